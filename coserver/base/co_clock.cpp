@@ -0,0 +1,62 @@
+#include <cstdio>
+#include "base/co_clock.h"
+
+
+namespace coserver
+{
+
+thread_local CoClockCache g_clockCache;
+
+static const char* HTTP_DATE_WEEKDAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char* HTTP_DATE_MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+
+void CoClock::init(int32_t clockSource)
+{
+    g_clockCache.m_clockId = (CLOCK_SOURCE_COARSE == clockSource) ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC;
+    update();
+}
+
+void CoClock::update()
+{
+    struct timespec ts;
+    clock_gettime(g_clockCache.m_clockId, &ts);
+    g_clockCache.m_monoUs = (uint64_t)(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    g_clockCache.m_wallUs = (uint64_t)(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t CoClock::wall_ms()
+{
+    if (g_clockCache.m_monoUs == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return (uint64_t)(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+    return g_clockCache.m_wallUs / 1000;
+}
+
+const char* CoClock::http_date()
+{
+    time_t sec = wall_ms() / 1000;
+    if (sec != g_clockCache.m_dateSec) {
+        struct tm gmt;
+        gmtime_r(&sec, &gmt);
+        snprintf(g_clockCache.m_httpDate, sizeof(g_clockCache.m_httpDate), "%s, %02d %s %04d %02d:%02d:%02d GMT", HTTP_DATE_WEEKDAYS[gmt.tm_wday],
+                gmt.tm_mday, HTTP_DATE_MONTHS[gmt.tm_mon], gmt.tm_year + 1900, gmt.tm_hour, gmt.tm_min, gmt.tm_sec);
+        g_clockCache.m_dateSec = sec;
+    }
+    return g_clockCache.m_httpDate;
+}
+
+void CoClock::localtime(time_t sec, struct tm* result)
+{
+    if (sec != g_clockCache.m_localSec) {
+        localtime_r(&sec, &(g_clockCache.m_localTm));
+        g_clockCache.m_localSec = sec;
+    }
+    *result = g_clockCache.m_localTm;
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef _CO_CLOCK_H_
+#define _CO_CLOCK_H_
+
+#include <ctime>
+#include <cstdint>
+
+
+namespace coserver
+{
+
+/*
+    worker线程缓存的时钟
+    dispatcher每次循环(epoll_wait前后/处理定时器前)调用update更新一次, 定时器/请求各阶段耗时/连接时间戳读取缓存 不再每次调用gettimeofday
+    单调时钟(CLOCK_MONOTONIC)不受NTP调整系统时间影响; 墙上时间只用于日志和HTTP Date头
+
+    缓存时间的精度是一次循环: 同一次循环中不切出协程的计算 读取到的时间不变
+    没有调用过update的线程(外部线程)直接读取系统时钟
+*/
+
+enum CoClockSource
+{
+    CLOCK_SOURCE_MONOTONIC = 1,     // CLOCK_MONOTONIC (vDSO, ns精度)
+    CLOCK_SOURCE_COARSE,            // CLOCK_MONOTONIC_COARSE (vDSO, 精度为一个jiffy 1-4ms, 读取更快)
+};
+
+struct CoClockCache
+{
+    clockid_t   m_clockId = CLOCK_MONOTONIC;
+    uint64_t    m_monoUs = 0;           // 单调时间 (us) 0表示没有缓存
+    uint64_t    m_wallUs = 0;           // 墙上时间 (us)
+
+    time_t      m_dateSec = 0;          // m_httpDate对应的秒
+    char        m_httpDate[32] = {0};   // HTTP Date头 (RFC 7231 IMF-fixdate)
+
+    time_t      m_localSec = -1;        // m_localTm对应的秒
+    struct tm   m_localTm;
+};
+
+extern thread_local CoClockCache g_clockCache;
+
+
+class CoClock
+{
+public:
+    // 设置当前线程的时钟源 并开始缓存
+    static void init(int32_t clockSource);
+
+    // 更新当前线程的缓存时间
+    static void update();
+
+    // 缓存的单调时间
+    static uint64_t now_ms()
+    {
+        return now_us() / 1000;
+    }
+
+    static uint64_t now_us()
+    {
+        if (g_clockCache.m_monoUs == 0) {
+            return mono_us();
+        }
+        return g_clockCache.m_monoUs;
+    }
+
+    // 缓存的墙上时间
+    static uint64_t wall_ms();
+
+    // 直接读取单调时钟 (不使用缓存, 其他线程中使用)
+    static uint64_t mono_us()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    static uint64_t mono_ms()
+    {
+        return mono_us() / 1000;
+    }
+
+    // HTTP Date头 每秒格式化一次
+    static const char* http_date();
+
+    // 日志使用 同一秒内不重复调用localtime_r
+    static void localtime(time_t sec, struct tm* result);
+};
+
+}
+
+#endif //_CO_CLOCK_H_
@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <functional>
+#include "base/co_clock.h"
 
 
 namespace coserver
@@ -14,8 +15,6 @@ namespace coserver
 // #define CO_DEBUG
 // #define CO_LOG_HTTP_DEBUG
 
-const std::string g_oneByteA = "a";
-
 
 const int32_t CO_EXCEPTION          = -5;   // 出现异常
 const int32_t CO_CONNECTION_CLOSE   = -4;   // 连接已关闭
@@ -85,7 +84,7 @@ inline void SAFE_CLOSE(FD &fd)
 }
 
 
-// time
+// time (墙上时间 每次调用gettimeofday, 框架内部使用CoClock缓存的单调时间)
 inline uint64_t GET_CURRENTTIME_MS() 
 {
     struct timeval tval;
@@ -11,6 +11,29 @@ namespace coserver
 const std::string CONF_CONFIG = "conf";
 const int32_t LOG_LEVEL = 1;
 const int32_t WORKER_THREADS = 4;
+const int32_t COROUTINE_STACK_MODE = 1;             // 1-shared 2-dedicated
+const int32_t COROUTINE_STACK_SIZE = 1024 * 1024;
+const int32_t COROUTINE_SHARED_STACKS = 1;
+const int32_t COROUTINE_STACK_ASSIGN = 1;           // 1-round_robin 2-occupancy
+const int64_t COROUTINE_BUFFER_CACHE = 64 * 1024 * 1024;
+const int32_t STATS_INTERVAL = 0;
+const int32_t WATCHDOG_BUDGET = 0;
+const int32_t CLOCK_SOURCE = 1;                     // 1-monotonic 2-coarse
+const int32_t TIMER_RESOLUTION = 1;                 // 1-ms 2-us
+const int32_t IO_TIMER_SLACK = 0;
+const int32_t KEEPALIVE_TIMER_SLACK = 0;
+const int32_t EVENT_BACKEND = 1;                    // 1-epoll 2-io_uring
+const int32_t EVENT_REGISTER = 1;                   // 1-dynamic 2-once
+const int32_t BUSY_POLL_US = 0;
+const int32_t SOCKET_BUSY_POLL = 0;
+const int32_t DISPATCH_BUDGET = 256;
+const int32_t MAX_TASKS = 1024;
+const int32_t PRIORITY_AGING = 50;
+const int32_t OFFLOAD_THREADS = 2;
+const int32_t OFFLOAD_QUEUE = 1024;
+const int32_t ACCEPT_MODE = 1;                      // 1-reuseport 2-acceptor 3-cpu
+const int32_t ACCEPTOR_THREADS = 1;
+const int32_t ACCEPT_BALANCE = 1;                   // 1-connections 2-lag
 
 // conf global
 const std::string HOOK_CONFIG = "hook";
@@ -32,6 +55,7 @@ const int32_t SERVER_MAX_CONNECTIONS = 65536;
 const int32_t SERVER_READ_TIMEOUT = 1000;
 const int32_t SERVER_WRITE_TIMEOUT = 1000;
 const int32_t SERVER_KEEPALIVE_TIMEOUT = 60000;
+const int32_t SERVER_PRIORITY = 1;                  // 0-high 1-normal 2-low
 
 // upstream config
 const std::string UPSTREAM_CONFIG = "upstream";
@@ -49,10 +73,56 @@ const int32_t UPSTREAM_CONNECTION_MAX_TIME = 60000;
 const int32_t UPSTREAM_RETRY_MAX_NUM = 3;
 
 
+/*
+    接受新连接的方式
+    reuseport: 每个worker线程监听同一个端口(SO_REUSEPORT) 内核选择worker, 不考虑worker的负载
+    acceptor: acceptor线程接受新连接 按负载选择worker, 通过worker的邮箱交给worker线程 (core/co_acceptor.h)
+    cpu: 每个worker一个reuseport监听socket 按收到连接的CPU选择worker, worker线程绑定CPU (core/co_reuseport.h)
+*/
+enum CoAcceptMode
+{
+    ACCEPT_MODE_REUSEPORT = 1,
+    ACCEPT_MODE_ACCEPTOR,
+    ACCEPT_MODE_CPU,
+};
+
+// acceptor选择worker的负载指标
+enum CoAcceptBalance
+{
+    ACCEPT_BALANCE_CONNECTIONS = 1,     // 活跃连接数最少
+    ACCEPT_BALANCE_LAG,                 // 调度循环延迟最低 (循环处理时间的滑动平均) 相同时连接数最少
+};
+
 struct CoConf
 {
     int32_t m_logLevel      = LOG_LEVEL;
     int32_t m_workerThreads = WORKER_THREADS;
+
+    int32_t m_coroutineStackMode = COROUTINE_STACK_MODE;    // 协程栈模式 共享栈/独立栈
+    int32_t m_coroutineStackSize = COROUTINE_STACK_SIZE;    // 协程栈大小 (byte)
+    int32_t m_coroutineSharedStacks = COROUTINE_SHARED_STACKS;  // 共享栈模式 每个线程的共享栈数量
+    int32_t m_coroutineStackAssign = COROUTINE_STACK_ASSIGN;    // 共享栈模式 协程分配共享栈的方式
+    int64_t m_coroutineBufferCache = COROUTINE_BUFFER_CACHE;    // 共享栈模式 每个线程缓存的栈备份缓冲区上限 (byte)
+
+    int32_t m_statsInterval = STATS_INTERVAL;               // 统计信息日志输出间隔 (ms) 0表示关闭
+    int32_t m_watchdogBudget = WATCHDOG_BUDGET;             // 一次调度不切出协程的最长时间 超过时看门狗告警 (ms) 0表示关闭
+    int32_t m_clockSource = CLOCK_SOURCE;                   // worker线程缓存时间使用的时钟源
+    int32_t m_timerResolution = TIMER_RESOLUTION;           // 定时器精度 us时使用timerfd
+    int32_t m_ioTimerSlack = IO_TIMER_SLACK;                // 读写超时定时器重置时 超时时间对齐的粒度 (ms) 0表示不对齐
+    int32_t m_keepaliveTimerSlack = KEEPALIVE_TIMER_SLACK;  // keepalive定时器重置时 超时时间对齐的粒度 (ms) 0表示不对齐
+    int32_t m_eventBackend = EVENT_BACKEND;                 // 事件后端 epoll/io_uring
+    int32_t m_eventRegister = EVENT_REGISTER;               // 连接socket事件注册方式 dynamic/once
+    int32_t m_busyPollUs = BUSY_POLL_US;                    // 阻塞等待事件前 非阻塞轮询事件的时间 (us) 0表示关闭
+    int32_t m_socketBusyPoll = SOCKET_BUSY_POLL;            // 监听/客户端socket设置SO_BUSY_POLL (us) 0表示不设置
+    int32_t m_dispatchBudget = DISPATCH_BUDGET;             // 一次调度循环每个任务来源最多处理的任务数 0表示不限制
+    int32_t m_maxTasks = MAX_TASKS;                         // 每个worker线程同时存在的spawn子协程上限 超过时spawn返回错误
+    int32_t m_priorityAging = PRIORITY_AGING;               // 运行队列中每低一级优先级 最多多等待的时间 防止饿死 (ms)
+    int32_t m_offloadThreads = OFFLOAD_THREADS;             // 默认辅助线程池(offload)的线程数 0表示不创建
+    int32_t m_offloadQueue = OFFLOAD_QUEUE;                 // 默认辅助线程池的队列上限 超过时拒绝
+    int32_t m_acceptMode = ACCEPT_MODE;                     // 接受新连接的方式 reuseport/acceptor
+    int32_t m_acceptorThreads = ACCEPTOR_THREADS;           // acceptor模式 接受新连接的线程数
+    int32_t m_acceptBalance = ACCEPT_BALANCE;               // acceptor模式 选择worker的负载指标 connections/lag
+    std::vector<int32_t> m_workerCpus;                      // 每个worker线程绑定的CPU 空表示不绑定(cpu模式时worker i绑定CPU i)
 };
 
 // hook
@@ -75,6 +145,7 @@ struct CoConfServer
     int32_t     m_keepaliveTimeout  = SERVER_KEEPALIVE_TIMEOUT;  // 连接最长保活时间, 过后将清理连接
 
     int32_t     m_maxConnections    = SERVER_MAX_CONNECTIONS;    // 最大连接数
+    int32_t     m_priority          = SERVER_PRIORITY;           // 连接/请求的调度优先级 high/normal/low
 };
 
 // upstream conf
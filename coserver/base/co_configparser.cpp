@@ -1,6 +1,11 @@
 #include "base/co_configparser.h"
 #include "base/co_log.h"
 #include "base/co_dns.h"
+#include "base/co_coroutine.h"
+#include "base/co_timer.h"
+#include "base/co_event_backend.h"
+#include "base/co_epoll.h"
+#include "base/co_run_queue.h"
 #include <stdlib.h>
 #include <fstream>
 #include <sstream>
@@ -207,6 +212,308 @@ bool CoConfigParser::parse_config_conf(const CoBlockArgs &blockArgs)
             }
             conf.m_workerThreads = atoi(lineArgs.m_args[1].c_str());
 
+        } else if (configKey == "coroutine_stack_mode") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "shared") {
+                conf.m_coroutineStackMode = COROUTINE_STACK_SHARED;
+            } else if (lineArgs.m_args[1] == "dedicated") {
+                conf.m_coroutineStackMode = COROUTINE_STACK_DEDICATED;
+            } else {
+                CO_SERVER_LOG_ERROR("coroutine_stack_mode '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
+        } else if (configKey == "coroutine_stack_size") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_coroutineStackSize = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "coroutine_shared_stacks") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_coroutineSharedStacks = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "coroutine_buffer_cache") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_coroutineBufferCache = atoll(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "coroutine_stack_assign") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "round_robin") {
+                conf.m_coroutineStackAssign = COROUTINE_ASSIGN_ROUND_ROBIN;
+            } else if (lineArgs.m_args[1] == "occupancy") {
+                conf.m_coroutineStackAssign = COROUTINE_ASSIGN_OCCUPANCY;
+            } else {
+                CO_SERVER_LOG_ERROR("coroutine_stack_assign '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
+        } else if (configKey == "stats_interval") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_statsInterval = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "watchdog_budget") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_watchdogBudget = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "clock_source") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "monotonic") {
+                conf.m_clockSource = CLOCK_SOURCE_MONOTONIC;
+            } else if (lineArgs.m_args[1] == "coarse") {
+                conf.m_clockSource = CLOCK_SOURCE_COARSE;
+            } else {
+                CO_SERVER_LOG_ERROR("clock_source '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
+        } else if (configKey == "timer_resolution") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "ms") {
+                conf.m_timerResolution = TIMER_RESOLUTION_MS;
+            } else if (lineArgs.m_args[1] == "us") {
+                conf.m_timerResolution = TIMER_RESOLUTION_US;
+            } else {
+                CO_SERVER_LOG_ERROR("timer_resolution '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
+        } else if (configKey == "event_backend") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "epoll") {
+                conf.m_eventBackend = EVENT_BACKEND_EPOLL;
+            } else if (lineArgs.m_args[1] == "io_uring") {
+                conf.m_eventBackend = EVENT_BACKEND_IO_URING;
+            } else {
+                CO_SERVER_LOG_ERROR("event_backend '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
+        } else if (configKey == "event_register") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "dynamic") {
+                conf.m_eventRegister = EVENT_REGISTER_DYNAMIC;
+            } else if (lineArgs.m_args[1] == "once") {
+                conf.m_eventRegister = EVENT_REGISTER_ONCE;
+            } else {
+                CO_SERVER_LOG_ERROR("event_register '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
+        } else if (configKey == "busy_poll_us") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_busyPollUs = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "socket_busy_poll") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_socketBusyPoll = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "dispatch_budget") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_dispatchBudget = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "max_tasks") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_maxTasks = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "priority_aging") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_priorityAging = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "offload_threads") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_offloadThreads = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "offload_queue") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_offloadQueue = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "accept_mode") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "reuseport") {
+                conf.m_acceptMode = ACCEPT_MODE_REUSEPORT;
+            } else if (lineArgs.m_args[1] == "acceptor") {
+                conf.m_acceptMode = ACCEPT_MODE_ACCEPTOR;
+            } else if (lineArgs.m_args[1] == "cpu") {
+                conf.m_acceptMode = ACCEPT_MODE_CPU;
+            } else {
+                CO_SERVER_LOG_ERROR("accept_mode '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
+        } else if (configKey == "acceptor_threads") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_acceptorThreads = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "accept_balance") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "connections") {
+                conf.m_acceptBalance = ACCEPT_BALANCE_CONNECTIONS;
+            } else if (lineArgs.m_args[1] == "lag") {
+                conf.m_acceptBalance = ACCEPT_BALANCE_LAG;
+            } else {
+                CO_SERVER_LOG_ERROR("accept_balance '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
+        } else if (configKey == "worker_cpus") {
+            if (lineArgs.m_args.size() < 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            conf.m_workerCpus.clear();
+            for (size_t j=1; j<lineArgs.m_args.size(); ++j) {
+                if (!CheckNumber(lineArgs.m_args[j])) {
+                    CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[j].c_str(), lineArgs.m_lineno);
+                    return false;
+                }
+                conf.m_workerCpus.push_back(atoi(lineArgs.m_args[j].c_str()));
+            }
+
+        } else if (configKey == "io_timer_slack") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_ioTimerSlack = atoi(lineArgs.m_args[1].c_str());
+
+        } else if (configKey == "keepalive_timer_slack") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+            if (!CheckNumber(lineArgs.m_args[1])) {
+                CO_SERVER_LOG_ERROR("'%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+            conf.m_keepaliveTimerSlack = atoi(lineArgs.m_args[1].c_str());
+
         } else {
             CO_SERVER_LOG_WARN("unknow parameter '%s': %d", configKey.c_str(), lineArgs.m_lineno);         
         }
@@ -276,6 +583,23 @@ bool CoConfigParser::parse_config_server(const CoBlockArgs &blockArgs)
             }
             configServer->m_maxConnections = atoi(lineArgs.m_args[1].c_str());
 
+        } else if (configKey == "priority") {
+            if (lineArgs.m_args.size() != 2) {
+                CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
+                return false;
+            }
+
+            if (lineArgs.m_args[1] == "high") {
+                configServer->m_priority = PRIORITY_HIGH;
+            } else if (lineArgs.m_args[1] == "normal") {
+                configServer->m_priority = PRIORITY_NORMAL;
+            } else if (lineArgs.m_args[1] == "low") {
+                configServer->m_priority = PRIORITY_LOW;
+            } else {
+                CO_SERVER_LOG_ERROR("priority '%s' unexpected: %d", lineArgs.m_args[1].c_str(), lineArgs.m_lineno);
+                return false;
+            }
+
         } else if (configKey == "keepalive_timeout") {
             if (lineArgs.m_args.size() != 2) {
                 CO_SERVER_LOG_ERROR("parameter number error: %d", lineArgs.m_lineno);
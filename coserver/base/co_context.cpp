@@ -0,0 +1,181 @@
+#include <string.h>
+#include "base/co_context.h"
+#include "base/co_common.h"
+
+
+#if !(CO_CONTEXT_UCONTEXT)
+
+#if defined(__x86_64__)
+/*
+    rdi: from  rsi: to
+    call压入的返回地址作为rip保存 rsp保存为返回后的值, 切换不依赖共享栈上[rsp, &dummy)之间的数据
+    新上下文首次切入时 rdi为arg 直接跳转到入口函数
+*/
+asm(
+    ".text\n"
+    ".globl co_context_switch\n"
+    ".type co_context_switch, @function\n"
+    ".p2align 4\n"
+    "co_context_switch:\n"
+    "    movq    (%rsp), %rax\n"
+    "    leaq    8(%rsp), %rdx\n"
+    "    movq    %rbx, 0(%rdi)\n"
+    "    movq    %rbp, 8(%rdi)\n"
+    "    movq    %r12, 16(%rdi)\n"
+    "    movq    %r13, 24(%rdi)\n"
+    "    movq    %r14, 32(%rdi)\n"
+    "    movq    %r15, 40(%rdi)\n"
+    "    movq    %rdx, 48(%rdi)\n"
+    "    movq    %rax, 56(%rdi)\n"
+    "    stmxcsr 64(%rdi)\n"
+    "    fnstcw  68(%rdi)\n"
+    "    movq    0(%rsi), %rbx\n"
+    "    movq    8(%rsi), %rbp\n"
+    "    movq    16(%rsi), %r12\n"
+    "    movq    24(%rsi), %r13\n"
+    "    movq    32(%rsi), %r14\n"
+    "    movq    40(%rsi), %r15\n"
+    "    movq    48(%rsi), %rsp\n"
+    "    ldmxcsr 64(%rsi)\n"
+    "    fldcw   68(%rsi)\n"
+    "    movq    72(%rsi), %rdi\n"
+    "    jmpq    *56(%rsi)\n"
+    ".size co_context_switch, .-co_context_switch\n"
+    "\n"
+    ".globl co_context_trap\n"
+    ".type co_context_trap, @function\n"
+    "co_context_trap:\n"
+    "    ud2\n"
+    ".size co_context_trap, .-co_context_trap\n"
+);
+
+#else
+/*
+    x0: from  x1: to
+    lr作为pc保存 新上下文首次切入时 x0为arg
+*/
+asm(
+    ".text\n"
+    ".globl co_context_switch\n"
+    ".type co_context_switch, %function\n"
+    ".p2align 4\n"
+    "co_context_switch:\n"
+    "    mov     x9, sp\n"
+    "    stp     x19, x20, [x0, #0]\n"
+    "    stp     x21, x22, [x0, #16]\n"
+    "    stp     x23, x24, [x0, #32]\n"
+    "    stp     x25, x26, [x0, #48]\n"
+    "    stp     x27, x28, [x0, #64]\n"
+    "    stp     x29, x30, [x0, #80]\n"
+    "    stp     x9,  x30, [x0, #96]\n"
+    "    stp     d8,  d9,  [x0, #112]\n"
+    "    stp     d10, d11, [x0, #128]\n"
+    "    stp     d12, d13, [x0, #144]\n"
+    "    stp     d14, d15, [x0, #160]\n"
+    "    mrs     x10, fpcr\n"
+    "    str     x10, [x0, #176]\n"
+    "    ldp     x19, x20, [x1, #0]\n"
+    "    ldp     x21, x22, [x1, #16]\n"
+    "    ldp     x23, x24, [x1, #32]\n"
+    "    ldp     x25, x26, [x1, #48]\n"
+    "    ldp     x27, x28, [x1, #64]\n"
+    "    ldp     x29, x30, [x1, #80]\n"
+    "    ldp     x9,  x11, [x1, #96]\n"
+    "    mov     sp, x9\n"
+    "    ldp     d8,  d9,  [x1, #112]\n"
+    "    ldp     d10, d11, [x1, #128]\n"
+    "    ldp     d12, d13, [x1, #144]\n"
+    "    ldp     d14, d15, [x1, #160]\n"
+    "    ldr     x10, [x1, #176]\n"
+    "    msr     fpcr, x10\n"
+    "    ldr     x0, [x1, #184]\n"
+    "    br      x11\n"
+    ".size co_context_switch, .-co_context_switch\n"
+    "\n"
+    ".globl co_context_trap\n"
+    ".type co_context_trap, %function\n"
+    "co_context_trap:\n"
+    "    brk     #0\n"
+    ".size co_context_trap, .-co_context_trap\n"
+);
+
+#endif
+
+extern "C" void co_context_trap();
+
+#endif
+
+
+namespace coserver
+{
+
+#if (CO_CONTEXT_UCONTEXT)
+
+int32_t co_context_init(CoContext* context, char* stack, uint32_t stackSize, CoContextFunc func, void* arg)
+{
+    if (-1 == getcontext(&(context->m_ucontext)))
+        return CO_ERROR;
+
+    context->m_ucontext.uc_stack.ss_sp = stack;
+    context->m_ucontext.uc_stack.ss_size = stackSize;
+    context->m_ucontext.uc_link = NULL;
+    makecontext(&(context->m_ucontext), (void(*)(void)) func, 1, arg);
+    return CO_OK;
+}
+
+const char* co_context_backend()
+{
+    return "ucontext";
+}
+
+#else
+
+int32_t co_context_init(CoContext* context, char* stack, uint32_t stackSize, CoContextFunc func, void* arg)
+{
+    memset(context->m_regs, 0, sizeof(context->m_regs));
+
+    // 栈顶16字节对齐
+    uintptr_t top = ((uintptr_t)(stack + stackSize)) & ~((uintptr_t)15);
+
+#if defined(__x86_64__)
+    // 模拟call指令: 入口处 (rsp + 8) 16字节对齐, 返回地址指向trap 入口函数不允许返回
+    void** sp = (void**)(top - sizeof(void*));
+    *sp = (void*)&co_context_trap;
+
+    context->m_regs[6] = (void*)sp;
+    context->m_regs[7] = (void*)func;
+    context->m_regs[9] = arg;
+
+    // 继承当前线程的浮点控制状态
+    uint32_t mxcsr = 0;
+    uint16_t fpucw = 0;
+    asm volatile("stmxcsr %0" : "=m"(mxcsr));
+    asm volatile("fnstcw %0" : "=m"(fpucw));
+    memcpy((char*)context->m_regs + 64, &mxcsr, sizeof(mxcsr));
+    memcpy((char*)context->m_regs + 68, &fpucw, sizeof(fpucw));
+#else
+    uint64_t fpcr = 0;
+    asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+
+    context->m_regs[11] = (void*)&co_context_trap;  // x30
+    context->m_regs[12] = (void*)top;               // sp
+    context->m_regs[13] = (void*)func;              // pc
+    context->m_regs[22] = (void*)fpcr;
+    context->m_regs[23] = arg;
+#endif
+
+    return CO_OK;
+}
+
+const char* co_context_backend()
+{
+#if defined(__x86_64__)
+    return "asm_x86_64";
+#else
+    return "asm_aarch64";
+#endif
+}
+
+#endif
+
+}
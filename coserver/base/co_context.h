@@ -0,0 +1,63 @@
+#ifndef _CO_CONTEXT_H_
+#define _CO_CONTEXT_H_
+
+#include <cstdint>
+
+/*
+    协程上下文切换后端
+    默认: x86_64/aarch64 使用汇编实现 只保存callee-saved寄存器 不切换信号掩码(swapcontext每次切换都会调用rt_sigprocmask)
+    回退: make FLAGS="-DCO_CONTEXT_UCONTEXT" 或其他平台 使用glibc ucontext
+*/
+#if !(CO_CONTEXT_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#undef  CO_CONTEXT_UCONTEXT
+#define CO_CONTEXT_UCONTEXT 1
+#endif
+
+#if (CO_CONTEXT_UCONTEXT)
+#include <ucontext.h>
+#endif
+
+
+#if !(CO_CONTEXT_UCONTEXT)
+extern "C" void co_context_switch(void* from, void* to);
+#endif
+
+namespace coserver
+{
+
+typedef void (*CoContextFunc)(void* arg);
+
+struct CoContext
+{
+#if (CO_CONTEXT_UCONTEXT)
+    ucontext_t      m_ucontext;
+#elif defined(__x86_64__)
+    // rbx rbp r12 r13 r14 r15 rsp rip mxcsr/fpucw arg
+    void*           m_regs[10];
+#else
+    // x19-x28 x29 x30 sp pc d8-d15 fpcr arg
+    void*           m_regs[24];
+#endif
+};
+
+// 初始化上下文 切入后在stack上执行func(arg), func不能返回
+int32_t co_context_init(CoContext* context, char* stack, uint32_t stackSize, CoContextFunc func, void* arg);
+
+// 保存当前上下文到from 切换到to
+// 内联到调用处: 共享栈只备份调用者栈帧以上的数据, 切换函数不能有自己的栈帧
+static inline int32_t co_context_swap(CoContext* from, CoContext* to)
+{
+#if (CO_CONTEXT_UCONTEXT)
+    return swapcontext(&(from->m_ucontext), &(to->m_ucontext));
+#else
+    co_context_switch(from, to);
+    return 0;
+#endif
+}
+
+// 当前使用的切换后端名称
+const char* co_context_backend();
+
+}
+
+#endif //_CO_CONTEXT_H_
@@ -1,7 +1,10 @@
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <sys/mman.h>
 #include "base/co_coroutine.h"
 #include "base/co_common.h"
+#include "base/co_log.h"
 
 
 namespace coserver
@@ -10,6 +13,98 @@ namespace coserver
 const int32_t MIN_SHARED_STACK_SIZE = 1024;            // 1k
 const int32_t MAX_SHARED_STACK_SIZE = 10*1024*1024;    // 10M
 const int32_t BEST_SHARED_STACK_SIZE = 1024*1024;      // 1M
+const int32_t MAX_DEDICATED_STACK_SIZE = 256*1024*1024;    // 256M 独立栈MAP_NORESERVE 只占用地址空间
+
+const size_t MAX_FREE_STACKS = 1024;                   // 独立栈模式 空闲栈池最大数量
+const int32_t MAX_SHARED_STACKS = 64;                  // 共享栈模式 最大共享栈数量
+
+const uint32_t MIN_BUFFER_CLASS_SHIFT = 10;            // 栈备份缓冲区 最小1k
+const uint32_t MAX_BUFFER_CLASS_SHIFT = 24;            // 栈备份缓冲区 最大16M (大于最大栈10M)
+const uint64_t BUFFER_TRIM_INTERVAL = 1000;            // 栈备份缓冲区 trim间隔 (ms)
+
+const uint64_t STACK_PAINT_PATTERN = 0xc5c5c5c5c5c5c5c5UL;  // CO_STACK_PAINT 栈填充内容
+
+
+CoStackBufferPool::CoStackBufferPool()
+: m_classes(MAX_BUFFER_CLASS_SHIFT - MIN_BUFFER_CLASS_SHIFT + 1)
+{
+}
+
+CoStackBufferPool::~CoStackBufferPool()
+{
+    for (auto &sizeClass : m_classes) {
+        for (auto &buffer : sizeClass.m_freeBuffers) {
+            free(buffer);
+        }
+        sizeClass.m_freeBuffers.clear();
+    }
+}
+
+void CoStackBufferPool::init(uint64_t maxCacheBytes, CoCoroutineStats* stats)
+{
+    m_maxCacheBytes = maxCacheBytes;
+    m_stats = stats;
+}
+
+char* CoStackBufferPool::get(uint32_t size, uint32_t &cap)
+{
+    uint32_t shift = MIN_BUFFER_CLASS_SHIFT;
+    while ((1U << shift) < size) {
+        shift++;
+    }
+    cap = 1U << shift;
+    m_stats->m_bufferInUse += cap;
+
+    CoSizeClass &sizeClass = m_classes[shift - MIN_BUFFER_CLASS_SHIFT];
+    if (!sizeClass.m_freeBuffers.empty()) {
+        char* buffer = sizeClass.m_freeBuffers.back();
+        sizeClass.m_freeBuffers.pop_back();
+        if (sizeClass.m_freeBuffers.size() < sizeClass.m_minFree) {
+            sizeClass.m_minFree = sizeClass.m_freeBuffers.size();
+        }
+
+        m_stats->m_bufferCached -= cap;
+        m_stats->m_bufferCacheHits++;
+        return buffer;
+    }
+
+    m_stats->m_bufferAllocs++;
+    return (char*)malloc(cap);
+}
+
+void CoStackBufferPool::put(char* buffer, uint32_t cap)
+{
+    m_stats->m_bufferInUse -= cap;
+
+    // 超过缓存上限 直接释放
+    if (m_stats->m_bufferCached + cap > m_maxCacheBytes) {
+        free(buffer);
+        return ;
+    }
+
+    uint32_t shift = MIN_BUFFER_CLASS_SHIFT;
+    while ((1U << shift) < cap) {
+        shift++;
+    }
+    m_classes[shift - MIN_BUFFER_CLASS_SHIFT].m_freeBuffers.push_back(buffer);
+    m_stats->m_bufferCached += cap;
+}
+
+void CoStackBufferPool::trim()
+{
+    // 上个周期内一直没有被使用的缓冲区 释放
+    for (size_t i=0; i<m_classes.size(); ++i) {
+        CoSizeClass &sizeClass = m_classes[i];
+        uint32_t cap = 1U << (i + MIN_BUFFER_CLASS_SHIFT);
+
+        for (size_t j=0; j<sizeClass.m_minFree && !sizeClass.m_freeBuffers.empty(); ++j) {
+            free(sizeClass.m_freeBuffers.back());
+            sizeClass.m_freeBuffers.pop_back();
+            m_stats->m_bufferCached -= cap;
+        }
+        sizeClass.m_minFree = sizeClass.m_freeBuffers.size();
+    }
+}
 
 
 CoCoroutine::CoCoroutine()
@@ -18,13 +113,20 @@ CoCoroutine::CoCoroutine()
 
 CoCoroutine::~CoCoroutine()
 {
-    SAFE_FREE(m_interStack);
+    if (m_coroutineMain) {
+        m_coroutineMain->release_stack(this);
+    }
 }
 
 void CoCoroutine::reset()
 {
     m_coroutineStatus = CoroutineStatus::COROUTINE_READY;
     m_func = NULL;
+
+    // 挂起中被重置的协程 不会再切入 归还独立栈/共享栈所属
+    if (m_coroutineMain) {
+        m_coroutineMain->release_stack(this);
+    }
 }
 
 
@@ -34,67 +136,337 @@ CoCoroutineMain::CoCoroutineMain()
 
 CoCoroutineMain::~CoCoroutineMain()
 {
-    SAFE_DELETE_ARRAY(m_sharedStack);
+    for (auto &sharedStack : m_sharedStacks) {
+        SAFE_DELETE_ARRAY(sharedStack.m_stack);
+    }
+    m_sharedStacks.clear();
+
+    for (auto &stack : m_freeStacks) {
+        munmap(stack - m_pageSize, m_stackSize + m_pageSize);
+    }
+    m_freeStacks.clear();
 }
 
-int32_t CoCoroutineMain::init(uint32_t sharedStackSize)
+int32_t CoCoroutineMain::init(uint32_t stackSize, int32_t stackMode, int32_t sharedStacks, int32_t stackAssign, uint64_t bufferCacheBytes)
 {
-    // shared stack
-    m_sharedStackSize = sharedStackSize < MIN_SHARED_STACK_SIZE ? BEST_SHARED_STACK_SIZE : sharedStackSize;
-    m_sharedStackSize = sharedStackSize > MAX_SHARED_STACK_SIZE ? BEST_SHARED_STACK_SIZE : sharedStackSize;
-    m_sharedStack = new char[m_sharedStackSize];
+    m_stackMode = stackMode;
+    m_stackSize = stackSize;
+    uint32_t maxStackSize = (m_stackMode == COROUTINE_STACK_DEDICATED) ? MAX_DEDICATED_STACK_SIZE : MAX_SHARED_STACK_SIZE;
+    if (stackSize < (uint32_t)MIN_SHARED_STACK_SIZE || stackSize > maxStackSize) {
+        CO_SERVER_LOG_ERROR("coroutine stack size:%u out of range [%d, %u], use default:%d", stackSize, MIN_SHARED_STACK_SIZE, maxStackSize, BEST_SHARED_STACK_SIZE);
+        m_stackSize = BEST_SHARED_STACK_SIZE;
+    }
+
+    if (m_stackMode == COROUTINE_STACK_DEDICATED) {
+        // 独立栈 按页对齐, 栈在首次切入时从栈池分配
+        long pageSize = sysconf(_SC_PAGESIZE);
+        if (pageSize > 0) {
+            m_pageSize = pageSize;
+        }
+        m_stackSize = (m_stackSize + m_pageSize - 1) / m_pageSize * m_pageSize;
+        return CO_OK;
+    }
 
+    // shared stack
+    if (sharedStacks < 1 || sharedStacks > MAX_SHARED_STACKS) {
+        sharedStacks = 1;
+    }
+    m_stackAssign = stackAssign;
+    m_bufferPool.init(bufferCacheBytes, &m_stats);
+    m_sharedStacks.resize(sharedStacks);
+    for (auto &sharedStack : m_sharedStacks) {
+        sharedStack.m_stack = new char[m_stackSize];
+        paint_stack(sharedStack.m_stack);
+    }
     return CO_OK;
 }
 
-static void func_context(std::function<void()> *func)
+static void func_context(void* arg)
 {
+    std::function<void()> *func = (std::function<void()> *)arg;
     (*func)();
 }
 
 int32_t CoCoroutineMain::init_coroutine(std::function<void()> const &func, CoCoroutine* coroutine)
 {
-    if (-1 == getcontext(&(coroutine->m_context)))
-        return CO_ERROR;
-
     // param
     coroutine->m_func = func;
+    coroutine->m_coroutineMain = this;
+
+    char* stack = NULL;
+    if (m_stackMode == COROUTINE_STACK_DEDICATED) {
+        if (!coroutine->m_stack) {
+            coroutine->m_stack = alloc_stack();
+            if (!coroutine->m_stack) {
+                return CO_ERROR;
+            }
+        }
+        stack = coroutine->m_stack;
+
+    } else {
+        if (coroutine->m_sharedIndex < 0) {
+            coroutine->m_sharedIndex = assign_shared_stack();
+            m_sharedStacks[coroutine->m_sharedIndex].m_occupancy++;
+        }
+
+        // 新协程没有需要恢复的栈数据, 栈被其他挂起协程占用时 先保存其数据
+        CoSharedStack &sharedStack = m_sharedStacks[coroutine->m_sharedIndex];
+        release_buffer(coroutine);
+        coroutine->m_stackBottom = NULL;
+        switch_owner(sharedStack, coroutine);
+        stack = sharedStack.m_stack;
+    }
 
     // init m_context
-    coroutine->m_context.uc_stack.ss_sp = m_sharedStack;
-    coroutine->m_context.uc_stack.ss_size = m_sharedStackSize;
-    coroutine->m_context.uc_link = NULL;
-    makecontext(&(coroutine->m_context), (void(*)(void)) &func_context, 1, &(coroutine->m_func));
-    return CO_OK;
+    return co_context_init(&(coroutine->m_context), stack, m_stackSize, &func_context, &(coroutine->m_func));
 }
 
 int32_t CoCoroutineMain::swap_in(CoCoroutine* coroutine)
 {
-    // 将备份栈数据拷贝回协程运行栈上  继续执行
-    if (coroutine->m_interStackSize) {
-        memcpy(m_sharedStack + m_sharedStackSize - coroutine->m_interStackSize, coroutine->m_interStack, coroutine->m_interStackSize);
+    if (coroutine->m_sharedIndex >= 0) {
+        // 共享栈上是其他协程的数据时 才需要将备份栈数据拷贝回协程运行栈上
+        CoSharedStack &sharedStack = m_sharedStacks[coroutine->m_sharedIndex];
+        if (sharedStack.m_owner != coroutine) {
+            switch_owner(sharedStack, coroutine);
+        } else if (coroutine->m_stackBottom) {
+            m_stats.m_stackCopySkips++;
+        }
+    }
+
+    coroutine->m_runPeakDepth = 0;
+    m_curCoroutine = coroutine;
+    int32_t ret = co_context_swap(&m_contextMain, &(coroutine->m_context));
+    m_curCoroutine = NULL;
+
+    // 协程执行完毕 已经不在协程栈上运行 归还栈
+    if (coroutine->m_coroutineStatus == CoroutineStatus::COROUTINE_READY) {
+        release_stack(coroutine);
     }
-    return swapcontext(&m_contextMain, &(coroutine->m_context));
+    return ret;
 }
 
 int32_t CoCoroutineMain::swap_out(CoCoroutine* coroutine)
 {
-    // 共享栈保存 使用的堆栈数据
+    if (m_stackMode == COROUTINE_STACK_DEDICATED) {
+        // 独立栈 无需拷贝, 栈溢出时访问guard page触发SIGSEGV
+        char dummy = 0;
+        record_yield(coroutine, coroutine->m_stack + m_stackSize - &dummy);
+        return co_context_swap(&(coroutine->m_context), &m_contextMain);
+    }
+
+    // 共享栈 只记录使用的堆栈位置, 其他协程需要使用此共享栈时再保存
     char dummy = 0;
-    char* top = m_sharedStack + m_sharedStackSize;
+    char* top = m_sharedStacks[coroutine->m_sharedIndex].m_stack + m_stackSize;
     uint32_t currentStackSize = top - &dummy;
-    assert(currentStackSize <= m_sharedStackSize);    // 栈溢出 异常
-    
-    if (coroutine->m_interStackCap < currentStackSize) {
-        // optimize
-        coroutine->m_interStack = (char*)realloc(coroutine->m_interStack, currentStackSize);
-        coroutine->m_interStackCap = currentStackSize;
+    assert(currentStackSize <= m_stackSize);    // 栈溢出 异常
+    coroutine->m_stackBottom = &dummy;
+    record_yield(coroutine, currentStackSize);
+
+    return co_context_swap(&(coroutine->m_context), &m_contextMain);
+}
+
+int32_t CoCoroutineMain::assign_shared_stack()
+{
+    int32_t stackNum = m_sharedStacks.size();
+    if (stackNum == 1) {
+        return 0;
+    }
+
+    if (m_stackAssign == COROUTINE_ASSIGN_OCCUPANCY) {
+        // 挂起协程最少的栈, 相同时优先没有所属协程的栈
+        int32_t index = 0;
+        for (int32_t i=1; i<stackNum; ++i) {
+            const CoSharedStack &best = m_sharedStacks[index];
+            const CoSharedStack &cur = m_sharedStacks[i];
+            if (cur.m_occupancy < best.m_occupancy || (cur.m_occupancy == best.m_occupancy && !cur.m_owner && best.m_owner)) {
+                index = i;
+            }
+        }
+        return index;
+    }
+
+    return (m_nextShared++) % stackNum;
+}
+
+void CoCoroutineMain::switch_owner(CoSharedStack &sharedStack, CoCoroutine* coroutine)
+{
+    if (sharedStack.m_owner == coroutine) {
+        return ;
+    }
+
+    char* top = sharedStack.m_stack + m_stackSize;
+
+    // 保存原所属协程 使用的堆栈数据
+    CoCoroutine* owner = sharedStack.m_owner;
+    if (owner && owner->m_stackBottom) {
+        uint32_t saveSize = top - owner->m_stackBottom;
+        owner->m_interStack = m_bufferPool.get(saveSize, owner->m_interStackCap);
+        owner->m_interStackSize = saveSize;
+        memcpy(owner->m_interStack, owner->m_stackBottom, saveSize);
+        m_stats.m_stackCopies++;
+        m_stats.m_copyBytes += saveSize;
+    }
+
+    // 恢复当前协程的堆栈数据 数据回到共享栈后 缓冲区即归还
+    if (coroutine->m_interStackSize) {
+        memcpy(top - coroutine->m_interStackSize, coroutine->m_interStack, coroutine->m_interStackSize);
+        m_stats.m_stackCopies++;
+        m_stats.m_copyBytes += coroutine->m_interStackSize;
+    }
+    release_buffer(coroutine);
+
+    sharedStack.m_owner = coroutine;
+}
+
+char* CoCoroutineMain::alloc_stack()
+{
+    if (!m_freeStacks.empty()) {
+        char* stack = m_freeStacks.back();
+        m_freeStacks.pop_back();
+        if (m_freeStacks.size() < m_freeStacksMinFree) {
+            m_freeStacksMinFree = m_freeStacks.size();
+        }
+        return stack;
+    }
+
+    // 栈底(低地址)一页作为guard page
+    size_t mapSize = m_stackSize + m_pageSize;
+    void* mem = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        CO_SERVER_LOG_ERROR("coroutine stack mmap failed, size:%lu error:%s", mapSize, strerror(errno));
+        return NULL;
+    }
+
+    if (0 != mprotect(mem, m_pageSize, PROT_NONE)) {
+        CO_SERVER_LOG_ERROR("coroutine stack guard page mprotect failed, error:%s", strerror(errno));
+        munmap(mem, mapSize);
+        return NULL;
+    }
+
+    paint_stack((char*)mem + m_pageSize);
+    return (char*)mem + m_pageSize;
+}
+
+void CoCoroutineMain::release_stack(CoCoroutine* coroutine)
+{
+    // 协程还在自己的栈上运行(比如协程内重置连接), 等切出后由swap_in归还
+    if (coroutine == m_curCoroutine) {
+        return ;
+    }
+
+    if (coroutine->m_sharedIndex >= 0) {
+        // 共享栈上的数据不再需要保存
+        CoSharedStack &sharedStack = m_sharedStacks[coroutine->m_sharedIndex];
+        if (sharedStack.m_owner == coroutine) {
+            sharedStack.m_owner = NULL;
+        }
+        sharedStack.m_occupancy--;
+
+        coroutine->m_sharedIndex = -1;
+        coroutine->m_stackBottom = NULL;
+        release_buffer(coroutine);
+        return ;
+    }
+
+    if (!coroutine->m_stack) {
+        return ;
+    }
+
+    char* stack = coroutine->m_stack;
+    coroutine->m_stack = NULL;
+    check_paint(stack);
+
+    if (m_freeStacks.size() < MAX_FREE_STACKS) {
+        m_freeStacks.push_back(stack);
+        return ;
+    }
+    munmap(stack - m_pageSize, m_stackSize + m_pageSize);
+}
+
+void CoCoroutineMain::release_buffer(CoCoroutine* coroutine)
+{
+    if (coroutine->m_interStack) {
+        m_bufferPool.put(coroutine->m_interStack, coroutine->m_interStackCap);
+        coroutine->m_interStack = NULL;
+        coroutine->m_interStackCap = 0;
+    }
+    coroutine->m_interStackSize = 0;
+}
+
+void CoCoroutineMain::trim_buffers()
+{
+    uint64_t now = CoClock::now_ms();
+    if (now - m_lastTrimTime < BUFFER_TRIM_INTERVAL) {
+        return ;
+    }
+    m_lastTrimTime = now;
+
+    m_bufferPool.trim();
+
+    // 上个周期内一直空闲的独立栈 释放 (栈上用过的页一直驻留内存)
+    for (size_t i=0; i<m_freeStacksMinFree && !m_freeStacks.empty(); ++i) {
+        char* stack = m_freeStacks.back();
+        m_freeStacks.pop_back();
+        munmap(stack - m_pageSize, m_stackSize + m_pageSize);
+    }
+    m_freeStacksMinFree = m_freeStacks.size();
+}
+
+void CoCoroutineMain::record_yield(CoCoroutine* coroutine, uint32_t depth)
+{
+    int32_t bucket = 0;
+    while (bucket < STACK_DEPTH_BUCKETS - 1 && (depth >> (bucket + 1))) {
+        bucket++;
+    }
+
+    m_stats.m_yields++;
+    m_stats.m_depthHistogram[bucket]++;
+    if (depth > m_stats.m_maxDepth) {
+        m_stats.m_maxDepth = depth;
+    }
+    if (depth > coroutine->m_runPeakDepth) {
+        coroutine->m_runPeakDepth = depth;
+    }
+}
+
+void CoCoroutineMain::paint_stack(char* stack)
+{
+#if (CO_STACK_PAINT)
+    uint64_t* begin = (uint64_t*)stack;
+    uint64_t* end = (uint64_t*)(stack + m_stackSize);
+    for (uint64_t* itr = begin; itr < end; ++itr) {
+        *itr = STACK_PAINT_PATTERN;
+    }
+#else
+    UNUSED(stack);
+#endif
+}
+
+void CoCoroutineMain::check_paint(char* stack)
+{
+#if (CO_STACK_PAINT)
+    // 从栈底(低地址)开始 第一个被修改的位置即为最大使用深度
+    uint64_t* begin = (uint64_t*)stack;
+    uint64_t* end = (uint64_t*)(stack + m_stackSize);
+    uint64_t* itr = begin;
+    while (itr < end && *itr == STACK_PAINT_PATTERN) {
+        ++itr;
     }
-    coroutine->m_interStackSize = currentStackSize;
-    memcpy(coroutine->m_interStack, &dummy, coroutine->m_interStackSize);
 
-    return swapcontext(&(coroutine->m_context), &m_contextMain);
+    uint32_t highWater = (char*)end - (char*)itr;
+    if (highWater > m_stats.m_paintHighWater) {
+        m_stats.m_paintHighWater = highWater;
+    }
+#else
+    UNUSED(stack);
+#endif
 }
 
+void CoCoroutineMain::check_stack_paint()
+{
+    for (auto &sharedStack : m_sharedStacks) {
+        check_paint(sharedStack.m_stack);
+    }
 }
 
+}
@@ -1,8 +1,11 @@
 #ifndef _CO_COROUTINE_H_
 #define _CO_COROUTINE_H_
 
-#include <ucontext.h>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
 #include <functional>
+#include "base/co_context.h"
 
 
 namespace coserver
@@ -16,19 +19,104 @@ enum CoroutineStatus
     COROUTINE_DOWN
 };
 
+enum CoroutineStackMode
+{
+    COROUTINE_STACK_SHARED = 1,     // 所有协程共用一个运行栈 切出时拷贝栈数据
+    COROUTINE_STACK_DEDICATED       // 每个运行中的协程独占一个mmap栈(带guard page) 切换无拷贝
+};
+
+enum CoroutineStackAssign
+{
+    COROUTINE_ASSIGN_ROUND_ROBIN = 1,   // 多共享栈 轮询分配
+    COROUTINE_ASSIGN_OCCUPANCY          // 多共享栈 分配给挂起协程最少的栈
+};
+
+struct CoCoroutine;
+class CoCoroutineMain;
+
+// 共享栈
+struct CoSharedStack
+{
+    char*           m_stack     = NULL;
+    CoCoroutine*    m_owner     = NULL;     // 当前栈上数据所属的协程, 切换所属协程时才需要保存/恢复栈数据
+    uint32_t        m_occupancy = 0;        // 分配到此栈且未结束的协程数量
+};
+
+const int32_t STACK_DEPTH_BUCKETS = 25;   // 栈深度直方图 按2的幂分桶 [2^i, 2^(i+1))
+
+// 协程统计
+struct CoCoroutineStats
+{
+    uint64_t        m_yields         = 0;   // 协程切出次数
+    uint64_t        m_depthHistogram[STACK_DEPTH_BUCKETS] = {0};  // 切出时栈深度(共享栈需要保存的字节数)分布
+    uint32_t        m_maxDepth       = 0;   // 切出时的最大栈深度
+    uint32_t        m_paintHighWater = 0;   // CO_STACK_PAINT 栈填充检测到的真实最大使用深度
+
+    uint64_t        m_copyBytes      = 0;   // 共享栈 保存/恢复拷贝的总字节数
+
+    uint64_t        m_stackCopies    = 0;   // 共享栈 实际发生的保存/恢复拷贝次数
+    uint64_t        m_stackCopySkips = 0;   // 共享栈 切入时栈所属协程未变 跳过的恢复拷贝次数
+
+    uint64_t        m_bufferAllocs   = 0;   // 栈备份缓冲区 malloc次数
+    uint64_t        m_bufferCacheHits= 0;   // 栈备份缓冲区 从缓存池获取次数
+    uint64_t        m_bufferCached   = 0;   // 栈备份缓冲区 缓存池中空闲的字节数
+    uint64_t        m_bufferInUse    = 0;   // 栈备份缓冲区 协程正在使用的字节数
+};
+
+/*
+    栈备份缓冲区池 (每个线程一个)
+    按2的幂分级缓存, 协程栈被其他协程占用时获取, 恢复到共享栈后即归还
+    缓存总量超过上限时直接释放, trim定期释放上个周期内一直空闲的缓冲区
+*/
+class CoStackBufferPool
+{
+public:
+    CoStackBufferPool();
+    ~CoStackBufferPool();
+
+    void init(uint64_t maxCacheBytes, CoCoroutineStats* stats);
+
+    // 获取至少size字节的缓冲区, cap返回实际大小
+    char* get(uint32_t size, uint32_t &cap);
+    void put(char* buffer, uint32_t cap);
+
+    void trim();
+
+private:
+    struct CoSizeClass
+    {
+        std::vector<char*>  m_freeBuffers;
+        size_t              m_minFree = 0;      // 上次trim后空闲数量的最小值
+    };
+
+    std::vector<CoSizeClass> m_classes;
+    uint64_t            m_maxCacheBytes = 0;
+    CoCoroutineStats*   m_stats = NULL;
+};
 
 struct CoCoroutine
 {
     CoroutineStatus     m_coroutineStatus = CoroutineStatus::COROUTINE_READY;
 
-    ucontext_t          m_context;
+    CoContext           m_context;
     std::function<void()>  m_func   = NULL;
 
-    // 协程内部堆栈  用于切出时临时保存协程信息
+    // 协程内部堆栈  用于共享栈被其他协程占用时 临时保存协程信息 (从CoStackBufferPool获取)
     char*           m_interStack    = NULL;
     uint32_t        m_interStackCap = 0;
     uint32_t        m_interStackSize= 0;
 
+    // 共享栈模式 分配的共享栈及切出时的栈底位置
+    int32_t         m_sharedIndex   = -1;
+    char*           m_stackBottom   = NULL;
+
+    // 本次切入运行期间 切出时的最大栈深度
+    uint32_t        m_runPeakDepth  = 0;
+
+    // 独立栈模式 协程运行期间持有的栈 协程结束后归还栈池
+    char*           m_stack         = NULL;
+    CoCoroutineMain* m_coroutineMain = NULL;
+
 
     CoCoroutine();
     ~CoCoroutine();
@@ -43,7 +131,7 @@ public:
     CoCoroutineMain();
     ~CoCoroutineMain();
 
-    int32_t init(uint32_t sharedStackSize);
+    int32_t init(uint32_t stackSize, int32_t stackMode = COROUTINE_STACK_SHARED, int32_t sharedStacks = 1, int32_t stackAssign = COROUTINE_ASSIGN_ROUND_ROBIN, uint64_t bufferCacheBytes = 64*1024*1024);
 
     // 初始化协程
     int32_t init_coroutine(std::function<void()> const &func, CoCoroutine* coroutine); // const important
@@ -54,12 +142,50 @@ public:
     // 切出 yield
     int32_t swap_out(CoCoroutine* coroutine);
 
+    // 协程结束或被重置 归还独立栈/释放共享栈所属
+    void release_stack(CoCoroutine* coroutine);
+
+    int32_t get_stack_mode() const { return m_stackMode; }
+    uint32_t get_stack_size() const { return m_stackSize; }
+    const CoCoroutineStats& get_stats() const { return m_stats; }
+
+    // 定期释放空闲的栈备份缓冲区/独立栈
+    void trim_buffers();
+
+    // CO_STACK_PAINT 扫描共享栈 更新真实最大使用深度
+    void check_stack_paint();
+
+
+private:
+    char* alloc_stack();
+
+    // 共享栈
+    int32_t assign_shared_stack();
+    void release_buffer(CoCoroutine* coroutine);
+    void record_yield(CoCoroutine* coroutine, uint32_t depth);
+    void paint_stack(char* stack);
+    void check_paint(char* stack);
+    void switch_owner(CoSharedStack &sharedStack, CoCoroutine* coroutine);
 
 private:
-    ucontext_t      m_contextMain;
+    CoContext       m_contextMain;
+    CoCoroutine*    m_curCoroutine  = NULL; // 正在运行的协程
+
+    int32_t         m_stackMode     = COROUTINE_STACK_SHARED;
+    uint32_t        m_stackSize     = 0;    // 协程栈大小
+
+    std::vector<CoSharedStack> m_sharedStacks;  // 共享栈空间
+    int32_t         m_stackAssign   = COROUTINE_ASSIGN_ROUND_ROBIN;
+    uint32_t        m_nextShared    = 0;    // 轮询分配位置
+
+    uint32_t        m_pageSize      = 4096;
+    std::vector<char*> m_freeStacks;        // 独立栈模式 空闲栈池
+    size_t          m_freeStacksMinFree = 0;    // 上次trim后空闲栈数量的最小值
+
+    CoCoroutineStats m_stats;
 
-    char*           m_sharedStack   = NULL; // 共享栈空间
-    uint32_t        m_sharedStackSize = 0;  // 共享栈大小
+    CoStackBufferPool m_bufferPool;         // 共享栈模式 栈备份缓冲区池
+    uint64_t        m_lastTrimTime  = 0;
 };
 
 }
@@ -1,3 +1,5 @@
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include "base/co_epoll.h"
 #include "base/co_log.h"
 #include "base/co_common.h"
@@ -10,8 +12,11 @@ namespace coserver
 
 const int32_t MIN_EV_NUMBER = 32;
 const int32_t MAX_EV_NUMBER = 1024;
+const int32_t EV_BATCH_SHRINK_ROUNDS = 16;  // 连续多次返回事件数不足1/4时 事件数组减半
 
 const uint32_t TIMER_INFINITE = -1;
+const uint64_t TIMERFD_EVENT_DATA = 0;     // conn id从1开始 0表示timerfd
+const uint64_t NOTIFYFD_EVENT_DATA = 1;    // conn id为0 version为1表示eventfd
 
 
 CoEpoll::CoEpoll()
@@ -20,19 +25,96 @@ CoEpoll::CoEpoll()
 
 CoEpoll::~CoEpoll()
 {
-    SAFE_CLOSE(m_epollFd);
+    SAFE_CLOSE(m_timerFd);
+    SAFE_CLOSE(m_notifyFd);
+    SAFE_DELETE(m_backend);
     SAFE_DELETE_ARRAY(m_events);
 }
 
-int32_t CoEpoll::init(int32_t maxConnSizes, int32_t eventSize) 
+int32_t CoEpoll::init(int32_t maxConnSizes, int32_t backendType, int32_t eventSize) 
 {
     m_eventsSize = eventSize > MAX_EV_NUMBER ? MAX_EV_NUMBER : eventSize;
-    m_eventsSize = eventSize < MIN_EV_NUMBER ? MIN_EV_NUMBER : eventSize;
+    m_eventsSize = m_eventsSize < MIN_EV_NUMBER ? MIN_EV_NUMBER : m_eventsSize;
+    m_eventsBatch = MIN_EV_NUMBER;
 
     m_events = new epoll_event[m_eventsSize];
-    m_epollFd = epoll_create(maxConnSizes / 2);
 
-    return m_epollFd < 0 ? m_epollFd : 0;
+    m_backend = CoEventBackend::create_backend(backendType);
+    if (m_backend->init(maxConnSizes) != CO_OK) {
+        if (EVENT_BACKEND_EPOLL == backendType) {
+            return CO_ERROR;
+        }
+
+        CO_SERVER_LOG_WARN("event backend %s init failed, use epoll", m_backend->name());
+        SAFE_DELETE(m_backend);
+        m_backend = CoEventBackend::create_backend(EVENT_BACKEND_EPOLL);
+        if (m_backend->init(maxConnSizes) != CO_OK) {
+            return CO_ERROR;
+        }
+    }
+
+    CO_SERVER_LOG_INFO("event backend:%s", m_backend->name());
+    return CO_OK;
+}
+
+int32_t CoEpoll::init_timerfd()
+{
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerFd < 0) {
+        CO_SERVER_LOG_ERROR("timerfd create failed, errno:%d", errno);
+        return CO_ERROR;
+    }
+
+    if (m_backend->ctl(EPOLL_CTL_ADD, m_timerFd, EPOLLIN, TIMERFD_EVENT_DATA) == -1) {
+        CO_SERVER_LOG_ERROR("epoll_ctl add timerfd:%d failed, errno:%d", m_timerFd, errno);
+        SAFE_CLOSE(m_timerFd);
+        return CO_ERROR;
+    }
+    return CO_OK;
+}
+
+int32_t CoEpoll::init_notifyfd()
+{
+    m_notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_notifyFd < 0) {
+        CO_SERVER_LOG_ERROR("eventfd create failed, errno:%d", errno);
+        return CO_ERROR;
+    }
+
+    if (m_backend->ctl(EPOLL_CTL_ADD, m_notifyFd, EPOLLIN | EPOLLET, NOTIFYFD_EVENT_DATA) == -1) {
+        CO_SERVER_LOG_ERROR("epoll_ctl add eventfd:%d failed, errno:%d", m_notifyFd, errno);
+        SAFE_CLOSE(m_notifyFd);
+        return CO_ERROR;
+    }
+    return CO_OK;
+}
+
+void CoEpoll::notify()
+{
+    // 其他线程调用 计数器溢出前的EAGAIN可以忽略 (已经有未处理的通知)
+    uint64_t value = 1;
+    if (write(m_notifyFd, &value, sizeof(value)) != sizeof(value) && errno != EAGAIN) {
+        CO_SERVER_LOG_ERROR("eventfd:%d notify failed, errno:%d", m_notifyFd, errno);
+    }
+}
+
+void CoEpoll::arm_timer(uint64_t expireUs)
+{
+    if (m_timerFd < 0 || expireUs == m_timerExpireUs) {
+        return ;
+    }
+
+    // 绝对时间 已经过去的时间立即触发
+    struct itimerspec its;
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = 0;
+    its.it_value.tv_sec = expireUs / 1000000;
+    its.it_value.tv_nsec = (expireUs % 1000000) * 1000;
+    if (timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+        CO_SERVER_LOG_ERROR("timerfd:%d settime failed, expire:%lu errno:%d", m_timerFd, expireUs, errno);
+        return ;
+    }
+    m_timerExpireUs = expireUs;
 }
 
 int32_t CoEpoll::add_connection(CoConnection* connection)
@@ -43,17 +125,14 @@ int32_t CoEpoll::add_connection(CoConnection* connection)
         return CO_OK;
     }
 
-    struct epoll_event epollEvent;
-    epollEvent.events = epollCurEvents | EPOLLET;
-    epollEvent.data.u64 = GEN_U64(connection->m_connId, connection->m_version);
-
     int32_t socketFd = connection->m_coTcp->get_socketfd();
-    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, socketFd, &epollEvent) == -1) {
+    if (m_backend->ctl(EPOLL_CTL_ADD, socketFd, epollCurEvents | EPOLLET, GEN_U64(connection->m_connId, connection->m_version)) == -1) {
         CO_SERVER_LOG_FATAL("(cid:%u) epoll_ctl add connection failed, fd:%d errno:%d op:ADD events(in/out/hup):1/1/1", connection->m_connId, socketFd, errno);
         return CO_ERROR;
     }
 
     connection->m_epollCurEvents = epollCurEvents;
+    connection->m_epollRegEvents = epollCurEvents;
     connection->m_epollCurVersion = connection->m_version;
     connection->m_readEvent->m_flagActive = 1;
     connection->m_writeEvent->m_flagActive = 1;
@@ -63,22 +142,22 @@ int32_t CoEpoll::add_connection(CoConnection* connection)
 
 int32_t CoEpoll::del_connection(CoConnection* connection)
 {
-    if (connection->m_epollCurEvents == 0) {
+    if (connection->m_epollRegEvents == 0) {
         CO_SERVER_LOG_DEBUG("(cid:%u) events(in/out/hup):0/0/0 not change", connection->m_connId);
+        connection->m_epollCurEvents = 0;
+        connection->m_readEvent->m_flagActive = 0;
+        connection->m_writeEvent->m_flagActive = 0;
         return CO_OK;
     }
 
-    epoll_event epollEvent;
-    epollEvent.events = 0;
-    epollEvent.data.u64 = 0;
-
     int32_t socketFd = connection->m_coTcp->get_socketfd();
-    if (epoll_ctl(m_epollFd, EPOLL_CTL_DEL, socketFd, &epollEvent) == -1) {
+    if (m_backend->ctl(EPOLL_CTL_DEL, socketFd, 0, 0) == -1) {
         CO_SERVER_LOG_FATAL("(cid:%u) epoll_ctl del connection failed, fd:%d errno:%d op:DEL events(in/out/hup):0/0/0", connection->m_connId, socketFd, errno);
         return CO_ERROR;
     }
 
     connection->m_epollCurEvents = 0;
+    connection->m_epollRegEvents = 0;
     connection->m_epollCurVersion = 0;
     connection->m_readEvent->m_flagActive = 0;
     connection->m_writeEvent->m_flagActive = 0;
@@ -100,33 +179,39 @@ int32_t CoEpoll::modify_connection(CoConnection* connection, uint32_t eventType,
         return CO_OK;
     }
 
-    /*
-        epoll针对一个socket 如果添加过 后续需要时修改 不能再是添加操作
-        修改操作的话 需要带上上次已经添加过的事件
-    */
-    int32_t epollOP = EPOLL_CTL_ADD;
-    if (epollPreEvents != 0) {
-        if (epollCurEvents == 0) {
-            epollOP = EPOLL_CTL_DEL;
+    // 需要注册到epoll中的事件 once方式注册后保持全部事件
+    uint32_t epollRegEvents = epollCurEvents;
+    if (connection->m_flagRegisterOnce && (epollCurEvents != 0 || connection->m_epollRegEvents != 0)) {
+        epollRegEvents = CO_EVENT_IN | CO_EVENT_OUT | CO_EVENT_HUP;
+    }
 
-        } else {
-            epollOP = EPOLL_CTL_MOD;
+    int32_t socketFd = connection->m_coTcp->get_socketfd();
+    if (epollRegEvents != connection->m_epollRegEvents || connection->m_epollCurVersion != connection->m_version) {
+        /*
+            epoll针对一个socket 如果添加过 后续需要时修改 不能再是添加操作
+            修改操作的话 需要带上上次已经添加过的事件
+        */
+        int32_t epollOP = EPOLL_CTL_ADD;
+        if (connection->m_epollRegEvents != 0) {
+            if (epollRegEvents == 0) {
+                epollOP = EPOLL_CTL_DEL;
+
+            } else {
+                epollOP = EPOLL_CTL_MOD;
+            }
         }
-    }
 
-    epoll_event epollEvent;
-    epollEvent.events = epollCurEvents | EPOLLET;
-    epollEvent.data.u64 = GEN_U64(connection->m_connId, connection->m_version);
+        if (m_backend->ctl(epollOP, socketFd, epollRegEvents | EPOLLET, GEN_U64(connection->m_connId, connection->m_version)) == -1) {
+            CO_SERVER_LOG_FATAL("(cid:%u) %s modify failed, fd:%d errno:%d op:%d events(in/out/hup):%d/%d/%d", connection->m_connId, m_backend->name(), 
+                                    socketFd, errno, epollOP, (epollRegEvents & EPOLLIN) > 0, (epollRegEvents & EPOLLOUT) > 0, (epollRegEvents & EPOLLRDHUP) > 0);
+            return CO_ERROR;
+        }
 
-    int32_t socketFd = connection->m_coTcp->get_socketfd();
-    if (epoll_ctl(m_epollFd, epollOP, socketFd, &epollEvent) == -1) {
-        CO_SERVER_LOG_FATAL("(cid:%u) epoll_ctl(%d) modify failed, fd:%d errno:%d op:%d events(in/out/hup):%d/%d/%d", connection->m_connId, m_epollFd, 
-                                socketFd, errno, epollOP, (epollCurEvents & EPOLLIN) > 0, (epollCurEvents & EPOLLOUT) > 0, (epollCurEvents & EPOLLRDHUP) > 0);
-        return CO_ERROR;
+        connection->m_epollRegEvents = epollRegEvents;
+        connection->m_epollCurVersion = connection->m_version;
     }
 
     connection->m_epollCurEvents = epollCurEvents;
-    connection->m_epollCurVersion = connection->m_version;
     // 处理事件active
     if (epollCurEvents & (CO_EVENT_READ)) {
         connection->m_readEvent->m_flagActive = 1;
@@ -140,14 +225,38 @@ int32_t CoEpoll::modify_connection(CoConnection* connection, uint32_t eventType,
         connection->m_writeEvent->m_flagActive = 0;
     }
 
-    CO_SERVER_LOG_DEBUG("(cid:%u) epoll_ctl(%d) modify success, fd:%d op:%d events(in/out/hup):%d/%d/%d", connection->m_connId, m_epollFd, 
-                        socketFd, epollOP, (epollCurEvents & EPOLLIN) > 0, (epollCurEvents & EPOLLOUT) > 0, (epollCurEvents & EPOLLRDHUP) > 0);
+    CO_SERVER_LOG_DEBUG("(cid:%u) %s modify success, fd:%d events(in/out/hup):%d/%d/%d", connection->m_connId, m_backend->name(), 
+                        socketFd, (epollCurEvents & EPOLLIN) > 0, (epollCurEvents & EPOLLOUT) > 0, (epollCurEvents & EPOLLRDHUP) > 0);
     return CO_OK;
 }
 
+void CoEpoll::close_socket(int32_t socketFd)
+{
+    m_backend->close_fd(socketFd);
+}
+
+void CoEpoll::adjust_events_batch(int32_t epollSize)
+{
+    // 返回的事件填满数组时翻倍 连续多轮负载较低时减半
+    if (epollSize >= m_eventsBatch) {
+        m_eventsBatch = m_eventsBatch * 2 > m_eventsSize ? m_eventsSize : m_eventsBatch * 2;
+        m_batchLightRounds = 0;
+
+    } else if (epollSize < m_eventsBatch / 4 && m_eventsBatch > MIN_EV_NUMBER) {
+        if (++ m_batchLightRounds >= EV_BATCH_SHRINK_ROUNDS) {
+            m_eventsBatch = m_eventsBatch / 2 < MIN_EV_NUMBER ? MIN_EV_NUMBER : m_eventsBatch / 2;
+            m_batchLightRounds = 0;
+        }
+
+    } else {
+        m_batchLightRounds = 0;
+    }
+}
+
 int32_t CoEpoll::process_events(uint32_t timerMs)
 {
-    int32_t epollSize = epoll_wait(m_epollFd, m_events, m_eventsSize, timerMs);
+    int32_t epollSize = m_backend->wait(m_events, m_eventsBatch, timerMs);
+    CoClock::update();
     if (epollSize == -1) {
         if (errno == EINTR) {
             return CO_OK;
@@ -165,12 +274,31 @@ int32_t CoEpoll::process_events(uint32_t timerMs)
         CO_SERVER_LOG_WARN("epoll_wait return no events without timeout");
         return CO_ERROR;
     }
+    adjust_events_batch(epollSize);
 
     CoThreadLocalInfo* threadInfo = GET_TLS();
     CoCycle* cycle = threadInfo->m_coCycle;
 
     // process events
     for (int32_t i=0; i<epollSize; ++i) {
+        if (m_events[i].data.u64 == TIMERFD_EVENT_DATA) {
+            // 精确定时器超时 在process_timer中处理
+            uint64_t expirations = 0;
+            if (read(m_timerFd, &expirations, sizeof(expirations)) > 0) {
+                m_timerExpireUs = 0;
+            }
+            continue;
+        }
+
+        if (m_events[i].data.u64 == NOTIFYFD_EVENT_DATA) {
+            // 其他线程的唤醒通知 队列在process_events_and_timers中处理
+            uint64_t value = 0;
+            if (read(m_notifyFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                CO_SERVER_LOG_ERROR("eventfd:%d read failed, errno:%d", m_notifyFd, errno);
+            }
+            continue;
+        }
+
         uint32_t connId = GET_U64_HIGH32(m_events[i].data.u64);
         uint32_t connVersion = GET_U64_LOW32(m_events[i].data.u64);
 
@@ -194,7 +322,8 @@ int32_t CoEpoll::process_events(uint32_t timerMs)
             continue;
         }
 
-        uint32_t revents = m_events[i].events;
+        // 只处理关注的事件 once方式注册的事件多于关注的事件
+        uint32_t revents = m_events[i].events & (connection->m_epollCurEvents | EPOLLERR | EPOLLHUP);
         CO_SERVER_LOG_DEBUG("(cid:%u) epoll index:%d size:%d ev:%u u64:%lu", connection->m_connId, i, epollSize, revents, m_events[i].data.u64);
         if (revents & (EPOLLERR|EPOLLHUP)) {
             CO_SERVER_LOG_WARN("(cid:%u) epoll index:%d error on ev:%u u64:%lu", connection->m_connId, i, revents, m_events[i].data.u64);
@@ -224,7 +353,7 @@ int32_t CoEpoll::process_events(uint32_t timerMs)
         }
     }
 
-    return CO_OK;
+    return epollSize;
 }
 
 }
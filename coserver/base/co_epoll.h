@@ -3,6 +3,7 @@
 
 #include <sys/epoll.h>
 #include "core/co_connection.h"
+#include "base/co_event_backend.h"
 
 
 namespace coserver
@@ -28,6 +29,19 @@ EPOLLONESHOT:1073741824
 const uint32_t EPOLL_EVENTS_ADD = 0;
 const uint32_t EPOLL_EVENTS_DEL = 1;
 
+/*
+    事件注册方式
+    dynamic: 关注的事件变化时 epoll_ctl修改注册的事件
+    once: 客户端/upstream连接(m_flagRegisterOnce)第一次注册时注册IN|OUT|RDHUP(边缘触发), 之后关注的事件只在用户态记录(m_epollCurEvents/m_flagActive)
+          连接版本变化时(keepalive复用)修改一次事件数据, epoll重新检查socket状态 不会丢失未关注期间的事件
+          等待事件前都先读写到EAGAIN(hook), 之后的状态变化一定会再次通知
+*/
+enum CoEventRegister
+{
+    EVENT_REGISTER_DYNAMIC = 1,
+    EVENT_REGISTER_ONCE,
+};
+
 
 class CoEpoll
 {
@@ -35,18 +49,45 @@ public:
     CoEpoll();
     ~CoEpoll();
 
-    int32_t init(int32_t maxConnSizes, int32_t eventSize = 256);
+    // backendType: 事件后端(epoll/io_uring) io_uring初始化失败时使用epoll
+    int32_t init(int32_t maxConnSizes, int32_t backendType = EVENT_BACKEND_EPOLL, int32_t eventSize = 256);
 
     int32_t add_connection(CoConnection* connection);
     int32_t del_connection(CoConnection* connection);
     int32_t modify_connection(CoConnection* connection, uint32_t eventType, uint32_t eventOP);
 
+    // 返回处理的事件数 (包括timerfd) 出错返回CO_ERROR
     int32_t process_events(uint32_t timerMs);
+    // 当前每次等待的最大事件数 (随负载调整)
+    int32_t get_events_batch() { return m_eventsBatch; }
+
+    // 连接socket关闭前调用 io_uring后端需要取消socket上的poll请求
+    void close_socket(int32_t socketFd);
+    CoEventBackend* get_backend() { return m_backend; }
+
+    // timerfd 精确定时器使用
+    int32_t init_timerfd();
+    // 设置timerfd的超时时间 (单调时钟 us) 0表示取消
+    void arm_timer(uint64_t expireUs);
+
+    // eventfd 其他线程唤醒当前线程的等待
+    int32_t init_notifyfd();
+    void notify();
+
+private:
+    void adjust_events_batch(int32_t epollSize);
 
 private:
-    int32_t      m_epollFd    = -1;
+    CoEventBackend* m_backend = NULL;
     int32_t      m_eventsSize = 1024;
+    int32_t      m_eventsBatch = 32;       // 每次等待的最大事件数 不超过m_eventsSize
+    int32_t      m_batchLightRounds = 0;   // 连续负载较低的次数
     epoll_event* m_events     = NULL;
+
+    int32_t      m_timerFd    = -1;
+    uint64_t     m_timerExpireUs = 0;  // timerfd当前设置的超时时间
+
+    int32_t      m_notifyFd   = -1;
 };
 
 }
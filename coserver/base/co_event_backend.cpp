@@ -0,0 +1,55 @@
+#include <unistd.h>
+#include "base/co_event_backend.h"
+#include "base/co_uring_backend.h"
+#include "base/co_common.h"
+#include "base/co_log.h"
+
+
+namespace coserver
+{
+
+CoEventBackend* CoEventBackend::create_backend(int32_t backendType)
+{
+#if (CO_IO_URING)
+    if (EVENT_BACKEND_IO_URING == backendType) {
+        return new CoUringBackend;
+    }
+#else
+    if (EVENT_BACKEND_IO_URING == backendType) {
+        CO_SERVER_LOG_WARN("event backend io_uring not compiled, use epoll");
+    }
+#endif
+    return new CoEpollBackend;
+}
+
+
+CoEpollBackend::~CoEpollBackend()
+{
+    SAFE_CLOSE(m_epollFd);
+}
+
+int32_t CoEpollBackend::init(int32_t maxConnSizes)
+{
+    m_epollFd = epoll_create(maxConnSizes / 2);
+    return m_epollFd < 0 ? CO_ERROR : CO_OK;
+}
+
+int32_t CoEpollBackend::ctl(int32_t op, int32_t fd, uint32_t events, uint64_t data)
+{
+    m_stats.m_ctls ++;
+    m_stats.m_syscalls ++;
+
+    struct epoll_event epollEvent;
+    epollEvent.events = events;
+    epollEvent.data.u64 = data;
+    return epoll_ctl(m_epollFd, op, fd, &epollEvent);
+}
+
+int32_t CoEpollBackend::wait(epoll_event* events, int32_t maxEvents, int32_t timeoutMs)
+{
+    m_stats.m_waits ++;
+    m_stats.m_syscalls ++;
+    return epoll_wait(m_epollFd, events, maxEvents, timeoutMs);
+}
+
+}
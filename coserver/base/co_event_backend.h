@@ -0,0 +1,77 @@
+#ifndef _CO_EVENT_BACKEND_H_
+#define _CO_EVENT_BACKEND_H_
+
+#include <cstdint>
+#include <sys/epoll.h>
+
+
+namespace coserver
+{
+
+/*
+    事件后端 CoEpoll通过后端注册socket事件和等待事件
+    epoll: 默认 每次修改事件调用一次epoll_ctl
+    io_uring: 事件修改作为poll请求放入提交队列, 等待事件时和io_uring_enter一起批量提交 (event_backend io_uring)
+
+    事件和返回值使用epoll的定义(EPOLLIN/EPOLLOUT/EPOLLRDHUP, epoll_event), 都是边缘触发
+*/
+
+enum CoEventBackendType
+{
+    EVENT_BACKEND_EPOLL = 1,
+    EVENT_BACKEND_IO_URING,
+};
+
+// 事件后端统计
+struct CoEventBackendStats
+{
+    uint64_t        m_ctls      = 0;    // 事件修改次数 (添加/修改/删除)
+    uint64_t        m_waits     = 0;    // 等待事件次数
+    uint64_t        m_syscalls  = 0;    // 事件相关的系统调用次数
+};
+
+class CoEventBackend
+{
+public:
+    virtual ~CoEventBackend() {}
+
+    virtual int32_t init(int32_t maxConnSizes) = 0;
+    virtual const char* name() = 0;
+
+    // op: EPOLL_CTL_ADD/EPOLL_CTL_MOD/EPOLL_CTL_DEL, 失败时返回-1 errno为错误码
+    virtual int32_t ctl(int32_t op, int32_t fd, uint32_t events, uint64_t data) = 0;
+    // socket关闭前调用 取消socket上的事件
+    virtual void close_fd(int32_t fd) = 0;
+    // 返回事件数量 失败时返回-1 errno为错误码
+    virtual int32_t wait(epoll_event* events, int32_t maxEvents, int32_t timeoutMs) = 0;
+
+    const CoEventBackendStats& get_stats() const { return m_stats; }
+
+    // 创建事件后端 io_uring不可用时使用epoll
+    static CoEventBackend* create_backend(int32_t backendType);
+
+protected:
+    CoEventBackendStats m_stats;
+};
+
+
+class CoEpollBackend : public CoEventBackend
+{
+public:
+    CoEpollBackend() {}
+    ~CoEpollBackend();
+
+    int32_t init(int32_t maxConnSizes);
+    const char* name() { return "epoll"; }
+
+    int32_t ctl(int32_t op, int32_t fd, uint32_t events, uint64_t data);
+    void close_fd(int32_t) {}
+    int32_t wait(epoll_event* events, int32_t maxEvents, int32_t timeoutMs);
+
+private:
+    int32_t      m_epollFd = -1;
+};
+
+}
+
+#endif //_CO_EVENT_BACKEND_H_
@@ -31,9 +31,9 @@ void socket_remove_nonblock(int32_t socketFd, int32_t flags)
 template <typename OriginFn, typename ... Args>
 static ssize_t read_write_mode(int32_t socketFd, OriginFn originFn, const char* hookFnName, uint32_t eventOP, int32_t timeoutSO, Args && ... args)
 {
-    // 判断线程私有变量是否有cycle 确定是否需要hook
+    // 判断线程私有变量是否有cycle和当前连接 确定是否需要hook
     CoThreadLocalInfo* threadInfo = GET_TLS();
-    if (threadInfo->m_coCycle == NULL) {
+    if (threadInfo->m_coCycle == NULL || threadInfo->m_curConnection == NULL) {
         return originFn(socketFd, std::forward<Args>(args)...);
     }
 
@@ -84,6 +84,14 @@ static ssize_t read_write_mode(int32_t socketFd, OriginFn originFn, const char*
     if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
         // socket无法立刻得到响应 加入epoll异步等待响应
         if (innerSocket) {
+            // 连接自身socket 读写到EAGAIN后才需要关注事件 (响应/请求直接发送 发送缓冲区满时才等待可写)
+            if (connection->m_coTcp->get_socketfd() == socketFd && (connection->m_epollCurEvents & eventOP) != eventOP) {
+                if (CO_OK != connection->m_cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_ADD, eventOP)) {
+                    CO_SERVER_LOG_FATAL("(cid:%u) hook readwrite, epoll add event failed, socketfd:%d", connection->m_connId, socketFd);
+                    return CO_ERROR;
+                }
+            }
+
             CO_SERVER_LOG_DEBUG("(cid:%u) hook readwrite, inner socket IO yield, socketfd:%d", connection->m_connId, socketFd)
             ret = CoDispatcher::yield(connection);
 
@@ -184,9 +192,9 @@ int32_t connect(int32_t socketFd, const struct sockaddr* addr, socklen_t addrlen
 {
     if (!fnConnect) init_coroutine_hook();
     
-    // 判断线程私有变量是否有cycle 确定是否需要hook 
+    // 判断线程私有变量是否有cycle和当前连接 确定是否需要hook
     CoThreadLocalInfo* threadInfo = GET_TLS();
-    if (threadInfo->m_coCycle == NULL) {
+    if (threadInfo->m_coCycle == NULL || threadInfo->m_curConnection == NULL) {
         return fnConnect(socketFd, addr, addrlen);
     }
 
@@ -356,9 +364,9 @@ uint32_t sleep(uint32_t seconds)
 {
     if (!fnSleep) init_coroutine_hook();
 
-    // 判断线程私有变量是否有cycle 确定是否需要hook
+    // 判断线程私有变量是否有cycle和当前连接 确定是否需要hook
     CoThreadLocalInfo* threadInfo = GET_TLS();
-    if (threadInfo->m_coCycle == NULL) {
+    if (threadInfo->m_coCycle == NULL || threadInfo->m_curConnection == NULL) {
         return fnSleep(seconds);
     }
     CoConnection* connection = threadInfo->m_curConnection;
@@ -380,16 +388,24 @@ int32_t usleep(useconds_t usec)
 {
     if (!fnUsleep) init_coroutine_hook();
 
-    // 判断线程私有变量是否有cycle 确定是否需要hook
+    // 判断线程私有变量是否有cycle和当前连接 确定是否需要hook
     CoThreadLocalInfo* threadInfo = GET_TLS();
-    if (threadInfo->m_coCycle == NULL) {
+    if (threadInfo->m_coCycle == NULL || threadInfo->m_curConnection == NULL) {
         return fnUsleep(usec);
     }
     CoConnection* connection = threadInfo->m_curConnection;
     CO_SERVER_LOG_DEBUG("(cid:%u) hook usleep, usec:%u", connection->m_connId, usec);
 
+    // 开启精确定时器时都进行hook
+    if (connection->m_cycle->m_timer->is_precise() && usec > 0) {
+        int32_t ret = CoDispatcher::yield_timer_us(connection, usec);
+        if (CO_OK != ret) {
+            CO_SERVER_LOG_ERROR("(cid:%u) hook usleep failed, usec:%u ret:%d", connection->m_connId, usec, ret);
+            return CO_ERROR;
+        }
+
     // 内部定时器在ms级别 大于1ms时间在进行hook
-    if (usec > 1000) {
+    } else if (usec > 1000) {
         uint32_t sleepMs = usec / 1000;
         int32_t ret = CoDispatcher::yield_timer(connection, sleepMs);
         if (CO_OK != ret) {
@@ -410,9 +426,9 @@ int32_t select(int32_t nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfd
 {
     if (!fnSelect) init_coroutine_hook();
 
-    // 判断线程私有变量是否有cycle 确定是否需要hook
+    // 判断线程私有变量是否有cycle和当前连接 确定是否需要hook
     CoThreadLocalInfo* threadInfo = GET_TLS();
-    if (threadInfo->m_coCycle == NULL) {
+    if (threadInfo->m_coCycle == NULL || threadInfo->m_curConnection == NULL) {
         return fnSelect(nfds, readfds, writefds, exceptfds, timeout);
     }
 
@@ -503,9 +519,9 @@ int32_t pthread_mutex_lock(pthread_mutex_t* mutex)
 
     // CO_SERVER_LOG_DEBUG("hook pthread_mutex_lock mutex:%p  ----------- ", mutex);
 
-    // 判断线程私有变量是否有cycle 确定是否需要hook
+    // 判断线程私有变量是否有cycle和当前连接 确定是否需要hook
     CoThreadLocalInfo* threadInfo = GET_TLS();
-    if (threadInfo->m_coCycle == NULL) {
+    if (threadInfo->m_coCycle == NULL || threadInfo->m_curConnection == NULL) {
         return fnPthreadMutexLock(mutex);
     }
     CoConnection* connection = threadInfo->m_curConnection;
@@ -4,6 +4,9 @@
 #include <string>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+#include "base/co_clock.h"
 
 
 namespace coserver
@@ -13,7 +16,7 @@ extern int32_t g_logLevel;
 extern thread_local int32_t g_innerThreadId;
 static const std::string g_logLevelString[] = {"DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
 
-#define filename(x) strrchr(x,'/')?strrchr(x,'/')+1:x
+#define co_log_filename(x) strrchr(x,'/')?strrchr(x,'/')+1:x
 
 #define STDOUT_LOG(level, fmt, args...) \
     do { \
@@ -21,8 +24,8 @@ static const std::string g_logLevelString[] = {"DEBUG", "INFO", "WARN", "ERROR",
             struct timeval tv;    \
             struct tm tm;    \
             gettimeofday(&tv, NULL);  \
-            localtime_r(&tv.tv_sec, &tm); \
-            fprintf(stdout, "%04d-%02d-%02d %02d:%02d:%02d.%03d [%u] [%s] (%s:%d) " fmt "\n", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, (int32_t) (tv.tv_usec / 1000), g_innerThreadId, g_logLevelString[level - 1].c_str(), filename(__FILE__), __LINE__, ##args); \
+            CoClock::localtime(tv.tv_sec, &tm); \
+            fprintf(stdout, "%04d-%02d-%02d %02d:%02d:%02d.%03d [%u] [%s] (%s:%d) " fmt "\n", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, (int32_t) (tv.tv_usec / 1000), g_innerThreadId, g_logLevelString[level - 1].c_str(), co_log_filename(__FILE__), __LINE__, ##args); \
         } \
     } while (0); \
 
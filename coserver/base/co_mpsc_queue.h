@@ -0,0 +1,89 @@
+#ifndef _CO_MPSC_QUEUE_H_
+#define _CO_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace coserver
+{
+
+const size_t CO_CACHE_LINE_SIZE = 64;
+
+/*
+    多生产者单消费者无锁队列 (Vyukov intrusive MPSC)
+    节点类型T需要包含成员 std::atomic<T*> m_mpscNext, 队列不负责节点内存
+    push: 任意线程调用 一次原子交换 无等待
+    pop: 只能在消费者线程调用 生产者正在push(已交换未链接)时可能暂时返回NULL
+    生产者写入的m_head和消费者读取的m_tail分开在不同的缓存行 避免伪共享
+*/
+template <typename T>
+class CoMpscQueue
+{
+public:
+    CoMpscQueue() : m_head(&m_stub), m_tail(&m_stub)
+    {
+        m_stub.m_mpscNext.store(NULL, std::memory_order_relaxed);
+    }
+    CoMpscQueue(const CoMpscQueue&) = delete;
+    CoMpscQueue& operator=(const CoMpscQueue&) = delete;
+
+    void push(T* node)
+    {
+        node->m_mpscNext.store(NULL, std::memory_order_relaxed);
+        // seq_cst: 与消费者等待前的唤醒标记(先清除标记再检查empty)配合 不会丢失唤醒
+        T* prev = m_head.exchange(node, std::memory_order_seq_cst);
+        prev->m_mpscNext.store(node, std::memory_order_release);
+    }
+
+    T* pop()
+    {
+        T* tail = m_tail;
+        T* next = tail->m_mpscNext.load(std::memory_order_acquire);
+        if (tail == &m_stub) {
+            if (next == NULL) {
+                return NULL;
+            }
+            m_tail = next;
+            tail = next;
+            next = next->m_mpscNext.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+
+        // tail是最后一个节点 有生产者正在push时等下次再取
+        if (tail != m_head.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+
+        // 放回stub节点 才能取出最后一个节点
+        push(&m_stub);
+        next = tail->m_mpscNext.load(std::memory_order_acquire);
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        return NULL;
+    }
+
+    // 消费者线程调用 tail不是stub时tail本身就是未取出的节点 返回false时可能有生产者正在push
+    bool empty()
+    {
+        return m_tail == &m_stub && m_head.load(std::memory_order_seq_cst) == &m_stub;
+    }
+
+private:
+    std::atomic<T*> m_head;     // 生产者
+    char            m_headPad[CO_CACHE_LINE_SIZE - sizeof(std::atomic<T*>)];
+
+    T*              m_tail;     // 消费者
+    char            m_tailPad[CO_CACHE_LINE_SIZE - sizeof(T*)];
+
+    T               m_stub;
+};
+
+}
+
+#endif //_CO_MPSC_QUEUE_H_
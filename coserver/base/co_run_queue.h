@@ -0,0 +1,109 @@
+#ifndef _CO_RUN_QUEUE_H_
+#define _CO_RUN_QUEUE_H_
+
+#include <queue>
+#include <cstdint>
+#include "base/co_clock.h"
+
+
+namespace coserver
+{
+
+// 调度优先级 数值越小优先级越高 (conf server priority)
+enum CoPriority
+{
+    PRIORITY_HIGH = 0,      // 健康检查/管理接口等
+    PRIORITY_NORMAL,
+    PRIORITY_LOW,           // 批量/后台任务
+    PRIORITY_LEVELS,
+};
+
+/*
+    按优先级调度的运行队列 (worker线程内使用 不加锁)
+    每个优先级一个FIFO队列, 任务的截止时间 = 放入队列的时间 + 优先级 * aging(ms), 取出截止时间最早的队列头部任务
+    没有积压时高优先级先处理; 低优先级每低一级最多多等待aging时间, 之后先于新放入的高优先级任务处理 不会饿死
+    时间使用线程缓存的时钟 只使用一个优先级时和FIFO队列相同
+*/
+template <typename T>
+class CoRunQueue
+{
+public:
+    void push(const T &item, int32_t priority)
+    {
+        if (priority < PRIORITY_HIGH || priority >= PRIORITY_LEVELS) {
+            priority = PRIORITY_NORMAL;
+        }
+        m_queues[priority].push(CoRunItem{item, CoClock::now_ms()});
+        ++m_size;
+    }
+
+    bool pop(T &item)
+    {
+        if (m_size == 0) {
+            return false;
+        }
+
+        // 截止时间相同时 高优先级先处理
+        int32_t priority = -1;
+        uint64_t deadline = 0;
+        for (int32_t i=PRIORITY_HIGH; i<PRIORITY_LEVELS; ++i) {
+            if (m_queues[i].empty()) {
+                continue;
+            }
+            uint64_t itemDeadline = m_queues[i].front().m_pushMs + i * m_agingMs;
+            if (priority < 0 || itemDeadline < deadline) {
+                priority = i;
+                deadline = itemDeadline;
+            }
+        }
+
+        // 有更高优先级的任务等待 说明低优先级任务等待时间超过了aging
+        if (has_higher(priority)) {
+            ++m_aged;
+        }
+
+        item = m_queues[priority].front().m_item;
+        m_queues[priority].pop();
+        --m_size;
+        ++m_pops[priority];
+        return true;
+    }
+
+    // 是否有比priority优先级更高的任务等待
+    bool has_higher(int32_t priority) const
+    {
+        for (int32_t i=PRIORITY_HIGH; i<priority && i<PRIORITY_LEVELS; ++i) {
+            if (!m_queues[i].empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    void set_aging(uint64_t agingMs) { m_agingMs = agingMs > 0 ? agingMs : 1; }
+
+    // 统计 各优先级取出的任务数 / 低优先级因等待超时提前处理的任务数
+    uint64_t get_pops(int32_t priority) const { return m_pops[priority]; }
+    uint64_t get_aged() const { return m_aged; }
+
+private:
+    struct CoRunItem
+    {
+        T           m_item;
+        uint64_t    m_pushMs;   // 放入队列的时间
+    };
+
+    std::queue<CoRunItem>   m_queues[PRIORITY_LEVELS];
+    size_t                  m_size = 0;
+    uint64_t                m_agingMs = 50;
+
+    uint64_t                m_pops[PRIORITY_LEVELS] = {0};
+    uint64_t                m_aged = 0;
+};
+
+}
+
+#endif //_CO_RUN_QUEUE_H_
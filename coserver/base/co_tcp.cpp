@@ -190,6 +190,48 @@ int32_t CoTCP::set_nodelay()
     return CO_OK;
 }
 
+int32_t CoTCP::set_busypoll(int32_t busyPollUs)
+{
+#ifdef SO_BUSY_POLL
+    if (CO_ERROR == setsockopt(m_socketfd, SOL_SOCKET, SO_BUSY_POLL, &busyPollUs, sizeof(busyPollUs))) {
+        CO_SERVER_LOG_ERROR("setbusypoll setsockopt failed, error:%s", strerror(errno));
+        return CO_ERROR;
+    }
+    return CO_OK;
+#else
+    CO_SERVER_LOG_ERROR("setbusypoll SO_BUSY_POLL not supported");
+    return CO_ERROR;
+#endif
+}
+
+int32_t CoTCP::set_incoming_cpu(int32_t cpu)
+{
+#ifdef SO_INCOMING_CPU
+    if (CO_ERROR == setsockopt(m_socketfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu))) {
+        CO_SERVER_LOG_ERROR("setincomingcpu setsockopt failed, error:%s", strerror(errno));
+        return CO_ERROR;
+    }
+    return CO_OK;
+#else
+    CO_SERVER_LOG_ERROR("setincomingcpu SO_INCOMING_CPU not supported");
+    return CO_ERROR;
+#endif
+}
+
+int32_t CoTCP::get_incoming_cpu()
+{
+#ifdef SO_INCOMING_CPU
+    int32_t cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (CO_ERROR == getsockopt(m_socketfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len)) {
+        return -1;
+    }
+    return cpu;
+#else
+    return -1;
+#endif
+}
+
 int32_t CoTCP::set_reused()
 {
     int32_t on = 1;
@@ -31,6 +31,12 @@ public:
     int32_t set_rcvbuffer(uint32_t size);
     int32_t set_nodelay();
     int32_t set_reused();
+    // SO_BUSY_POLL 阻塞读时忙轮询网卡队列的时间 (us)
+    int32_t set_busypoll(int32_t busyPollUs);
+    // SO_INCOMING_CPU reuseport组中优先选择设置的CPU和收到连接的CPU相同的监听socket
+    int32_t set_incoming_cpu(int32_t cpu);
+    // 已接受连接的数据包由哪个CPU处理(网卡队列的中断/软中断所在CPU) 失败返回-1
+    int32_t get_incoming_cpu();
 
     // get param funcs
     int32_t get_socketfd();
@@ -12,24 +12,62 @@ namespace coserver
 const uint64_t MAX_EPOLL_WAIT_TIME = 1000;
 
 
-void CoTimer::add_timer(CoEvent* event, uint32_t timerMs) 
+CoTimer::CoTimer()
 {
-    CO_SERVER_LOG_DEBUG("(cid:%u et:%d) add timer, flagtimerset:%d -> 1 ms:%u", event->m_connection->m_connId, event->m_eventType, event->m_flagTimerSet, timerMs);
-
-    if (event->m_flagTimerSet) {
-        CO_SERVER_LOG_ERROR("(cid:%u et:%d) timer flagtimerset is true", event->m_connection->m_connId, event->m_eventType);
-        return;
+    for (int32_t i=0; i<TIMER_WHEEL_ROOT_SIZE; ++i) {
+        m_root[i].m_prev = m_root[i].m_next = &m_root[i];
+    }
+    for (int32_t level=0; level<TIMER_WHEEL_LEVELS - 1; ++level) {
+        for (int32_t i=0; i<TIMER_WHEEL_LEVEL_SIZE; ++i) {
+            m_levels[level][i].m_prev = m_levels[level][i].m_next = &m_levels[level][i];
+        }
+        m_levelBitmaps[level] = 0;
+    }
+    for (int32_t i=0; i<TIMER_WHEEL_ROOT_SIZE / 64; ++i) {
+        m_rootBitmap[i] = 0;
     }
 
-    uint64_t timer = GET_CURRENTTIME_MS() + timerMs;
-    TimerNode iter = m_timers.insert(std::make_pair(timer, (void*)event));
+    m_current = CoClock::now_ms();
+}
 
-    event->m_timerNode = iter;
-    event->m_flagTimerSet = 1;
+void CoTimer::set_precise(bool precise)
+{
+    m_precise = precise;
 }
 
-void CoTimer::del_timer(CoEvent* event) 
+bool CoTimer::is_precise()
 {
+    return m_precise;
+}
+
+void CoTimer::set_slack(int32_t timerClass, uint32_t slackMs)
+{
+    m_slacks[timerClass] = slackMs;
+}
+
+void CoTimer::add_timer(CoEvent* event, uint32_t timerMs)
+{
+    m_stats.m_adds ++;
+    if (m_precise && timerMs * 1000ULL < TIMER_PRECISE_RANGE_US) {
+        add_precise_timer(event, timerMs * 1000ULL);
+        return ;
+    }
+    add_wheel_timer(event, CoClock::now_ms() + timerMs);
+}
+
+void CoTimer::add_timer_us(CoEvent* event, uint64_t timerUs)
+{
+    m_stats.m_adds ++;
+    if (m_precise && timerUs < TIMER_PRECISE_RANGE_US) {
+        add_precise_timer(event, timerUs);
+        return ;
+    }
+    add_wheel_timer(event, CoClock::now_ms() + (timerUs + 999) / 1000);
+}
+
+void CoTimer::del_timer(CoEvent* event)
+{
+    m_stats.m_dels ++;
     CO_SERVER_LOG_DEBUG("(cid:%u et:%d) del timer, flagtimerset:%d -> 0", event->m_connection->m_connId, event->m_eventType, event->m_flagTimerSet);
 
     if (!event->m_flagTimerSet) {
@@ -41,64 +79,424 @@ void CoTimer::del_timer(CoEvent* event)
         }
         return;
     }
+    remove_timer(event);
+}
+
+void CoTimer::rearm_timer(CoEvent* event, uint32_t timerMs, int32_t timerClass)
+{
+    m_stats.m_rearms ++;
+
+    uint64_t expire = CoClock::now_ms() + timerMs;
+    uint32_t slack = m_slacks[timerClass];
+    if (slack > 1) {
+        expire = (expire + slack - 1) / slack * slack;
+    }
+
+    CoTimerNode* node = &(event->m_timerNode);
+    CO_SERVER_LOG_DEBUG("(cid:%u et:%d) rearm timer, flagtimerset:%d ms:%u expire:%lu -> %lu", event->m_connection->m_connId, event->m_eventType, event->m_flagTimerSet, timerMs, node->m_expire, expire);
+
+    // 精确定时器 删除后重新添加
+    if (m_precise && timerMs * 1000ULL < TIMER_PRECISE_RANGE_US) {
+        if (event->m_flagTimerSet) {
+            remove_timer(event);
+        }
+        add_precise_timer(event, timerMs * 1000ULL);
+        return ;
+    }
+
+    if (!event->m_flagTimerSet) {
+        add_wheel_timer(event, expire);
+        return ;
+    }
 
-    m_timers.erase(event->m_timerNode);
+    if (node->m_level == TIMER_PRECISE_LEVEL) {
+        remove_timer(event);
+        add_wheel_timer(event, expire);
+        return ;
+    }
+
+    if (expire >= node->m_expire) {
+        // 延后 节点留在原来的槽中 到达时重新放入
+        node->m_expire = expire;
+        m_stats.m_rearmLazy ++;
+        return ;
+    }
+
+    // 提前 移动节点
+    unlink_node(node);
+    node->m_expire = expire;
+    link_node(node);
+}
+
+int64_t CoTimer::get_remain_us(CoEvent* event)
+{
+    if (!event->m_flagTimerSet) {
+        return -1;
+    }
+
+    // 精确定时器的超时时间为us 时间轮为ms
+    CoTimerNode* node = &(event->m_timerNode);
+    uint64_t nowUs = CoClock::now_us();
+    uint64_t expireUs = node->m_expire * 1000;
+    if (node->m_level == TIMER_PRECISE_LEVEL) {
+        nowUs = CoClock::mono_us();
+        expireUs = node->m_expire;
+    }
+    return expireUs > nowUs ? expireUs - nowUs : 0;
+}
+
+void CoTimer::add_wheel_timer(CoEvent* event, uint64_t expire)
+{
+    if (event->m_flagTimerSet) {
+        CO_SERVER_LOG_ERROR("(cid:%u et:%d) timer flagtimerset is true", event->m_connection->m_connId, event->m_eventType);
+        return;
+    }
+    CO_SERVER_LOG_DEBUG("(cid:%u et:%d) add timer, flagtimerset:0 -> 1 expire:%lu", event->m_connection->m_connId, event->m_eventType, expire);
+
+    CoTimerNode* node = &(event->m_timerNode);
+    node->m_expire = expire;
+    link_node(node);
+
+    m_size ++;
+    event->m_flagTimerSet = 1;
+}
+
+void CoTimer::add_precise_timer(CoEvent* event, uint64_t timerUs)
+{
+    if (event->m_flagTimerSet) {
+        CO_SERVER_LOG_ERROR("(cid:%u et:%d) timer flagtimerset is true", event->m_connection->m_connId, event->m_eventType);
+        return;
+    }
+    CO_SERVER_LOG_DEBUG("(cid:%u et:%d) add precise timer, flagtimerset:0 -> 1 us:%lu", event->m_connection->m_connId, event->m_eventType, timerUs);
+
+    // 缓存时间可能落后于当前时间(本次循环的处理时间) 直接读取时钟
+    CoTimerNode* node = &(event->m_timerNode);
+    node->m_expire = CoClock::mono_us() + timerUs;
+    node->m_level = TIMER_PRECISE_LEVEL;
+    heap_push(node);
+
+    m_size ++;
+    event->m_flagTimerSet = 1;
+}
+
+void CoTimer::remove_timer(CoEvent* event)
+{
+    CoTimerNode* node = &(event->m_timerNode);
+    if (node->m_level == TIMER_PRECISE_LEVEL) {
+        heap_remove(node);
+        node->m_level = 0;
+
+    } else {
+        unlink_node(node);
+    }
+    m_size --;
     event->m_flagTimerSet = 0;
 }
 
-uint64_t CoTimer::find_timer() 
+uint64_t CoTimer::find_timer()
 {
-    if (m_timers.empty()) {
-        // 没有定时任务
+    if (m_size == m_preciseTimers.size()) {
+        // 时间轮中没有定时任务 精确定时器由timerfd唤醒
         return MAX_EPOLL_WAIT_TIME;
     }
 
+    // 第0层没有定时器时 最晚在下一次cascade时醒来
+    uint64_t next = 0;
+    int32_t offset = find_root_offset();
+    if (offset >= 0) {
+        next = m_current + offset;
+    } else {
+        next = (m_current | (TIMER_WHEEL_ROOT_SIZE - 1)) + 1;
+    }
+
     uint64_t timer = 0;
-    uint64_t now = GET_CURRENTTIME_MS();
-    TimerNode iter = m_timers.begin();
-    if (iter->first > now) {
-        timer = iter->first - now;
+    uint64_t now = CoClock::now_ms();
+    if (next > now) {
+        timer = next - now;
+    }
+
+    // 最长等待时间 保证定期任务(统计/缓冲区trim)能够执行
+    if (timer > MAX_EPOLL_WAIT_TIME) {
+        timer = MAX_EPOLL_WAIT_TIME;
     }
     return timer;
-} 
+}
+
+uint64_t CoTimer::find_precise_timer()
+{
+    if (m_preciseTimers.empty()) {
+        return 0;
+    }
+    return m_preciseTimers[0]->m_expire;
+}
 
-void CoTimer::process_timer() 
+bool CoTimer::precise_expired()
 {
-    uint64_t now = GET_CURRENTTIME_MS();
+    return !m_preciseTimers.empty() && m_preciseTimers[0]->m_expire <= CoClock::mono_us();
+}
+
+void CoTimer::process_timer()
+{
+    // 精确定时器 和timerfd使用相同的时钟(CLOCK_MONOTONIC)
+    uint64_t nowUs = m_preciseTimers.empty() ? 0 : CoClock::mono_us();
+    while (!m_preciseTimers.empty() && m_preciseTimers[0]->m_expire <= nowUs) {
+        CoTimerNode* node = m_preciseTimers[0];
+        heap_remove(node);
+        node->m_level = 0;
+        m_size --;
 
-    while (!m_timers.empty()) {
-        TimerNode iter = m_timers.begin();
+        expire_timer(node->m_event, nowUs);
+    }
 
-        if (iter->first <= now) {
-            CoEvent* event = (CoEvent* )(iter->second);
-            m_timers.erase(iter);
-            event->m_flagTimerSet = 0;
+    uint64_t now = CoClock::now_ms();
 
-            CoConnection* connection = event->m_connection;
-            connection->m_flagTimedOut = 1;
+    while (m_current <= now) {
+        if (m_size == m_preciseTimers.size()) {
+            // 时间轮中没有定时器 直接转到当前时间
+            m_current = now + 1;
+            break;
+        }
 
-            if (event->m_timerPreHandler) {
-                event->m_timerPreHandler(event);
+        int32_t index = m_current & (TIMER_WHEEL_ROOT_SIZE - 1);
+        if (index == 0) {
+            for (int32_t level=1; level<TIMER_WHEEL_LEVELS; ++level) {
+                if (cascade(level) != 0) {
+                    break;
+                }
             }
+        }
 
-            CO_SERVER_LOG_DEBUG("(cid:%u et:%d) process timers remain size:%lu, connection timeout now:%lu timer:%lu", connection->m_connId, event->m_eventType, m_timers.size(), now, iter->first);
-            CoDispatcher::func_dispatcher(connection);
-            continue;
+        // 超时处理中添加的已超时定时器(m_expire <= m_current) 也在当前槽中处理
+        CoTimerNode* head = &m_root[index];
+        while (head->m_next != head) {
+            CoTimerNode* node = head->m_next;
+            unlink_node(node);
+
+            // rearm延后的定时器 重新放入时间轮
+            if (node->m_expire > m_current) {
+                link_node(node);
+                m_stats.m_relinks ++;
+                continue;
+            }
+
+            m_size --;
+            expire_timer(node->m_event, now);
         }
 
-        break;
+        m_current ++;
     }
 }
 
+void CoTimer::expire_timer(CoEvent* event, uint64_t now)
+{
+    m_stats.m_expires ++;
+    event->m_flagTimerSet = 0;
+
+    CoConnection* connection = event->m_connection;
+    connection->m_flagTimedOut = 1;
+
+    if (event->m_timerPreHandler) {
+        event->m_timerPreHandler(event);
+    }
+
+    CO_SERVER_LOG_DEBUG("(cid:%u et:%d) process timers remain size:%lu, connection timeout now:%lu timer:%lu", connection->m_connId, event->m_eventType, m_size, now, event->m_timerNode.m_expire);
+    CoDispatcher::func_dispatcher(connection);
+}
+
 bool CoTimer::empty()
 {
-    return m_timers.empty();
+    return m_size == 0;
 }
 
 size_t CoTimer::size()
 {
-    return m_timers.size();
+    return m_size;
 }
 
+CoTimerNode* CoTimer::slot_head(int32_t level, int32_t slot)
+{
+    if (level == 0) {
+        return &m_root[slot];
+    }
+    return &m_levels[level - 1][slot];
 }
 
+void CoTimer::link_node(CoTimerNode* node)
+{
+    uint64_t expire = node->m_expire;
+    if (expire < m_current) {
+        // 已经超时 放入当前槽
+        expire = m_current;
+    }
+
+    uint64_t idx = expire - m_current;
+    int32_t level = 0;
+    int32_t slot = 0;
+    if (idx < (uint64_t)TIMER_WHEEL_ROOT_SIZE) {
+        slot = expire & (TIMER_WHEEL_ROOT_SIZE - 1);
+
+    } else {
+        // 超出最大范围的放在最上层 cascade时重新分配
+        uint64_t maxIdx = (1ULL << (TIMER_WHEEL_ROOT_BITS + (TIMER_WHEEL_LEVELS - 1) * TIMER_WHEEL_LEVEL_BITS)) - 1;
+        if (idx > maxIdx) {
+            expire = m_current + maxIdx;
+            idx = maxIdx;
+        }
+
+        for (level=1; level<TIMER_WHEEL_LEVELS; ++level) {
+            if (idx < (1ULL << (TIMER_WHEEL_ROOT_BITS + level * TIMER_WHEEL_LEVEL_BITS))) {
+                break;
+            }
+        }
+        slot = (expire >> (TIMER_WHEEL_ROOT_BITS + (level - 1) * TIMER_WHEEL_LEVEL_BITS)) & (TIMER_WHEEL_LEVEL_SIZE - 1);
+    }
+
+    CoTimerNode* head = slot_head(level, slot);
+    node->m_level = level;
+    node->m_slot = slot;
+    node->m_prev = head->m_prev;
+    node->m_next = head;
+    head->m_prev->m_next = node;
+    head->m_prev = node;
+
+    if (level == 0) {
+        m_rootBitmap[slot >> 6] |= (1ULL << (slot & 63));
+    } else {
+        m_levelBitmaps[level - 1] |= (1ULL << slot);
+    }
+}
+
+void CoTimer::unlink_node(CoTimerNode* node)
+{
+    node->m_prev->m_next = node->m_next;
+    node->m_next->m_prev = node->m_prev;
+    node->m_prev = node->m_next = NULL;
+
+    // 槽为空时清除位图
+    CoTimerNode* head = slot_head(node->m_level, node->m_slot);
+    if (head->m_next == head) {
+        if (node->m_level == 0) {
+            m_rootBitmap[node->m_slot >> 6] &= ~(1ULL << (node->m_slot & 63));
+        } else {
+            m_levelBitmaps[node->m_level - 1] &= ~(1ULL << node->m_slot);
+        }
+    }
+}
+
+int32_t CoTimer::cascade(int32_t level)
+{
+    int32_t slot = (m_current >> (TIMER_WHEEL_ROOT_BITS + (level - 1) * TIMER_WHEEL_LEVEL_BITS)) & (TIMER_WHEEL_LEVEL_SIZE - 1);
+
+    // 取出整个槽 重新按超时时间分配
+    CoTimerNode list;
+    CoTimerNode* head = slot_head(level, slot);
+    if (head->m_next == head) {
+        return slot;
+    }
+    list.m_next = head->m_next;
+    list.m_prev = head->m_prev;
+    list.m_next->m_prev = &list;
+    list.m_prev->m_next = &list;
+    head->m_prev = head->m_next = head;
+    m_levelBitmaps[level - 1] &= ~(1ULL << slot);
+
+    while (list.m_next != &list) {
+        CoTimerNode* node = list.m_next;
+        list.m_next = node->m_next;
+        node->m_next->m_prev = &list;
+        link_node(node);
+    }
+
+    return slot;
+}
+
+void CoTimer::heap_push(CoTimerNode* node)
+{
+    m_preciseTimers.push_back(node);
+    node->m_heapIndex = m_preciseTimers.size() - 1;
+    heap_up(node->m_heapIndex);
+}
+
+void CoTimer::heap_remove(CoTimerNode* node)
+{
+    // 最后一个节点移到删除的位置 再向上或向下调整
+    uint32_t index = node->m_heapIndex;
+    CoTimerNode* last = m_preciseTimers.back();
+    m_preciseTimers.pop_back();
+    if (last == node) {
+        return ;
+    }
+
+    heap_set(index, last);
+    if (index > 0 && last->m_expire < m_preciseTimers[(index - 1) / 2]->m_expire) {
+        heap_up(index);
+    } else {
+        heap_down(index);
+    }
+}
+
+void CoTimer::heap_up(uint32_t index)
+{
+    CoTimerNode* node = m_preciseTimers[index];
+    while (index > 0) {
+        uint32_t parent = (index - 1) / 2;
+        if (m_preciseTimers[parent]->m_expire <= node->m_expire) {
+            break;
+        }
+        heap_set(index, m_preciseTimers[parent]);
+        index = parent;
+    }
+    heap_set(index, node);
+}
+
+void CoTimer::heap_down(uint32_t index)
+{
+    uint32_t size = m_preciseTimers.size();
+    CoTimerNode* node = m_preciseTimers[index];
+    while (1) {
+        uint32_t child = index * 2 + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && m_preciseTimers[child + 1]->m_expire < m_preciseTimers[child]->m_expire) {
+            child ++;
+        }
+        if (node->m_expire <= m_preciseTimers[child]->m_expire) {
+            break;
+        }
+        heap_set(index, m_preciseTimers[child]);
+        index = child;
+    }
+    heap_set(index, node);
+}
+
+void CoTimer::heap_set(uint32_t index, CoTimerNode* node)
+{
+    m_preciseTimers[index] = node;
+    node->m_heapIndex = index;
+}
+
+int32_t CoTimer::find_root_offset()
+{
+    int32_t start = m_current & (TIMER_WHEEL_ROOT_SIZE - 1);
+    int32_t words = TIMER_WHEEL_ROOT_SIZE / 64;
+
+    // 从当前槽开始循环查找 最多检查words+1个字
+    for (int32_t i=0; i<=words; ++i) {
+        int32_t word = ((start >> 6) + i) % words;
+        uint64_t bits = m_rootBitmap[word];
+        if (i == 0) {
+            bits &= ~0ULL << (start & 63);
+        } else if (i == words) {
+            bits &= (start & 63) ? ~(~0ULL << (start & 63)) : 0;
+        }
+
+        if (bits) {
+            int32_t slot = (word << 6) + __builtin_ctzll(bits);
+            return (slot - start + TIMER_WHEEL_ROOT_SIZE) & (TIMER_WHEEL_ROOT_SIZE - 1);
+        }
+    }
+    return -1;
+}
+
+}
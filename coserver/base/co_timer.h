@@ -1,38 +1,158 @@
 #ifndef _CO_TIMER_H_
 #define _CO_TIMER_H_
 
-#include <map>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
 
 
 namespace coserver
 {
 
+/*
+    分层时间轮定时器, 精度1ms
+    第0层256个槽 每个槽1ms; 第1-4层每层64个槽 每个槽是下一层一圈的时间, 总共覆盖2^32ms
+    定时器节点嵌入在CoEvent中(侵入式双向链表), 添加/删除/超时都是O(1) 不申请内存
+    第0层转完一圈时 把上一层对应槽的定时器重新分配到下层(cascade)
+
+    rearm_timer: 已经在时间轮中的定时器 超时时间延后时只更新超时时间(不移动节点), 到达原来的槽时再重新放入时间轮;
+    按定时器类型配置slack时 超时时间向上对齐到slack的整数倍, 请求过程中多次重置的定时器大多不需要任何操作
+
+    精确定时器(timer_resolution us): 第0层范围内的定时器改为按us排序的最小堆, 由CoEpoll的timerfd唤醒(只设置最早的超时时间),
+    usleep(200)等短时间sleep和较短的超时时间不再按ms取整; 堆中存放定时器节点指针 节点记录自己在堆中的位置, 添加/删除O(logn) 不申请节点内存
+*/
+
 struct CoEvent;
-typedef std::multimap<uint64_t, void*>::iterator TimerNode;
+
+const int32_t TIMER_WHEEL_LEVELS = 5;
+const int32_t TIMER_WHEEL_ROOT_BITS = 8;
+const int32_t TIMER_WHEEL_ROOT_SIZE = 1 << TIMER_WHEEL_ROOT_BITS;
+const int32_t TIMER_WHEEL_LEVEL_BITS = 6;
+const int32_t TIMER_WHEEL_LEVEL_SIZE = 1 << TIMER_WHEEL_LEVEL_BITS;
+
+const uint16_t TIMER_PRECISE_LEVEL = 0xFFFF;                            // 精确定时器节点的m_level
+const uint64_t TIMER_PRECISE_RANGE_US = TIMER_WHEEL_ROOT_SIZE * 1000;   // 小于此时间的定时器使用精确定时器
+
+enum CoTimerClass
+{
+    TIMER_CLASS_IO = 0,         // 读写/连接超时
+    TIMER_CLASS_KEEPALIVE,      // keepalive/请求处理超时
+    TIMER_CLASS_SIZE,
+};
+
+enum CoTimerResolution
+{
+    TIMER_RESOLUTION_MS = 1,    // 时间轮 精度1ms
+    TIMER_RESOLUTION_US,        // 短定时器使用timerfd 精度us
+};
+
+// 定时器节点 (嵌入在CoEvent中)
+struct CoTimerNode
+{
+    CoTimerNode*    m_prev = NULL;
+    CoTimerNode*    m_next = NULL;
+    CoEvent*        m_event = NULL;     // 节点所属事件
+    uint64_t        m_expire = 0;       // 超时时间 (ms, 精确定时器为us)
+    uint16_t        m_level = 0;        // 所在的层和槽
+    uint16_t        m_slot = 0;
+    uint32_t        m_heapIndex = 0;    // 精确定时器在堆中的位置
+};
+
+// 定时器操作统计
+struct CoTimerStats
+{
+    uint64_t        m_adds      = 0;    // add_timer次数
+    uint64_t        m_dels      = 0;    // del_timer次数
+    uint64_t        m_rearms    = 0;    // rearm_timer次数
+    uint64_t        m_rearmLazy = 0;    // rearm时没有移动节点的次数 (超时时间不变/延后)
+    uint64_t        m_relinks   = 0;    // 延后的定时器到达原超时时间时 重新放入时间轮的次数
+    uint64_t        m_expires   = 0;    // 超时次数
+};
 
 class CoTimer
 {
 public:
-    CoTimer() {}
+    CoTimer();
     ~CoTimer() {}
 
+    // 开启精确定时器 需要CoEpoll开启timerfd
+    void set_precise(bool precise);
+    bool is_precise();
+
+    // 定时器类型的slack (ms) 0表示不对齐
+    void set_slack(int32_t timerClass, uint32_t slackMs);
+
     void add_timer(CoEvent* event, uint32_t timerMs);
+    // us精度定时器 没有开启精确定时器时向上取整到ms
+    void add_timer_us(CoEvent* event, uint64_t timerUs);
     void del_timer(CoEvent* event);
+    // 重置定时器 没有设置时添加
+    void rearm_timer(CoEvent* event, uint32_t timerMs, int32_t timerClass = TIMER_CLASS_IO);
+
+    // 事件定时器的剩余时间 (us) 没有设置定时器时返回-1
+    int64_t get_remain_us(CoEvent* event);
 
-    // 找出最近定时器的超时时间和当前时间的 时间差
+    // 找出最近定时器的超时时间和当前时间的 时间差 (不包含精确定时器)
     uint64_t find_timer();
+    // 最近的精确定时器超时时间 (us) 没有时返回0
+    uint64_t find_precise_timer();
+    // 是否有已经超时的精确定时器
+    bool precise_expired();
     // 处理已经超时的定时器
     void process_timer();
 
     bool empty();
     size_t size();
 
+    const CoTimerStats& get_stats() const { return m_stats; }
+
 
 private:
-    std::multimap<uint64_t, void*>  m_timers;
+    CoTimerNode* slot_head(int32_t level, int32_t slot);
+
+    // 按超时时间放入对应的层和槽
+    void link_node(CoTimerNode* node);
+    void unlink_node(CoTimerNode* node);
+
+    // 上层槽中的定时器重新分配到下层 返回当前槽号
+    int32_t cascade(int32_t level);
+
+    // 第0层从当前槽开始 第一个非空槽的偏移, 没有时返回-1
+    int32_t find_root_offset();
+
+    void add_wheel_timer(CoEvent* event, uint64_t expire);
+    void add_precise_timer(CoEvent* event, uint64_t timerUs);
+    void remove_timer(CoEvent* event);
+
+    // 精确定时器最小堆 (按m_expire)
+    void heap_push(CoTimerNode* node);
+    void heap_remove(CoTimerNode* node);
+    void heap_up(uint32_t index);
+    void heap_down(uint32_t index);
+    void heap_set(uint32_t index, CoTimerNode* node);
+    // 定时器超时 切入连接协程
+    void expire_timer(CoEvent* event, uint64_t now);
+
+
+private:
+    uint64_t    m_current = 0;      // 时间轮当前时间 (ms) 小于m_current的定时器都已经处理
+    size_t      m_size = 0;
+
+    CoTimerNode m_root[TIMER_WHEEL_ROOT_SIZE];                              // 第0层 链表头
+    CoTimerNode m_levels[TIMER_WHEEL_LEVELS - 1][TIMER_WHEEL_LEVEL_SIZE];   // 第1-4层 链表头
+
+    // 非空槽位图
+    uint64_t    m_rootBitmap[TIMER_WHEEL_ROOT_SIZE / 64];
+    uint64_t    m_levelBitmaps[TIMER_WHEEL_LEVELS - 1];
+
+    CoTimerStats m_stats;
+
+    uint32_t    m_slacks[TIMER_CLASS_SIZE] = {0};
+
+    bool        m_precise = false;
+    std::vector<CoTimerNode*> m_preciseTimers;     // 精确定时器 按超时时间(us)的最小堆
 };
 
 }
 
 #endif //_CO_TIMER_H_
-
@@ -0,0 +1,325 @@
+#include "base/co_uring_backend.h"
+
+#if (CO_IO_URING)
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "base/co_common.h"
+#include "base/co_log.h"
+
+
+namespace coserver
+{
+
+const uint32_t URING_MIN_ENTRIES = 256;
+const uint32_t URING_MAX_ENTRIES = 4096;
+const uint64_t URING_IGNORE_DATA = (uint64_t)-1;   // 删除poll请求/取消的添加请求 本身的完成事件
+
+
+static inline uint64_t uring_poll_data(int32_t fd, uint32_t seq)
+{
+    return ((uint64_t)fd << 32) | seq;
+}
+
+CoUringBackend::~CoUringBackend()
+{
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if (m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if (m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    SAFE_CLOSE(m_ringFd);
+}
+
+int32_t CoUringBackend::init(int32_t maxConnSizes)
+{
+    uint32_t entries = URING_MIN_ENTRIES;
+    while (entries < (uint32_t)maxConnSizes && entries < URING_MAX_ENTRIES) {
+        entries <<= 1;
+    }
+
+    // 每个poll请求可能多次完成 完成队列设置大一些
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    m_ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_ringFd < 0) {
+        CO_SERVER_LOG_ERROR("io_uring setup failed, entries:%u errno:%d", entries, errno);
+        return CO_ERROR;
+    }
+
+    // io_uring_enter等待超时时间 需要5.11以上内核
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        CO_SERVER_LOG_ERROR("io_uring not support IORING_FEAT_EXT_ARG, features:%u", params.features);
+        return CO_ERROR;
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        m_sqRingSize = m_sqRingSize > m_cqRingSize ? m_sqRingSize : m_cqRingSize;
+        m_cqRingSize = m_sqRingSize;
+    }
+
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = NULL;
+        CO_SERVER_LOG_ERROR("io_uring mmap sq ring failed, errno:%d", errno);
+        return CO_ERROR;
+    }
+
+    if (singleMmap) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = NULL;
+            CO_SERVER_LOG_ERROR("io_uring mmap cq ring failed, errno:%d", errno);
+            return CO_ERROR;
+        }
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe*)mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+        m_sqes = NULL;
+        CO_SERVER_LOG_ERROR("io_uring mmap sqes failed, errno:%d", errno);
+        return CO_ERROR;
+    }
+
+    char* sqRing = (char*)m_sqRing;
+    m_sqHead = (uint32_t*)(sqRing + params.sq_off.head);
+    m_sqTail = (uint32_t*)(sqRing + params.sq_off.tail);
+    m_sqMask = *(uint32_t*)(sqRing + params.sq_off.ring_mask);
+    m_sqEntries = *(uint32_t*)(sqRing + params.sq_off.ring_entries);
+    m_sqArray = (uint32_t*)(sqRing + params.sq_off.array);
+    m_sqLocalTail = *m_sqTail;
+
+    char* cqRing = (char*)m_cqRing;
+    m_cqHead = (uint32_t*)(cqRing + params.cq_off.head);
+    m_cqTail = (uint32_t*)(cqRing + params.cq_off.tail);
+    m_cqMask = *(uint32_t*)(cqRing + params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)(cqRing + params.cq_off.cqes);
+
+    m_polls.resize(maxConnSizes * 2);
+
+    CO_SERVER_LOG_INFO("io_uring init success, sq entries:%u cq entries:%u", params.sq_entries, params.cq_entries);
+    return CO_OK;
+}
+
+int32_t CoUringBackend::ctl(int32_t op, int32_t fd, uint32_t events, uint64_t data)
+{
+    m_stats.m_ctls ++;
+
+    if (fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if ((size_t)fd >= m_polls.size()) {
+        m_polls.resize(fd * 2);
+    }
+
+    CoUringPoll &poll = m_polls[fd];
+    if (poll.m_active && is_pending(poll)) {
+        // 本次循环添加的poll请求还没有提交 直接修改sqe
+        struct io_uring_sqe* sqe = &m_sqes[poll.m_sqePos & m_sqMask];
+        if (EPOLL_CTL_DEL == op) {
+            memset(sqe, 0, sizeof(struct io_uring_sqe));
+            sqe->opcode = IORING_OP_NOP;
+            sqe->user_data = URING_IGNORE_DATA;
+            poll.m_active = false;
+
+        } else {
+            poll.m_events = events & ~EPOLLET;
+            poll.m_data = data;
+            sqe->poll32_events = poll.m_events;
+        }
+        return 0;
+    }
+
+    if (poll.m_active) {
+        remove_poll(fd, poll);
+    }
+
+    if (EPOLL_CTL_DEL != op) {
+        // poll请求默认边缘触发
+        poll.m_events = events & ~EPOLLET;
+        poll.m_data = data;
+        add_poll(fd, poll);
+    }
+    return 0;
+}
+
+void CoUringBackend::close_fd(int32_t fd)
+{
+    // poll请求持有socket的引用 不删除时close不会真正关闭连接
+    if (fd >= 0 && (size_t)fd < m_polls.size() && m_polls[fd].m_active) {
+        ctl(EPOLL_CTL_DEL, fd, 0, 0);
+    }
+}
+
+int32_t CoUringBackend::wait(epoll_event* events, int32_t maxEvents, int32_t timeoutMs)
+{
+    m_stats.m_waits ++;
+
+    // 完成队列中已经有事件时 只提交不等待
+    uint32_t cqReady = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) - *m_cqHead;
+    int32_t ret = enter((cqReady == 0 && timeoutMs != 0) ? 1 : 0, timeoutMs);
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        return -1;
+    }
+
+    int32_t eventSize = 0;
+    uint32_t head = *m_cqHead;
+    uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail && eventSize < maxEvents) {
+        struct io_uring_cqe* cqe = &m_cqes[head & m_cqMask];
+        head ++;
+
+        if (cqe->user_data == URING_IGNORE_DATA) {
+            continue;
+        }
+
+        // 已经删除或者重新注册的poll请求 忽略
+        int32_t fd = cqe->user_data >> 32;
+        uint32_t seq = (uint32_t)cqe->user_data;
+        if ((size_t)fd >= m_polls.size() || !m_polls[fd].m_active || m_polls[fd].m_seq != seq) {
+            continue;
+        }
+
+        CoUringPoll &poll = m_polls[fd];
+        if (cqe->res < 0) {
+            CO_SERVER_LOG_WARN("io_uring poll fd:%d failed, res:%d", fd, cqe->res);
+            poll.m_active = false;
+            if (cqe->res == -ECANCELED) {
+                add_poll(fd, poll);
+                continue;
+            }
+
+            events[eventSize].events = EPOLLERR;
+            events[eventSize].data.u64 = poll.m_data;
+            eventSize ++;
+            continue;
+        }
+
+        events[eventSize].events = cqe->res;
+        events[eventSize].data.u64 = poll.m_data;
+        eventSize ++;
+
+        // multishot poll请求结束(内核资源不足等) 重新添加
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            add_poll(fd, poll);
+        }
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+    return eventSize;
+}
+
+struct io_uring_sqe* CoUringBackend::get_sqe()
+{
+    uint32_t head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqLocalTail - head >= m_sqEntries) {
+        // 提交队列满 先提交
+        enter(0, 0);
+        head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_sqLocalTail - head >= m_sqEntries) {
+            return NULL;
+        }
+    }
+
+    uint32_t index = m_sqLocalTail & m_sqMask;
+    struct io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    m_sqArray[index] = index;
+    m_sqLocalTail ++;
+    return sqe;
+}
+
+bool CoUringBackend::is_pending(const CoUringPoll &poll)
+{
+    // 内核在io_uring_enter中消费sqe 之前的位置都已经提交
+    return (int32_t)(poll.m_sqePos - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE)) >= 0;
+}
+
+void CoUringBackend::add_poll(int32_t fd, CoUringPoll &poll)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+    if (!sqe) {
+        CO_SERVER_LOG_FATAL("io_uring sq full, poll add fd:%d failed", fd);
+        return ;
+    }
+
+    poll.m_seq ++;
+    poll.m_active = true;
+    poll.m_sqePos = m_sqLocalTail - 1;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = poll.m_events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = uring_poll_data(fd, poll.m_seq);
+}
+
+void CoUringBackend::remove_poll(int32_t fd, CoUringPoll &poll)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+    if (!sqe) {
+        CO_SERVER_LOG_FATAL("io_uring sq full, poll remove fd:%d failed", fd);
+        return ;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = uring_poll_data(fd, poll.m_seq);
+    sqe->user_data = URING_IGNORE_DATA;
+
+    // 已经在完成队列中的旧事件通过序号过滤
+    poll.m_seq ++;
+    poll.m_active = false;
+}
+
+int32_t CoUringBackend::enter(uint32_t waitNr, int32_t timeoutMs)
+{
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+    uint32_t toSubmit = m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (toSubmit == 0 && waitNr == 0) {
+        return 0;
+    }
+
+    uint32_t flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void* argp = NULL;
+    size_t argSize = 0;
+    if (waitNr > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+
+        if (timeoutMs >= 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argSize = sizeof(arg);
+        }
+    }
+
+    m_stats.m_syscalls ++;
+    return syscall(__NR_io_uring_enter, m_ringFd, toSubmit, waitNr, flags, argp, argSize);
+}
+
+}
+
+#endif
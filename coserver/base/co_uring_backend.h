@@ -0,0 +1,99 @@
+#ifndef _CO_URING_BACKEND_H_
+#define _CO_URING_BACKEND_H_
+
+#include <vector>
+#include <cstddef>
+#include "base/co_event_backend.h"
+
+/*
+    io_uring事件后端 直接使用系统调用(io_uring_setup/io_uring_enter) 不依赖liburing
+    内核头文件没有io_uring.h时不编译, make FLAGS="-DCO_IO_URING=0" 可以关闭
+
+    每个fd的事件是一个multishot poll请求(IORING_OP_POLL_ADD, 默认边缘触发)
+    修改事件: 删除旧的poll请求(IORING_OP_POLL_REMOVE) 添加新的poll请求, 都只写入提交队列
+              本次循环添加的poll请求还没有提交时 直接修改提交队列中的sqe, 一次循环内一个fd最多提交一个poll请求
+    等待事件: 一次io_uring_enter提交本次循环所有的修改 同时等待完成事件
+
+    poll请求的user_data为 fd<<32 | 序号, fd每次重新注册序号+1, 旧请求的完成事件(取消/已经在完成队列中)通过序号过滤
+*/
+#ifndef CO_IO_URING
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CO_IO_URING 1
+#endif
+#endif
+#endif
+
+#if (CO_IO_URING)
+#include <linux/io_uring.h>
+
+
+namespace coserver
+{
+
+class CoUringBackend : public CoEventBackend
+{
+public:
+    CoUringBackend() {}
+    ~CoUringBackend();
+
+    int32_t init(int32_t maxConnSizes);
+    const char* name() { return "io_uring"; }
+
+    int32_t ctl(int32_t op, int32_t fd, uint32_t events, uint64_t data);
+    void close_fd(int32_t fd);
+    int32_t wait(epoll_event* events, int32_t maxEvents, int32_t timeoutMs);
+
+private:
+    // fd注册的poll请求
+    struct CoUringPoll
+    {
+        uint32_t    m_seq = 0;          // 当前poll请求的序号
+        uint32_t    m_events = 0;       // 监听的事件
+        uint64_t    m_data = 0;         // 返回给CoEpoll的数据
+        bool        m_active = false;   // 是否有poll请求
+        uint32_t    m_sqePos = 0;       // 添加poll请求的sqe在提交队列中的位置
+    };
+
+    struct io_uring_sqe* get_sqe();
+    // poll请求是否还在提交队列中没有提交
+    bool is_pending(const CoUringPoll &poll);
+    void add_poll(int32_t fd, CoUringPoll &poll);
+    void remove_poll(int32_t fd, CoUringPoll &poll);
+
+    // 提交队列中的请求 waitNr>0时等待完成事件
+    int32_t enter(uint32_t waitNr, int32_t timeoutMs);
+
+
+private:
+    int32_t         m_ringFd = -1;
+
+    // 提交队列
+    uint32_t*       m_sqHead = NULL;
+    uint32_t*       m_sqTail = NULL;
+    uint32_t        m_sqMask = 0;
+    uint32_t        m_sqEntries = 0;
+    uint32_t*       m_sqArray = NULL;
+    struct io_uring_sqe* m_sqes = NULL;
+    uint32_t        m_sqLocalTail = 0;  // 本地写入位置 enter前同步到m_sqTail
+
+    // 完成队列
+    uint32_t*       m_cqHead = NULL;
+    uint32_t*       m_cqTail = NULL;
+    uint32_t        m_cqMask = 0;
+    struct io_uring_cqe* m_cqes = NULL;
+
+    void*           m_sqRing = NULL;
+    size_t          m_sqRingSize = 0;
+    void*           m_cqRing = NULL;
+    size_t          m_cqRingSize = 0;
+    size_t          m_sqesSize = 0;
+
+    std::vector<CoUringPoll> m_polls;   // fd -> poll请求
+};
+
+}
+
+#endif
+
+#endif //_CO_URING_BACKEND_H_
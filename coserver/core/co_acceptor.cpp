@@ -0,0 +1,364 @@
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "core/co_acceptor.h"
+#include "base/co_log.h"
+#include "core/co_cycle.h"
+#include "core/co_mailbox.h"
+#include "core/co_server_control.h"
+
+
+namespace coserver
+{
+
+const int32_t ACCEPTOR_LISTEN_BACKLOG = 512;    // 和worker线程监听相同
+const int32_t ACCEPTOR_ACCEPT_NUM = 64;         // 一个server每次最多接受的连接数 剩余的下一次epoll_wait处理
+const int32_t ACCEPTOR_EVENTS = 16;
+const uint32_t ACCEPTOR_STOP_EVENT = UINT32_MAX;
+const uint32_t ACCEPTOR_RESUME_EVENT = UINT32_MAX - 1;
+const uint64_t ACCEPT_LAG_GRANULARITY_US = 500;  // 调度循环延迟分档 同一档的worker比较连接数
+
+
+CoAcceptor::CoAcceptor(const CoConfig* conf, int32_t workerCount)
+: m_conf(conf)
+{
+    m_loads.reserve(workerCount);
+    for (int32_t i=0; i<workerCount; ++i) {
+        CoWorkerLoad* load = new CoWorkerLoad;
+        load->m_acceptor = this;
+        load->m_serverConnections = std::vector<std::atomic<int32_t>>(conf->m_confServers.size());
+        for (auto &serverConnections : load->m_serverConnections) {
+            serverConnections.store(0);
+        }
+        m_loads.push_back(load);
+    }
+
+    m_paused = std::vector<std::atomic<bool>>(conf->m_confServers.size());
+    for (auto &paused : m_paused) {
+        paused.store(false);
+    }
+}
+
+CoAcceptor::~CoAcceptor()
+{
+    stop();
+
+    // worker线程关闭连接时可能写入 worker线程退出后再关闭
+    if (m_resumeFd >= 0) {
+        close(m_resumeFd);
+        m_resumeFd = -1;
+    }
+
+    for (auto &itr : m_loads) {
+        SAFE_DELETE(itr);
+    }
+    m_loads.clear();
+}
+
+int32_t CoAcceptor::start()
+{
+    int32_t threadSize = m_conf->m_conf.m_acceptorThreads;
+    if (threadSize <= 0 || m_loads.empty()) {
+        CO_SERVER_LOG_ERROR("acceptor threads:%d workers:%lu invalid", threadSize, m_loads.size());
+        return CO_ERROR;
+    }
+
+    // 监听socket 所有acceptor线程共享
+    int32_t socketBusyPoll = m_conf->m_conf.m_socketBusyPoll;
+    for (auto &itr : m_conf->m_confServers) {
+        CoConfServer* confServer = itr;
+        CoTCP* listener = new CoTCP;
+        m_listeners.push_back(listener);
+
+        if (CO_OK != listener->init_ipport(confServer->m_listenIP, confServer->m_listenPort) || CO_OK != listener->set_nonblock()
+                || CO_OK != listener->set_reused() || CO_OK != listener->server_bind() || CO_OK != listener->server_listen(ACCEPTOR_LISTEN_BACKLOG)) {
+            CO_SERVER_LOG_ERROR("acceptor listen ip:%s port:%d failed", confServer->m_listenIP.c_str(), confServer->m_listenPort);
+            return CO_ERROR;
+        }
+        if (socketBusyPoll > 0 && CO_OK != listener->set_busypoll(socketBusyPoll)) {
+            CO_SERVER_LOG_WARN("acceptor listen socket:%d set busy poll:%d failed", listener->get_socketfd(), socketBusyPoll);
+        }
+    }
+
+    m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_resumeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_stopFd < 0 || m_resumeFd < 0) {
+        CO_SERVER_LOG_ERROR("acceptor eventfd failed, errno:%d", errno);
+        return CO_ERROR;
+    }
+
+    for (int32_t i=0; i<threadSize; ++i) {
+        int32_t epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            CO_SERVER_LOG_ERROR("acceptor epoll create failed, errno:%d", errno);
+            return CO_ERROR;
+        }
+        m_epollFds.push_back(epollFd);
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = ACCEPTOR_STOP_EVENT;
+        if (0 != epoll_ctl(epollFd, EPOLL_CTL_ADD, m_stopFd, &event)) {
+            CO_SERVER_LOG_ERROR("acceptor epoll add eventfd failed, errno:%d", errno);
+            return CO_ERROR;
+        }
+        // 恢复监听只需要一个acceptor线程处理 和监听socket一样只唤醒一个线程
+        event.events = EPOLLIN | (threadSize > 1 ? EPOLLEXCLUSIVE : 0);
+        event.data.u32 = ACCEPTOR_RESUME_EVENT;
+        if (0 != epoll_ctl(epollFd, EPOLL_CTL_ADD, m_resumeFd, &event)) {
+            CO_SERVER_LOG_ERROR("acceptor epoll add eventfd failed, errno:%d", errno);
+            return CO_ERROR;
+        }
+    }
+
+    for (uint32_t j=0; j<m_listeners.size(); ++j) {
+        if (CO_OK != modify_listening(j, true)) {
+            return CO_ERROR;
+        }
+    }
+
+    for (int32_t i=0; i<threadSize; ++i) {
+        m_threads.push_back(std::thread([this, i]() {
+            std::string threadName = "acceptor_" + std::to_string(i);
+            prctl(PR_SET_NAME, threadName.c_str(), 0, 0, 0);
+            this->run(i);
+        }));
+    }
+
+    CO_SERVER_LOG_INFO("acceptor start, threads:%d servers:%lu workers:%lu balance:%d", threadSize, m_listeners.size(), m_loads.size(), m_conf->m_conf.m_acceptBalance);
+    return CO_OK;
+}
+
+void CoAcceptor::stop()
+{
+    m_stop.store(true);
+    if (m_stopFd >= 0) {
+        uint64_t value = 1;
+        if (write(m_stopFd, &value, sizeof(value)) != sizeof(value)) {
+            CO_SERVER_LOG_ERROR("acceptor stop, write eventfd failed, errno:%d", errno);
+        }
+    }
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+    if (!m_threads.empty()) {
+        std::string workers;
+        for (uint32_t i=0; i<m_loads.size(); ++i) {
+            workers += " " + std::to_string(i) + ":" + std::to_string(m_loads[i]->m_handoffs.load()) + "/" + std::to_string(m_loads[i]->m_drops.load());
+        }
+        CO_SERVER_LOG_INFO("acceptor stop, accepts:%lu, worker handoffs/drops:%s", m_accepts.load(), workers.c_str());
+    }
+    m_threads.clear();
+
+    for (auto &epollFd : m_epollFds) {
+        close(epollFd);
+    }
+    m_epollFds.clear();
+
+    if (m_stopFd >= 0) {
+        close(m_stopFd);
+        m_stopFd = -1;
+    }
+
+    for (auto &itr : m_listeners) {
+        SAFE_DELETE(itr);
+    }
+    m_listeners.clear();
+}
+
+void CoAcceptor::run(int32_t index)
+{
+    int32_t epollFd = m_epollFds[index];
+    struct epoll_event events[ACCEPTOR_EVENTS];
+
+    while (!m_stop.load()) {
+        int32_t eventNum = epoll_wait(epollFd, events, ACCEPTOR_EVENTS, -1);
+        if (eventNum < 0) {
+            if (errno != EINTR) {
+                CO_SERVER_LOG_ERROR("acceptor epoll wait failed, errno:%d", errno);
+            }
+            continue;
+        }
+
+        for (int32_t i=0; i<eventNum && !m_stop.load(); ++i) {
+            if (events[i].data.u32 == ACCEPTOR_RESUME_EVENT) {
+                uint64_t value = 0;
+                if (read(m_resumeFd, &value, sizeof(value)) == sizeof(value)) {
+                    resume_servers();
+                }
+
+            } else if (events[i].data.u32 != ACCEPTOR_STOP_EVENT) {
+                accept_server(events[i].data.u32);
+            }
+        }
+    }
+}
+
+void CoAcceptor::accept_server(int32_t serverIndex)
+{
+    int32_t listenFd = m_listeners[serverIndex]->get_socketfd();
+    for (int32_t i=0; i<ACCEPTOR_ACCEPT_NUM; ++i) {
+        // 先预留worker的连接数 所有worker都已满时不接受 新连接留在内核监听队列中
+        int32_t worker = reserve_worker(serverIndex);
+        if (worker < 0) {
+            pause_server(serverIndex);
+            return ;
+        }
+
+        int32_t clientFd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            release_connection(m_loads[worker], serverIndex);
+            if (errno == ECONNABORTED || errno == EINTR) {
+                continue;
+            }
+            // 多个acceptor线程时 其他线程已经接受 返回EAGAIN
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                CO_SERVER_LOG_ERROR("acceptor accept failed, listen socket:%d errno:%d", listenFd, errno);
+            }
+            return ;
+        }
+
+        m_accepts.fetch_add(1, std::memory_order_relaxed);
+        handoff(worker, serverIndex, clientFd);
+    }
+}
+
+void CoAcceptor::handoff(int32_t worker, int32_t serverIndex, int32_t socketFd)
+{
+    CoWorkerLoad* load = m_loads[worker];
+    load->m_handoffs.fetch_add(1, std::memory_order_relaxed);
+
+    if (CO_OK != CoMailbox::post(worker, [serverIndex, socketFd]() { CoAcceptor::accept_handoff(serverIndex, socketFd); })) {
+        release_connection(load, serverIndex);
+        load->m_drops.fetch_add(1, std::memory_order_relaxed);
+        close(socketFd);
+    }
+}
+
+int32_t CoAcceptor::select_worker(int32_t serverIndex)
+{
+    int32_t workerCount = m_loads.size();
+    int32_t start = m_rotate.fetch_add(1, std::memory_order_relaxed) % workerCount;
+    int32_t maxConnections = m_conf->m_confServers[serverIndex]->m_maxConnections;
+    bool balanceLag = (m_conf->m_conf.m_acceptBalance == ACCEPT_BALANCE_LAG);
+
+    int32_t best = -1;
+    int32_t bestConnections = INT32_MAX;
+    uint64_t bestLag = UINT64_MAX;
+    for (int32_t i=0; i<workerCount; ++i) {
+        int32_t worker = (start + i) % workerCount;
+        CoWorkerLoad* load = m_loads[worker];
+        if (load->m_serverConnections[serverIndex].load(std::memory_order_relaxed) >= maxConnections) {
+            continue;
+        }
+        int32_t connections = load->m_connections.load(std::memory_order_relaxed);
+        uint64_t lag = balanceLag ? load->m_loopLagUs.load(std::memory_order_relaxed) / ACCEPT_LAG_GRANULARITY_US : 0;
+
+        // 依次比较: 调度循环延迟(lag) / 连接数
+        if (lag < bestLag || (lag == bestLag && connections < bestConnections)) {
+            best = worker;
+            bestConnections = connections;
+            bestLag = lag;
+        }
+    }
+    return best;
+}
+
+int32_t CoAcceptor::reserve_worker(int32_t serverIndex)
+{
+    int32_t maxConnections = m_conf->m_confServers[serverIndex]->m_maxConnections;
+
+    // 多个acceptor线程可能同时选择同一个worker 预留失败时重新选择
+    for (uint32_t i=0; i<m_loads.size(); ++i) {
+        int32_t worker = select_worker(serverIndex);
+        if (worker < 0) {
+            return -1;
+        }
+
+        CoWorkerLoad* load = m_loads[worker];
+        if (load->m_serverConnections[serverIndex].fetch_add(1, std::memory_order_relaxed) < maxConnections) {
+            // 交给worker前就计入连接数 同一批新连接不会都选择同一个worker
+            load->m_connections.fetch_add(1, std::memory_order_relaxed);
+            return worker;
+        }
+        load->m_serverConnections[serverIndex].fetch_sub(1, std::memory_order_relaxed);
+    }
+    return -1;
+}
+
+void CoAcceptor::pause_server(int32_t serverIndex)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pauseLock);
+        if (!m_paused[serverIndex].load()) {
+            m_paused[serverIndex].store(true);
+            modify_listening(serverIndex, false);
+            CO_SERVER_LOG_WARN("acceptor all workers reach max connections, pause listen port:%d", m_conf->m_confServers[serverIndex]->m_listenPort);
+        }
+    }
+
+    // 设置暂停前worker已经关闭连接 不会再通知 这里再检查一次
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (select_worker(serverIndex) >= 0) {
+        resume_servers();
+    }
+}
+
+void CoAcceptor::resume_servers()
+{
+    std::lock_guard<std::mutex> lock(m_pauseLock);
+    for (uint32_t i=0; i<m_paused.size(); ++i) {
+        if (m_paused[i].load() && select_worker(i) >= 0) {
+            m_paused[i].store(false);
+            modify_listening(i, true);
+            CO_SERVER_LOG_INFO("acceptor resume listen port:%d", m_conf->m_confServers[i]->m_listenPort);
+        }
+    }
+}
+
+int32_t CoAcceptor::modify_listening(int32_t serverIndex, bool listen)
+{
+    int32_t listenFd = m_listeners[serverIndex]->get_socketfd();
+    for (auto &epollFd : m_epollFds) {
+        struct epoll_event event;
+        // 多个acceptor线程时 一个新连接只唤醒一个线程 (EPOLLEXCLUSIVE不能EPOLL_CTL_MOD 暂停/恢复时删除/添加)
+        event.events = EPOLLIN | (m_epollFds.size() > 1 ? EPOLLEXCLUSIVE : 0);
+        event.data.u32 = serverIndex;
+        if (0 != epoll_ctl(epollFd, listen ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, listenFd, &event)) {
+            CO_SERVER_LOG_ERROR("acceptor epoll %s listen socket:%d failed, errno:%d", listen ? "add" : "del", listenFd, errno);
+            return CO_ERROR;
+        }
+    }
+    return CO_OK;
+}
+
+void CoAcceptor::accept_handoff(int32_t serverIndex, int32_t socketFd)
+{
+    CoCycle* cycle = GET_TLS()->m_coCycle;
+    CoDispatcher* dispatcher = cycle->m_dispatcher;
+
+    if (CO_OK != dispatcher->m_serverControls[serverIndex]->accept_handoff(cycle, socketFd)) {
+        release_connection(dispatcher->m_load, serverIndex);
+        dispatcher->m_load->m_drops.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void CoAcceptor::release_connection(CoWorkerLoad* load, int32_t serverIndex)
+{
+    load->m_connections.fetch_sub(1, std::memory_order_relaxed);
+    load->m_serverConnections[serverIndex].fetch_sub(1);
+
+    // 暂停监听时 通知acceptor线程恢复
+    // worker线程中连接关闭时调用 当前连接已经dying hook的write直接返回错误, eventfd_write不经过hook
+    CoAcceptor* acceptor = load->m_acceptor;
+    if (acceptor->m_paused[serverIndex].load() && acceptor->m_resumeFd >= 0) {
+        if (0 != eventfd_write(acceptor->m_resumeFd, 1) && errno != EAGAIN) {
+            CO_SERVER_LOG_ERROR("acceptor resume, write eventfd failed, errno:%d", errno);
+        }
+    }
+}
+
+}
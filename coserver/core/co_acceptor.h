@@ -0,0 +1,96 @@
+#ifndef _CO_ACCEPTOR_H_
+#define _CO_ACCEPTOR_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "base/co_config.h"
+#include "base/co_tcp.h"
+
+
+namespace coserver
+{
+
+/*
+    acceptor线程 (conf accept_mode acceptor)
+
+    reuseport模式每个worker线程都监听同一个端口 由内核按四元组哈希选择worker, 不考虑worker的负载:
+    一个worker的max_connections用完时 其他worker可能还空闲, 长keepalive连接在worker之间分布不均
+    acceptor模式由acceptor线程监听所有server端口(worker线程不监听), 接受新连接后选择负载最低的worker,
+    通过worker的邮箱(CoMailbox 无锁队列)把fd交给worker线程 在worker线程中初始化连接
+
+    负载指标(accept_balance): 每个worker的活跃连接数(交给worker时加1 连接关闭时减1, 包括还在邮箱中的连接)
+    或者调度循环的处理时间(滑动平均 worker空闲等待事件时为0, 按ACCEPT_LAG_GRANULARITY_US分档 同一档时比较连接数), 负载相同时轮流选择
+    accept前先在选择的worker上预留连接数 跳过server连接数已达到max_connections的worker;
+    所有worker都已满时暂停监听这个server(从acceptor的epoll中删除) 新连接留在内核监听队列中, worker关闭连接后通过eventfd通知acceptor恢复监听
+    多个acceptor线程共享监听socket 每个线程的epoll使用EPOLLEXCLUSIVE 一个新连接只唤醒一个线程
+*/
+
+// worker线程的负载 worker线程写入 acceptor线程读取
+class CoAcceptor;
+
+struct CoWorkerLoad
+{
+    CoAcceptor*             m_acceptor = NULL;  // 连接关闭时通知acceptor恢复监听
+    std::atomic<int32_t>    m_connections{0};   // 活跃连接数 (包括邮箱中还没有初始化的连接)
+    std::vector<std::atomic<int32_t>> m_serverConnections;  // 按server配置顺序 每个server的活跃连接数
+    std::atomic<uint64_t>   m_loopLagUs{0};     // 调度循环处理时间的滑动平均 (us)
+    std::atomic<uint64_t>   m_handoffs{0};      // acceptor交给worker的连接数
+    std::atomic<uint64_t>   m_drops{0};         // worker连接数已满/初始化失败 关闭的连接数
+};
+
+
+class CoAcceptor
+{
+public:
+    CoAcceptor(const CoConfig* conf, int32_t workerCount);
+    ~CoAcceptor();
+
+    // 创建监听socket和acceptor线程 worker线程启动前调用(启动前交给worker的连接在启动后处理)
+    int32_t start();
+    // 停止接受新连接 关闭监听socket
+    void stop();
+
+    CoWorkerLoad* get_load(int32_t worker) { return m_loads[worker]; }
+
+public:
+    // worker线程中执行: 初始化交给当前worker的连接 / 连接关闭时更新负载
+    static void accept_handoff(int32_t serverIndex, int32_t socketFd);
+    static void release_connection(CoWorkerLoad* load, int32_t serverIndex);
+
+private:
+    void run(int32_t index);
+    // 接受一个server的新连接 每次最多一批
+    void accept_server(int32_t serverIndex);
+    void handoff(int32_t worker, int32_t serverIndex, int32_t socketFd);
+    // 负载最低且server连接数未满的worker 都已满时返回-1
+    int32_t select_worker(int32_t serverIndex);
+    // 选择worker并预留一个连接数 都已满时返回-1
+    int32_t reserve_worker(int32_t serverIndex);
+
+    // 所有worker都已满时暂停监听server / 有worker可以接受新连接时恢复
+    void pause_server(int32_t serverIndex);
+    void resume_servers();
+    int32_t modify_listening(int32_t serverIndex, bool listen);
+
+private:
+    const CoConfig*             m_conf = NULL;
+    std::vector<CoWorkerLoad*>  m_loads;        // 按worker序号
+
+    std::vector<CoTCP*>         m_listeners;    // 按server配置顺序 (和CoDispatcher::m_serverControls相同)
+    std::vector<int32_t>        m_epollFds;     // 每个acceptor线程一个epoll
+    int32_t                     m_stopFd = -1;  // eventfd 停止时唤醒acceptor线程
+    int32_t                     m_resumeFd = -1;    // eventfd 暂停监听时 worker关闭连接后唤醒acceptor线程
+    std::vector<std::atomic<bool>> m_paused;    // 按server配置顺序 是否暂停监听
+    std::mutex                  m_pauseLock;    // 多个acceptor线程 暂停/恢复监听互斥
+    std::atomic<bool>           m_stop{false};
+    std::vector<std::thread>    m_threads;
+
+    std::atomic<uint32_t>       m_rotate{0};    // 负载相同时轮流选择的起始worker
+    std::atomic<uint64_t>       m_accepts{0};
+};
+
+}
+
+#endif //_CO_ACCEPTOR_H_
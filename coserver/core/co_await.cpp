@@ -0,0 +1,465 @@
+#include "core/co_await.h"
+
+#if (CO_AWAIT)
+
+#include "base/co_log.h"
+#include "core/co_cycle.h"
+#include "core/co_request.h"
+#include "core/co_callback_request.h"
+
+
+namespace coserver
+{
+
+std::coroutine_handle<> CoAwaitTask::CoFinalAwaiter::await_suspend(CoHandle handle) noexcept
+{
+    promise_type &promise = handle.promise();
+    if (promise.m_detached) {
+        // 分离的协程没有等待方 挂起在final point后销毁协程帧
+        handle.destroy();
+        return std::noop_coroutine();
+    }
+
+    if (promise.m_continuation) {
+        return promise.m_continuation;
+    }
+    return std::noop_coroutine();
+}
+
+CoAwaitTask::~CoAwaitTask()
+{
+    if (m_handle) {
+        m_handle.destroy();
+    }
+}
+
+CoAwaitTask& CoAwaitTask::operator=(CoAwaitTask &&other) noexcept
+{
+    if (this != &other) {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+        m_handle = other.m_handle;
+        other.m_handle = nullptr;
+    }
+    return *this;
+}
+
+void CoAwaitTask::detach()
+{
+    if (!m_handle) {
+        return ;
+    }
+
+    CoHandle handle = m_handle;
+    m_handle = nullptr;
+
+    handle.promise().m_detached = true;
+    handle.resume();
+}
+
+std::coroutine_handle<> CoAwaitTask::await_suspend(std::coroutine_handle<> continuation) noexcept
+{
+    // 对称转移 直接切换到子协程执行
+    m_handle.promise().m_continuation = continuation;
+    return m_handle;
+}
+
+
+bool CoAwaitResume::await_suspend(std::coroutine_handle<> handle)
+{
+    m_connection->m_awaitHandle = handle.address();
+    return true;
+}
+
+int32_t CoAwaitResume::await_resume()
+{
+    m_connection->m_awaitHandle = NULL;
+
+    if (m_ret != CO_OK) {
+        return m_ret;
+    }
+
+    if (m_connection->m_flagDying) {
+        CO_SERVER_LOG_WARN("(cid:%u) await resume, connection dying", m_connection->m_connId);
+        return CO_ERROR;
+    }
+    return CO_OK;
+}
+
+bool CoAwaitSleep::await_suspend(std::coroutine_handle<> handle)
+{
+    // 和yield_timer相同 sleep期间连接异常时等待sleep结束
+    m_connection->m_flagThirdFuncBlocking = 1;
+    m_connection->m_cycle->m_timer->add_timer(m_connection->m_sleepEvent, m_sleepMs);
+
+    return CoAwaitResume::await_suspend(handle);
+}
+
+int32_t CoAwaitSleep::await_resume()
+{
+    m_connection->m_flagThirdFuncBlocking = 0;
+
+    CoEvent* event = m_connection->m_sleepEvent;
+    if (event->m_flagTimerSet) {
+        m_connection->m_cycle->m_timer->del_timer(event);
+    }
+
+    return CoAwaitResume::await_resume();
+}
+
+bool CoAwaitSocket::await_suspend(std::coroutine_handle<> handle)
+{
+    CoCycle* cycle = m_connection->m_cycle;
+    CoConnection* blockConnection = m_connection->m_blockConn;
+
+    // 使用阻塞连接注册第三方socket
+    m_connection->m_flagUseBlockConn = 1;
+    if (CO_OK != blockConnection->m_coTcp->init_client_socketfd(m_socketFd)) {
+        CO_SERVER_LOG_ERROR("(cid:%u) await socket, init client socketfd:%d failed", m_connection->m_connId, m_socketFd);
+        m_ret = CO_ERROR;
+        return false;
+    }
+
+    if (CO_OK != cycle->m_coEpoll->modify_connection(blockConnection, EPOLL_EVENTS_ADD, m_eventOP)) {
+        CO_SERVER_LOG_FATAL("(cid:%u) await socket, epoll add block event failed, socketfd:%d", m_connection->m_connId, m_socketFd);
+        m_ret = CO_ERROR;
+        return false;
+    }
+    m_registered = true;
+
+    if (m_timeoutMs > 0) {
+        CoEvent* blockEvent = m_eventOP == (CO_EVENT_READ) ? blockConnection->m_readEvent : blockConnection->m_writeEvent;
+        cycle->m_timer->add_timer(blockEvent, m_timeoutMs);
+    }
+
+    return CoAwaitResume::await_suspend(handle);
+}
+
+int32_t CoAwaitSocket::await_resume()
+{
+    CoCycle* cycle = m_connection->m_cycle;
+    CoConnection* blockConnection = m_connection->m_blockConn;
+    m_connection->m_awaitHandle = NULL;
+
+    int32_t ret = m_ret;
+    if (m_registered) {
+        if (cycle->m_coEpoll->modify_connection(blockConnection, EPOLL_EVENTS_DEL, m_eventOP) != CO_OK) {
+            CO_SERVER_LOG_FATAL("(cid:%u) await socket, epoll del block event failed, socketfd:%d", m_connection->m_connId, m_socketFd);
+        }
+
+        CoEvent* blockEvent = m_eventOP == (CO_EVENT_READ) ? blockConnection->m_readEvent : blockConnection->m_writeEvent;
+        if (blockEvent->m_flagTimerSet) {
+            cycle->m_timer->del_timer(blockEvent);
+        }
+
+        // 和yield_thirdsocket相同的返回值
+        if (blockConnection->m_flagDying) {
+            CO_SERVER_LOG_WARN("(cid:%u bcid:%u) await socket, block dying", m_connection->m_connId, blockConnection->m_connId);
+            ret = CO_EXCEPTION;
+
+        } else if (blockConnection->m_flagTimedOut) {
+            CO_SERVER_LOG_WARN("(cid:%u bcid:%u) await socket:%d timeout", m_connection->m_connId, blockConnection->m_connId, m_socketFd);
+            ret = CO_TIMEOUT;
+
+        } else if (blockConnection->m_flagPendingEof) {
+            CO_SERVER_LOG_ERROR("(cid:%u bcid:%u) await socket, block eof:%d", m_connection->m_connId, blockConnection->m_connId, blockConnection->m_flagPendingEof);
+            ret = CO_ERROR;
+        }
+    }
+
+    m_connection->m_flagUseBlockConn = 0;
+    m_connection->reset_block();
+    return ret;
+}
+
+bool CoAwaitYield::await_suspend(std::coroutine_handle<> handle)
+{
+    // 和CoDispatcher::yield_now相同 让出期间连接异常时等待运行队列切入
+    CoDispatcher* dispatcher = m_connection->m_cycle->m_dispatcher;
+    m_connection->m_flagThirdFuncBlocking = 1;
+    m_connection->m_flagYieldNow = 1;
+    dispatcher->m_yieldConnections.emplace_back(m_connection, m_connection->m_version);
+
+    return CoAwaitResume::await_suspend(handle);
+}
+
+int32_t CoAwaitYield::await_resume()
+{
+    m_connection->m_flagThirdFuncBlocking = 0;
+    m_connection->m_flagYieldNow = 0;
+
+    return CoAwaitResume::await_resume();
+}
+
+bool CoAwaitOffload::await_suspend(std::coroutine_handle<> handle)
+{
+    m_job = CoDispatcher::submit_offload(m_connection, std::move(m_func), m_timeoutMs, m_poolName);
+    if (!m_job) {
+        m_ret = CO_ERROR;
+        return false;
+    }
+
+    return CoAwaitResume::await_suspend(handle);
+}
+
+int32_t CoAwaitOffload::await_resume()
+{
+    if (!m_job) {
+        return m_ret;
+    }
+
+    m_connection->m_awaitHandle = NULL;
+    return CoDispatcher::finish_offload(m_connection, m_job);
+}
+
+bool CoAwaitUpstreams::await_ready() const noexcept
+{
+    // 没有未完成的子请求 不需要挂起
+    CoRequest* request = m_connection->m_request;
+    return !request || request->m_count <= 1;
+}
+
+
+CoAwaitSleep CoAwait::sleep(CoUserHandlerData* userData, uint32_t sleepMs)
+{
+    return CoAwaitSleep((CoConnection*)(userData->m_coroutineData.first), sleepMs);
+}
+
+CoAwaitSocket CoAwait::read(CoUserHandlerData* userData, int32_t socketFd, int32_t timeoutMs)
+{
+    return CoAwaitSocket((CoConnection*)(userData->m_coroutineData.first), socketFd, CO_EVENT_READ, timeoutMs);
+}
+
+CoAwaitSocket CoAwait::write(CoUserHandlerData* userData, int32_t socketFd, int32_t timeoutMs)
+{
+    return CoAwaitSocket((CoConnection*)(userData->m_coroutineData.first), socketFd, CO_EVENT_WRITE, timeoutMs);
+}
+
+CoAwaitUpstreams CoAwait::upstreams(CoUserHandlerData* userData)
+{
+    return CoAwaitUpstreams((CoConnection*)(userData->m_coroutineData.first));
+}
+
+CoAwaitYield CoAwait::yield_now(CoUserHandlerData* userData)
+{
+    return CoAwaitYield((CoConnection*)(userData->m_coroutineData.first));
+}
+
+CoAwaitOffload CoAwait::offload(CoUserHandlerData* userData, std::function<void ()> func, int32_t timeoutMs, const std::string &poolName)
+{
+    return CoAwaitOffload((CoConnection*)(userData->m_coroutineData.first), std::move(func), timeoutMs, poolName);
+}
+
+void CoAwait::dispatch(CoConnection* connection)
+{
+    CoConnection* originConnection = connection->m_flagBlockConn ? connection->m_blockOriginConn : connection;
+
+    // 等待offload任务完成时 其他唤醒不恢复协程
+    if (originConnection->m_flagOffload) {
+        CO_SERVER_LOG_DEBUG("(cid:%u) await dispatch, wait offload job", connection->m_connId);
+        return ;
+    }
+
+    // C++20协程中不hook系统调用
+    GET_TLS()->m_curConnection = NULL;
+
+    if (originConnection->m_awaitHandle) {
+        std::coroutine_handle<> handle = std::coroutine_handle<>::from_address(originConnection->m_awaitHandle);
+        originConnection->m_awaitHandle = NULL;
+
+        CO_SERVER_LOG_DEBUG("(cid:%u) await dispatch, resume coroutine", connection->m_connId);
+        handle.resume();
+        return ;
+    }
+
+    // 没有挂起的协程 开始新请求
+    if (!(connection->m_flagBlockConn) && connection->m_handler) {
+        connection->m_handler(connection);
+    }
+}
+
+
+void CoAwaitRequest::request_init(CoConnection* connection)
+{
+    // 复用连接的keepalive定时器在request_read中重置为读超时时间
+    connection->m_serverControl->m_requests ++;
+    CoRequest* request = new CoRequest(CO_REQUEST_NORMAL);
+    int32_t ret = request->init(connection, connection->m_serverControl->m_confServer->m_serverType);
+    if (ret != CO_OK) {
+        CO_SERVER_LOG_ERROR("(cid:%u rid:%u) await request init request failed, ret:%d", connection->m_connId, request->m_requestId, ret);
+    }
+
+    request_run(request, ret).detach();
+}
+
+CoAwaitTask CoAwaitRequest::request_run(CoRequest* request, int32_t retCode)
+{
+    if (CO_OK == retCode) {
+        retCode = co_await request_read(request);
+    }
+
+    if (CO_OK == retCode) {
+        retCode = co_await request_process(request);
+    }
+
+    retCode = co_await request_write(request, retCode);
+    request_finalize(request, retCode);
+    co_return retCode;
+}
+
+CoAwaitTask CoAwaitRequest::request_read(CoRequest* request)
+{
+    CoCycle* cycle = request->m_cycle;
+    CoConnection* connection = request->m_connection;
+    CoBuffer* coBuffer = connection->m_coBuffer;
+
+    // 添加读事件epoll和定时器
+    cycle->m_timer->rearm_timer(connection->m_readEvent, connection->m_socketRcvTimeout);
+    int32_t ret = cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_ADD, CO_EVENT_READ);
+    if (CO_OK != ret) {
+        CO_SERVER_LOG_FATAL("(cid:%u) await request epoll add event failed", connection->m_connId);
+    }
+
+    while (CO_OK == ret) {
+        ret = coBuffer->buffer_expand(BUFFER_SIZE_4096);
+        if (CO_OK != ret) {
+            CO_SERVER_LOG_ERROR("(cid:%u rid:%u) buffer expand:%d failed", connection->m_connId, request->m_requestId, BUFFER_SIZE_4096);
+            break;
+        }
+
+        ret = connection->m_coTcp->tcp_read(coBuffer->get_bufferdata() + coBuffer->get_buffersize(), BUFFER_SIZE_4096);
+        if (CO_TIMEOUT == ret) {
+            // 没有数据 等待epoll可读
+            ret = co_await CoAwaitResume(connection);
+            continue;
+        }
+
+        if (ret < CO_OK) {
+            CO_SERVER_LOG_ERROR("(cid:%u rid:%u) socket tcpread ret:%d error", connection->m_connId, request->m_requestId, ret);
+            break;
+        }
+
+        int32_t expandSize = ret;
+        ret = coBuffer->buffer_size_expand(expandSize);
+        if (CO_OK != ret) {
+            CO_SERVER_LOG_ERROR("(cid:%u rid:%u) coBuffer expand size:%d failed", connection->m_connId, request->m_requestId, expandSize);
+            break;
+        }
+
+        ret = request->m_protocol->decode(coBuffer);
+        if (CO_AGAIN == ret) {
+            ret = CO_OK;
+            continue;
+        }
+
+        if (CO_OK == ret) {
+            request->m_readUs = CoClock::now_us() - request->m_startUs;
+            break;
+        }
+
+        CO_SERVER_LOG_ERROR("(cid:%u rid:%u) buffer protocol parse failed, ret:%d", connection->m_connId, request->m_requestId, ret);
+        break;
+    }
+
+    // 只删除读事件监听 还需要监听异常 防止客户端主动断开连接
+    // 读取成功时 读事件定时器在request_process中重置为keepalive时间 不需要删除
+    if (CO_OK != ret) {
+        cycle->m_timer->del_timer(connection->m_readEvent);
+    }
+    if (CO_OK != cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_DEL, CO_EVENT_IN)) {
+        CO_SERVER_LOG_FATAL("(cid:%u) await request epoll del event failed", connection->m_connId);
+    }
+
+    co_return ret;
+}
+
+CoAwaitTask CoAwaitRequest::request_process(CoRequest* request)
+{
+    CoConnection* connection = request->m_connection;
+    CoTimer* timer = request->m_cycle->m_timer;
+
+    // 请求最大处理时间(包含发送响应)为keepalive时间
+    timer->rearm_timer(connection->m_readEvent, connection->m_keepaliveTimeout, TIMER_CLASS_KEEPALIVE);
+
+    CoAwaitTask task = connection->m_serverControl->m_userFuncs->m_awaitProcess(request->m_userData);
+    int32_t ret = co_await task;
+    request->m_processUs = CoClock::now_us() - request->m_startUs;
+    CO_SERVER_LOG_DEBUG("(cid:%u rid:%u) await business handler process complete, ret:%d", connection->m_connId, request->m_requestId, ret);
+
+    co_return ret;
+}
+
+CoAwaitTask CoAwaitRequest::request_write(CoRequest* request, int32_t retCode)
+{
+    CoCycle* cycle = request->m_cycle;
+    CoConnection* connection = request->m_connection;
+    CoEvent* writeEvent = connection->m_writeEvent;
+    CoBuffer* coBuffer = connection->m_coBuffer;
+
+    // 直接发送响应 发送缓冲区满时才添加写事件epoll
+    cycle->m_timer->add_timer(writeEvent, connection->m_socketSndTimeout);
+    int32_t ret = CO_OK;
+
+    // 构建响应
+    if (coBuffer->get_buffersize() > 0) {
+        coBuffer->reset();
+    }
+    request->m_protocol->encode(coBuffer);
+
+    while (CO_OK == ret && coBuffer->get_buffersize() > 0) {
+        int32_t writeSize = connection->m_coTcp->tcp_write(coBuffer->get_bufferdata(), coBuffer->get_buffersize());
+        if (writeSize > 0) {
+            coBuffer->buffer_erase(writeSize);
+            continue;
+        }
+
+        if (CO_TIMEOUT == writeSize) {
+            // 发送缓冲区满 等待epoll可写
+            ret = cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_ADD, CO_EVENT_OUT);
+            if (CO_OK != ret) {
+                CO_SERVER_LOG_FATAL("(cid:%u rid:%u) await request epoll add event failed", connection->m_connId, request->m_requestId);
+                continue;
+            }
+            ret = co_await CoAwaitResume(connection);
+            continue;
+        }
+
+        CO_SERVER_LOG_ERROR("(cid:%u rid:%u) buffer write socket fd:%d failed, ret:%d errno:%d", connection->m_connId, request->m_requestId, connection->m_coTcp->get_socketfd(), writeSize, errno);
+        ret = CO_ERROR;
+    }
+
+    cycle->m_timer->del_timer(writeEvent);
+    if (CO_OK != cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_DEL, CO_EVENT_OUT)) {
+        CO_SERVER_LOG_FATAL("(cid:%u) await request epoll del event failed", connection->m_connId);
+    }
+
+    if (CO_OK != ret) {
+        co_return CO_ERROR;
+    }
+
+    request->m_writeUs = CoClock::now_us() - request->m_startUs;
+    co_return retCode;
+}
+
+void CoAwaitRequest::request_finalize(CoRequest* request, int32_t retCode)
+{
+    CoConnection* connection = request->m_connection;
+
+    if (request->m_userDestroy) {
+        request->m_userDestroy(request->m_userData);
+    }
+    CO_SERVER_LOG_DEBUG("(cid:%u rid:%u) await request finalize, timeus start:%lu, diffstart read:%lu process:%lu write:%lu", connection->m_connId, request->m_requestId, request->m_startUs, request->m_readUs, request->m_processUs, request->m_writeUs);
+
+    SAFE_DELETE(request);
+
+    CoCallbackRequest::free_request_connection(connection, retCode);
+    if (CO_OK == retCode) {
+        // keepalive 下一个请求继续使用C++20协程
+        connection->m_handler = CoAwaitRequest::request_init;
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef _CO_AWAIT_H_
+#define _CO_AWAIT_H_
+
+/*
+    C++20无栈协程(co_await)处理函数
+    编译: make FLAGS="-DCO_AWAIT -std=c++20"
+
+    CoServer::add_await_handlers注册的server, 请求的读取/处理/响应全部在C++20协程中执行
+    不使用CoCoroutineMain: 没有协程栈 没有栈拷贝和上下文切换, 协程帧在堆上 挂起时句柄保存在连接的m_awaitHandle
+    epoll/定时器/延迟队列事件触发func_dispatcher后 直接resume句柄
+
+    处理函数中可以co_await:
+        CoAwait::sleep          定时器
+        CoAwait::read/write     第三方非阻塞socket可读/可写 (使用连接的阻塞连接注册epoll)
+        CoAwait::upstreams      add_upstream添加的子请求全部完成 (子请求仍然使用upstream连接的有栈协程)
+        CoAwait::yield_now      主动让出 放到运行队列末尾 (对应CoDispatcher::yield_now)
+        CoAwait::offload        在辅助线程池中执行函数 (对应CoDispatcher::offload)
+        其他返回CoAwaitTask的函数
+
+    注意: 处理函数中不hook系统调用, 阻塞调用会阻塞整个线程 第三方socket需要设置非阻塞后配合CoAwait::read/write
+*/
+
+#if (CO_AWAIT)
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include "base/co_common.h"
+#include "core/co_offload.h"
+
+
+namespace coserver
+{
+
+struct CoConnection;
+struct CoRequest;
+struct CoUserHandlerData;
+
+
+// 返回int32_t的C++20协程 创建后挂起, co_await时开始执行 结束后恢复等待方
+class CoAwaitTask
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> CoHandle;
+
+    struct CoFinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(CoHandle handle) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type
+    {
+        int32_t                 m_value = CO_OK;
+        bool                    m_detached = false;     // 分离运行 结束时自己销毁协程帧
+        std::coroutine_handle<> m_continuation;         // 等待当前协程结束的协程
+
+        CoAwaitTask get_return_object() { return CoAwaitTask(CoHandle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        CoFinalAwaiter final_suspend() noexcept { return {}; }
+        void return_value(int32_t value) { m_value = value; }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    CoAwaitTask() = default;
+    explicit CoAwaitTask(CoHandle handle) : m_handle(handle) {}
+    CoAwaitTask(CoAwaitTask &&other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+    CoAwaitTask(const CoAwaitTask&) = delete;
+    CoAwaitTask& operator=(const CoAwaitTask&) = delete;
+    ~CoAwaitTask();
+
+    CoAwaitTask& operator=(CoAwaitTask &&other) noexcept;
+
+    // 开始执行并分离 (请求入口使用)
+    void detach();
+
+    // co_await task
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept;
+    int32_t await_resume() const noexcept { return m_handle ? m_handle.promise().m_value : CO_ERROR; }
+
+private:
+    CoHandle m_handle = nullptr;
+};
+
+typedef std::function<CoAwaitTask (CoUserHandlerData* userData)> CoFuncAwaitProcess;
+
+
+/*
+    挂起当前请求的协程 等待连接被func_dispatcher调度
+    返回值: CO_OK成功 连接即将销毁(超时/对端关闭)时CO_ERROR
+*/
+class CoAwaitResume
+{
+public:
+    explicit CoAwaitResume(CoConnection* connection) : m_connection(connection) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    int32_t await_resume();
+
+protected:
+    CoConnection*   m_connection = NULL;
+    int32_t         m_ret = CO_OK;
+};
+
+// 定时器
+class CoAwaitSleep : public CoAwaitResume
+{
+public:
+    CoAwaitSleep(CoConnection* connection, uint32_t sleepMs) : CoAwaitResume(connection), m_sleepMs(sleepMs) {}
+
+    bool await_suspend(std::coroutine_handle<> handle);
+    int32_t await_resume();
+
+private:
+    uint32_t    m_sleepMs = 0;
+};
+
+// 第三方socket可读/可写
+class CoAwaitSocket : public CoAwaitResume
+{
+public:
+    CoAwaitSocket(CoConnection* connection, int32_t socketFd, uint32_t eventOP, int32_t timeoutMs) : CoAwaitResume(connection), m_socketFd(socketFd), m_eventOP(eventOP), m_timeoutMs(timeoutMs) {}
+
+    bool await_suspend(std::coroutine_handle<> handle);
+    int32_t await_resume();
+
+private:
+    int32_t     m_socketFd = -1;
+    uint32_t    m_eventOP = 0;
+    int32_t     m_timeoutMs = -1;
+    bool        m_registered = false;
+};
+
+// 主动让出 运行队列切入
+class CoAwaitYield : public CoAwaitResume
+{
+public:
+    explicit CoAwaitYield(CoConnection* connection) : CoAwaitResume(connection) {}
+
+    bool await_suspend(std::coroutine_handle<> handle);
+    int32_t await_resume();
+};
+
+// 辅助线程池任务完成
+class CoAwaitOffload : public CoAwaitResume
+{
+public:
+    CoAwaitOffload(CoConnection* connection, std::function<void ()> func, int32_t timeoutMs, const std::string &poolName) 
+        : CoAwaitResume(connection), m_func(std::move(func)), m_timeoutMs(timeoutMs), m_poolName(poolName) {}
+
+    bool await_suspend(std::coroutine_handle<> handle);
+    int32_t await_resume();
+
+private:
+    std::function<void ()>  m_func;
+    int32_t                 m_timeoutMs = -1;
+    std::string             m_poolName;
+    CoOffloadJob*           m_job = NULL;
+};
+
+// 子请求全部完成
+class CoAwaitUpstreams : public CoAwaitResume
+{
+public:
+    explicit CoAwaitUpstreams(CoConnection* connection) : CoAwaitResume(connection) {}
+
+    bool await_ready() const noexcept;
+};
+
+
+// 处理函数使用的awaitable
+class CoAwait
+{
+public:
+    // 等待sleepMs毫秒
+    static CoAwaitSleep sleep(CoUserHandlerData* userData, uint32_t sleepMs);
+
+    // 等待第三方非阻塞socket可读/可写, 返回CO_OK成功 CO_TIMEOUT超时 其他错误
+    static CoAwaitSocket read(CoUserHandlerData* userData, int32_t socketFd, int32_t timeoutMs = -1);
+    static CoAwaitSocket write(CoUserHandlerData* userData, int32_t socketFd, int32_t timeoutMs = -1);
+
+    // 等待CoUpstreamPool::add_upstream添加的子请求全部完成 (代替run_upstreams)
+    static CoAwaitUpstreams upstreams(CoUserHandlerData* userData);
+
+    // 主动让出 先处理其他连接 长时间计算中配合CoYielder::need_yield使用
+    static CoAwaitYield yield_now(CoUserHandlerData* userData);
+
+    // 在辅助线程池中执行func 返回值和CoDispatcher::offload相同 (协程帧在堆上 func可以引用协程中的变量)
+    static CoAwaitOffload offload(CoUserHandlerData* userData, std::function<void ()> func, int32_t timeoutMs = -1, const std::string &poolName = OFFLOAD_POOL_DEFAULT);
+
+    // func_dispatcher调用: 恢复挂起的协程 或 开始新请求
+    static void dispatch(CoConnection* connection);
+};
+
+
+// C++20协程的请求处理流程 (对应CoCallbackRequest)
+class CoAwaitRequest
+{
+public:
+    static void request_init(CoConnection* connection);
+
+private:
+    static CoAwaitTask request_run(CoRequest* request, int32_t retCode);
+    static CoAwaitTask request_read(CoRequest* request);
+    static CoAwaitTask request_process(CoRequest* request);
+    static CoAwaitTask request_write(CoRequest* request, int32_t retCode);
+    static void request_finalize(CoRequest* request, int32_t retCode);
+};
+
+}
+
+#endif
+
+#endif //_CO_AWAIT_H_
@@ -44,6 +44,12 @@ int32_t CoCallbackEvent::event_exception(CoConnection* connection)
         return CO_OK;
     }
 
+    // 请求内的子协程没有socket和request 切入协程 由阻塞调用处返回错误尽快结束
+    if (connection->m_flagTask) {
+        CO_SERVER_LOG_WARN("(cid:%u) task connection exception, resume task, quick finish, timedout:%d dying:%d", connection->m_connId, connection->m_flagTimedOut, connection->m_flagDying);
+        return CO_OK;
+    }
+
     if (connection->m_request) {
         CoRequest* request = connection->m_request;
         CO_SERVER_LOG_WARN("(cid:%u rid:%u rt:%d) request connection timedout:%d pendingeof:%d dying:%d", connection->m_connId, request->m_requestId, request->m_requestType, connection->m_flagTimedOut, connection->m_flagPendingEof, connection->m_flagDying);
@@ -56,7 +62,7 @@ int32_t CoCallbackEvent::event_exception(CoConnection* connection)
 
                 upstreamConnection->m_flagDying = 1;
                 upstreamConnection->m_flagParentDying = 1; 
-                connection->m_cycle->m_dispatcher->m_delayConnections.push(std::make_pair(upstreamConnection, upstreamConnection->m_version));
+                connection->m_cycle->m_dispatcher->m_delayConnections.push(std::make_pair(upstreamConnection, upstreamConnection->m_version), upstreamConnection->m_priority);
                 CO_SERVER_LOG_WARN("(cid:%u scid:%d srid:%u) connection exception, resume dying upstreams, quick finish", connection->m_connId, upstreamConnection->m_connId, upstreamRequest->m_requestId);
             }
 
@@ -9,11 +9,8 @@ namespace coserver
 
 void CoCallbackRequest::request_init(CoConnection* connection)
 {
-    // 如果是复用连接 删除之前的keepalive定时器
-    if (connection->m_readEvent->m_flagTimerSet) {
-        connection->m_cycle->m_timer->del_timer(connection->m_readEvent);
-    }
-
+    // 复用连接的keepalive定时器在request_read中重置为读超时时间
+    connection->m_serverControl->m_requests ++;
     CoRequest* request = new CoRequest(CO_REQUEST_NORMAL);
     int32_t ret = request->init(connection, connection->m_serverControl->m_confServer->m_serverType);
     if (ret != CO_OK) {
@@ -30,18 +27,23 @@ void CoCallbackRequest::request_read(CoRequest* request)
     CoConnection* connection = request->m_connection;
     CoBuffer* coBuffer = connection->m_coBuffer;
 
+    // 读取成功时 读事件定时器在request_process中重置为keepalive时间 不需要删除
+    bool readComplete = false;
+
     co_use_defer_return();
 
     // 客户端数据读取完毕或出错 删除事件epoll 只删除读事件监听 还需要监听异常 防止客户端主动断开连接
     co_defer(
-        cycle->m_timer->del_timer(connection->m_readEvent);
+        if (!readComplete) {
+            cycle->m_timer->del_timer(connection->m_readEvent);
+        }
         if (CO_OK != cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_DEL, CO_EVENT_IN)) {
             CO_SERVER_LOG_FATAL("(cid:%u) request epoll del event failed", connection->m_connId);
         }
     )
     
     // 添加读事件epoll和定时器
-    cycle->m_timer->add_timer(connection->m_readEvent, connection->m_socketRcvTimeout);
+    cycle->m_timer->rearm_timer(connection->m_readEvent, connection->m_socketRcvTimeout);
     if (CO_OK != cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_ADD, CO_EVENT_READ)) {
         CO_SERVER_LOG_FATAL("(cid:%u) request epoll add event failed", connection->m_connId);
         return co_defer_return(request_write(request, CO_ERROR));
@@ -81,7 +83,7 @@ void CoCallbackRequest::request_read(CoRequest* request)
         }
         
         if (CO_OK == ret) {
-            request->m_readUs = GET_CURRENTTIME_US() - request->m_startUs;
+            request->m_readUs = CoClock::now_us() - request->m_startUs;
             break;
         }
         
@@ -96,6 +98,7 @@ void CoCallbackRequest::request_read(CoRequest* request)
     }
 
     // 请求协议解析成功  开始处理请求
+    readComplete = true;
     return co_defer_return(request_process(request));
 }
 
@@ -104,15 +107,14 @@ void CoCallbackRequest::request_process(CoRequest* request)
     CoTimer* timer = request->m_cycle->m_timer;
     CoEvent* readEvent = request->m_connection->m_readEvent;
 
-    // 请求最大处理时间为keepalive时间  超时后清理请求
-    timer->add_timer(readEvent, request->m_connection->m_keepaliveTimeout);
+    // 请求最大处理时间(包含发送响应)为keepalive时间  超时后清理请求
+    timer->rearm_timer(readEvent, request->m_connection->m_keepaliveTimeout, TIMER_CLASS_KEEPALIVE);
 
     // 业务函数处理
     int32_t ret = request->m_userProcess(request->m_userData);
-    request->m_processUs = GET_CURRENTTIME_US() - request->m_startUs;
+    request->m_processUs = CoClock::now_us() - request->m_startUs;
     CO_SERVER_LOG_DEBUG("(cid:%u rid:%u) business handler process complete, ret:%d", request->m_connection->m_connId, request->m_requestId, ret);
 
-    timer->del_timer(readEvent);
     return request_write(request, ret);
 }
 
@@ -123,7 +125,7 @@ void CoCallbackRequest::request_write(CoRequest* request, int32_t retCode)
     CoEvent* writeEvent = connection->m_writeEvent;
 
     co_use_defer_return();
-    // 客户端数据读取完毕 删除事件epoll 只删除读事件监听 还需要监听异常 防止客户端主动断开连接
+    // 响应发送完毕 删除写事件(发送缓冲区满时hook添加) 还需要监听异常 防止客户端主动断开连接
     co_defer(
         cycle->m_timer->del_timer(writeEvent);
         if (CO_OK != cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_DEL, CO_EVENT_OUT)) {
@@ -131,12 +133,8 @@ void CoCallbackRequest::request_write(CoRequest* request, int32_t retCode)
         }
     )
 
-    // 添加写事件超时定时器和epoll
+    // 添加写事件超时定时器 直接发送响应 发送返回EAGAIN时hook才添加写事件epoll
     cycle->m_timer->add_timer(writeEvent, connection->m_socketSndTimeout);
-    if (cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_ADD, CO_EVENT_OUT)) {
-        CO_SERVER_LOG_FATAL("(cid:%u rid:%u) request epoll add event failed", connection->m_connId, request->m_requestId);
-        return co_defer_return(request_finalize(request, CO_ERROR));
-    }
 
     // 构建响应
     CoBuffer* coBuffer = connection->m_coBuffer;
@@ -162,7 +160,7 @@ void CoCallbackRequest::request_write(CoRequest* request, int32_t retCode)
         break;
     }
 
-    request->m_writeUs = GET_CURRENTTIME_US() - request->m_startUs;
+    request->m_writeUs = CoClock::now_us() - request->m_startUs;
     CO_SERVER_LOG_DEBUG("(cid:%u rid:%u) response write success", connection->m_connId, request->m_requestId);
 
     return co_defer_return(request_finalize(request, retCode));
@@ -190,11 +188,11 @@ void CoCallbackRequest::free_request_connection(CoConnection* connection, int32_
     CoEvent* readEvent = connection->m_readEvent;
     CoEvent* writeEvent = connection->m_writeEvent;
 
-    // 清理连接上的事件和定时器
+    // 清理连接上的事件和定时器 keepalive连接的读事件定时器之后重置
     if (writeEvent->m_flagTimerSet) {
         connection->m_cycle->m_timer->del_timer(writeEvent);
     }
-    if (readEvent->m_flagTimerSet) {
+    if (readEvent->m_flagTimerSet && CO_OK != retCode) {
         connection->m_cycle->m_timer->del_timer(readEvent);
     }
 
@@ -211,15 +209,12 @@ void CoCallbackRequest::free_request_connection(CoConnection* connection, int32_
     // reuse连接信息  tcp连接保留(清空后再添加epoll/timer 防止连接版本不对)
     connection->reset(true);
 
-    // 复用连接 添加epoll、定时器等  需要添加epoll_in 继续读取新请求数据
+    // 复用连接 添加epoll、定时器等  需要添加epoll_in 继续读取新请求数据 (写事件在request_write中已经删除)
     if (cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_ADD, CO_EVENT_IN)) {
-        CO_SERVER_LOG_FATAL("(cid:%u) client keepalive, epoll del event failed", connection->m_connId);
-    }
-    if (cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_DEL, CO_EVENT_OUT)) {
-        CO_SERVER_LOG_FATAL("(cid:%u) client keepalive, epoll del event failed", connection->m_connId);
+        CO_SERVER_LOG_FATAL("(cid:%u) client keepalive, epoll add event failed", connection->m_connId);
     }
     // 读超时时间重置为keepalive时间
-    cycle->m_timer->add_timer(readEvent, connection->m_keepaliveTimeout);
+    cycle->m_timer->rearm_timer(readEvent, connection->m_keepaliveTimeout, TIMER_CLASS_KEEPALIVE);
 
     // 重置读事件回调函数为event_init
     connection->m_handler = request_init;
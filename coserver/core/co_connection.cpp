@@ -23,6 +23,12 @@ CoConnection::CoConnection(uint32_t id, CoCycle* cycle)
 , m_flagDying(0)
 , m_flagParentDying(0)
 , m_flagThirdFuncBlocking(0)
+, m_flagTask(0)
+, m_flagTaskFinished(0)
+, m_flagYieldNow(0)
+, m_flagOffload(0)
+, m_flagAwait(0)
+, m_flagRegisterOnce(0)
 {
 }
 
@@ -32,6 +38,7 @@ CoConnection::~CoConnection()
     SAFE_DELETE(m_readEvent);
     SAFE_DELETE(m_writeEvent);
     SAFE_DELETE(m_sleepEvent);
+    SAFE_DELETE(m_localStorage);
     SAFE_DELETE(m_coroutine);
     SAFE_DELETE(m_coTcp);
 }
@@ -43,6 +50,7 @@ void CoConnection::reset(bool keepalive)
 
     m_handler = NULL;
     m_request = NULL;
+    m_awaitHandle = NULL;
 
     m_flagUseBlockConn = 0;
     m_flagPendingEof = 0;
@@ -50,27 +58,41 @@ void CoConnection::reset(bool keepalive)
     m_flagDying = 0;
     m_flagParentDying = 0;
     m_flagThirdFuncBlocking = 0;
+    m_flagTask = 0;
+    m_flagTaskFinished = 0;
+    m_flagYieldNow = 0;
+    m_flagOffload = 0;
 
-    m_readEvent->reset();
+    // keepalive连接保留读事件定时器 随后重置为keepalive时间
+    m_readEvent->reset(keepalive);
     m_writeEvent->reset();
     m_sleepEvent->reset();
 
     m_coBuffer->reset();
     m_coroutine->reset();
 
+    // 请求结束 析构协程本地对象
+    if (m_localStorage) {
+        m_localStorage->clear();
+    }
+
     // keepalive连接 socket/servercontrol/upstream/backend不需要清空
     if (!keepalive) {
         if (m_coTcp->get_socketfd() > 0) {
             CO_SERVER_LOG_ERROR("connection tcp is using by socketfd:%d, now close socket", m_coTcp->get_socketfd());
+            m_cycle->m_coEpoll->close_socket(m_coTcp->get_socketfd());
             m_coTcp->tcp_close();
         }
 
         m_startTimestamp = 0;
         m_serverControl = NULL;
+        m_priority = PRIORITY_NORMAL;
         m_upstream = NULL;
         m_backend = NULL;
         m_requestCount = 0;
         m_handlerCleanups.clear();
+        m_flagAwait = 0;
+        m_flagRegisterOnce = 0;
     }
 
     // blockconn重置信息
@@ -205,13 +227,13 @@ CoConnection* CoConnectionPool::get_connection(const std::string &ip, uint16_t p
     }
 
     m_freeConnections.pop_front();
-    connection->m_startTimestamp = GET_CURRENTTIME_MS(); 
+    connection->m_startTimestamp = CoClock::now_ms(); 
 
     m_innerSockets.insert(connection->m_coTcp->get_socketfd());
     return connection;
 }
 
-CoConnection* CoConnectionPool::get_connection(int32_t socketFd)
+CoConnection* CoConnectionPool::get_connection(int32_t socketFd, bool getPeerInfo)
 {
     // 在cycle所属线程中调用 无需加锁
     if (m_freeConnections.empty()) {
@@ -223,7 +245,7 @@ CoConnection* CoConnectionPool::get_connection(int32_t socketFd)
     }
 
     CoConnection* connection = m_freeConnections.front();
-    if (CO_OK != connection->m_coTcp->init_client_socketfd(socketFd)) {
+    if (CO_OK != connection->m_coTcp->init_client_socketfd(socketFd, getPeerInfo)) {
         return NULL;
     }
 
@@ -233,7 +255,7 @@ CoConnection* CoConnectionPool::get_connection(int32_t socketFd)
     }
 
     m_freeConnections.pop_front();
-    connection->m_startTimestamp = GET_CURRENTTIME_MS();
+    connection->m_startTimestamp = CoClock::now_ms();
 
     m_innerSockets.insert(socketFd);
     return connection;
@@ -252,6 +274,7 @@ void CoConnectionPool::free_connection(CoConnection* connection)
     }
 
     if (socketFd > 0) {
+        m_cycle->m_coEpoll->close_socket(socketFd);
         connection->m_coTcp->tcp_close();
 
     } else {
@@ -269,6 +292,38 @@ void CoConnectionPool::free_connection(CoConnection* connection)
     m_freeConnections.emplace_front(connection);
 }
 
+CoConnection* CoConnectionPool::get_task_connection()
+{
+    // 在cycle所属线程中调用 无需加锁
+    if (m_freeConnections.empty()) {
+        expand_connections();
+        if (m_freeConnections.empty()) {
+            CO_SERVER_LOG_ERROR("%u connections are not enough, no task connection", m_maxConnectionSize);
+            return NULL;
+        }
+    }
+
+    CoConnection* connection = m_freeConnections.front();
+    m_freeConnections.pop_front();
+
+    connection->m_flagTask = 1;
+    connection->m_startTimestamp = CoClock::now_ms();
+    return connection;
+}
+
+void CoConnectionPool::free_task_connection(CoConnection* connection)
+{
+    // cleanup
+    for (auto &itrFunc : connection->m_handlerCleanups) {
+        itrFunc(connection);
+    }
+    connection->m_handlerCleanups.clear();
+
+    // 置于队列头 方便下次使用
+    connection->reset();
+    m_freeConnections.emplace_front(connection);
+}
+
 CoConnection* CoConnectionPool::get_connection_accord_id(int32_t connId)
 {
     return m_connections[connId - 1];   // conn id是从1开始
@@ -291,7 +346,7 @@ void CoConnectionPool::close_all_connection()
             if (connection->m_coTcp->get_socketfd() > 0) {
                 // 连接使用中 调用读事件handler来处理主动关闭标识  注：客户端处于连接中 肯定有读事件及回调函数存在
                 connection->m_flagPendingEof = 1;
-                connection->m_cycle->m_dispatcher->m_delayConnections.push(std::make_pair(connection, connection->m_version));
+                connection->m_cycle->m_dispatcher->m_delayConnections.push(std::make_pair(connection, connection->m_version), connection->m_priority);
             }
         }
     }
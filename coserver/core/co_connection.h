@@ -7,8 +7,11 @@
 #include "core/co_event.h"
 #include "base/co_tcp.h"
 #include "base/co_buffer.h"
+#include "base/co_run_queue.h"
 #include "core/co_server_control.h"
+#include "core/co_local.h"
 #include "core/co_callback_event.h"
+#include "core/co_dispatcher.h"
 
 
 namespace coserver
@@ -32,8 +35,9 @@ struct CoConnection
 {
     uint32_t        m_connId = 0;           // 连接id, 从1开始
     uint32_t        m_version = 0;          // 连接版本信息 用于检查连接是否过期
-    uint32_t        m_epollCurEvents = 0;   // epoll中现在的事件events
+    uint32_t        m_epollCurEvents = 0;   // epoll中现在的事件events (关注的事件)
     uint32_t        m_epollCurVersion = 0;  // epoll中现在的version
+    uint32_t        m_epollRegEvents = 0;   // epoll中注册的事件events event_register once时注册全部事件 和关注的事件不同
 
     CoEvent*        m_readEvent  = NULL;    // 读事件
     CoEvent*        m_writeEvent = NULL;    // 写事件
@@ -49,6 +53,7 @@ struct CoConnection
     int32_t         m_socketSndTimeout = -1;    // socket上写超时时间（hook使用）
     int32_t         m_keepaliveTimeout = -1;    // keepalive超时时间（保活时间）
     CoServerControl* m_serverControl = NULL;    // 连接所属的server
+    int32_t         m_priority = PRIORITY_NORMAL;  // 调度优先级 server配置 请求处理中可修改 (CoUserHandlerData::set_priority)
 
     // request
     CoRequest*      m_request = NULL;           // 指向连接对应的请求request
@@ -64,6 +69,15 @@ struct CoConnection
     std::function<int32_t (CoConnection* connection)> m_handlerException = CoCallbackEvent::event_exception;   // 事件发生异常时回调函数, 比如超时/对端关闭socket
     std::vector<std::function<void (CoConnection* connection)>> m_handlerCleanups;
 
+    // 协程本地存储 第一次使用CoLocal时创建, 请求结束析构对象 内存随连接复用
+    CoLocalStorage* m_localStorage = NULL;
+
+    // 其他线程恢复协程时放入worker恢复队列的节点 (CoDispatcher::push_resume) 不随连接重置, 按版本判断是否过期
+    CoResumeNode    m_resumeNode;
+
+    // C++20协程处理函数 挂起的协程句柄(std::coroutine_handle::address)
+    void*           m_awaitHandle = NULL;
+
     // 调用第三方模块中使用了阻塞socket
     CoConnection*   m_blockConn = NULL;         // 第三方阻塞网络socket的连接 flagBlockSocket为0时有效
     CoConnection*   m_blockOriginConn = NULL;   // 当前连接是第三方阻塞socket时 的原始socket连接
@@ -78,6 +92,12 @@ struct CoConnection
     unsigned        m_flagParentDying:1;    // 父请求连接即将销毁
 
     unsigned        m_flagThirdFuncBlocking:1; // 为1表示第三方函数阻塞中, 比如sleep/mutex
+    unsigned        m_flagTask:1;           // 为1表示请求内spawn的子协程连接 (没有socket)
+    unsigned        m_flagTaskFinished:1;   // 为1表示子协程执行函数已经返回 协程切出后由dispatcher归还连接
+    unsigned        m_flagYieldNow:1;       // 为1表示协程调用yield_now让出 在运行队列中等待
+    unsigned        m_flagOffload:1;        // 为1表示协程等待offload的辅助线程任务完成
+    unsigned        m_flagAwait:1;          // 为1表示连接的请求使用C++20协程处理 (add_await_handlers)
+    unsigned        m_flagRegisterOnce:1;   // 为1表示socket只注册一次epoll 关注的事件在用户态记录 (event_register once)
 
 
 // functions
@@ -102,10 +122,14 @@ public:
 
     // 获取连接
     CoConnection* get_connection(const std::string &ip, uint16_t port, bool listen = false);
-    CoConnection* get_connection(int32_t socketFd);
+    CoConnection* get_connection(int32_t socketFd, bool getPeerInfo = true);
     // 释放连接  置回连接池
     void free_connection(CoConnection* connection);
 
+    // 获取/释放子协程使用的连接 (没有socket)
+    CoConnection* get_task_connection();
+    void free_task_connection(CoConnection* connection);
+
     CoConnection* get_connection_accord_id(int32_t connId);
     bool is_inner_socketfd(int32_t socketFd);
     
@@ -18,6 +18,8 @@ namespace coserver
 struct CoCycle 
 {
     int32_t             m_innerThreadId = -1;       // 对应的内部线程id
+    int32_t             m_cpu = -1;                 // worker线程绑定的CPU -1表示没有绑定
+    std::vector<int32_t> m_listenSockets;           // cpu模式 主线程创建的当前worker的监听socket 按server配置顺序
 
     const CoConfig*     m_conf      = NULL;         // 配置项
 
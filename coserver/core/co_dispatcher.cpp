@@ -1,5 +1,6 @@
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sched.h>
 #include "core/co_dispatcher.h"
 #include "base/co_log.h"
 #include "core/co_cycle.h"
@@ -7,6 +8,9 @@
 #include "core/co_callback_event.h"
 #include "core/co_callback_request.h"
 #include "core/co_server_control.h"
+#include "core/co_watchdog.h"
+#include "core/co_periodic.h"
+#include "core/co_acceptor.h"
 
 
 namespace coserver
@@ -18,6 +22,17 @@ CoDispatcher::CoDispatcher()
 
 CoDispatcher::~CoDispatcher() 
 {
+    SAFE_DELETE(m_watchdog);
+    SAFE_DELETE(m_periodic);
+
+    // 连接池在dispatcher之后释放 内嵌节点不需要处理
+    CoResumeNode* node = NULL;
+    while ((node = m_resumeQueue.pop()) != NULL) {
+        if (node != &node->m_connection->m_resumeNode) {
+            SAFE_DELETE(node);
+        }
+    }
+
     for (auto &itr : m_serverControls) {
         SAFE_DELETE(itr);
     }
@@ -26,16 +41,20 @@ CoDispatcher::~CoDispatcher()
 
 int32_t CoDispatcher::init(CoCycle* cycle)
 {
-    int32_t ret = init_yieldresume_comm(cycle);
+    // 其他线程恢复协程时 通过eventfd唤醒当前线程
+    int32_t ret = cycle->m_coEpoll->init_notifyfd();
     if (ret != CO_OK) {
-        CO_SERVER_LOG_ERROR("start inter resume socket init error, ret:%d", ret);
+        CO_SERVER_LOG_ERROR("start inter resume eventfd init error, ret:%d", ret);
         return CO_ERROR;
     }
 
+    m_cycle = cycle;
+    m_delayConnections.set_aging(cycle->m_conf->m_conf.m_priorityAging);
+
     // listen servers
     for (auto &itr : cycle->m_conf->m_confServers) {
         CoConfServer* confServer = itr;
-        CoServerControl* serverControl = new CoServerControl(confServer);
+        CoServerControl* serverControl = new CoServerControl(confServer, m_serverControls.size());
         
         ret = serverControl->init(cycle);
         if (ret != CO_OK) {
@@ -49,59 +68,32 @@ int32_t CoDispatcher::init(CoCycle* cycle)
     return CO_OK;
 }
 
-int32_t CoDispatcher::init_yieldresume_comm(CoCycle* cycle)
+int32_t CoDispatcher::start(CoCycle* cycle)
 {
-    // yield/resume socket attributes
-    int32_t socketFds[2];
-    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socketFds) != 0) {
-        CO_SERVER_LOG_ERROR("yield/resume UNIX socketpair failed");
-        return CO_ERROR;
-    }
+    m_run = true;
 
-    // read
-    CoConnection* resumeReadConnection = cycle->m_connectionPool->get_connection(socketFds[0]);
-    if (resumeReadConnection == NULL) {
-        CO_SERVER_LOG_ERROR("yield/resume read comm get connection failed");
-        return CO_ERROR;
+    int32_t watchdogBudget = cycle->m_conf->m_conf.m_watchdogBudget;
+    if (watchdogBudget > 0) {
+        m_watchdog = new CoWatchdog;
+        m_watchdog->start(watchdogBudget);
     }
 
-    // write
-    m_writeResumeConnection = cycle->m_connectionPool->get_connection(socketFds[1]);
-    if (m_writeResumeConnection == NULL) {
-        CO_SERVER_LOG_ERROR("yield/resume write comm get connection failed");
-        return CO_ERROR;
-    }
-    CO_SERVER_LOG_DEBUG("yield/resume communicate read fd:%d write fd:%d", resumeReadConnection->m_coTcp->get_socketfd(), m_writeResumeConnection->m_coTcp->get_socketfd());
-
-    // 监听连接 读事件处理函数
-    resumeReadConnection->m_handler = [=](CoConnection* connection) {
-        // 将数据全部读出 主要目的是触发epoll 处理m_waitResumes数组数据
-        char buffer[8];
-        int32_t readSize = connection->m_coTcp->tcp_read(buffer, 8); UNUSED(readSize);
-        CO_SERVER_LOG_DEBUG("yield/resume socket read:%d bytes data:%.*s", readSize, readSize, buffer);
-    };
-
-    // 监听连接 读事件异常处理函数
-    resumeReadConnection->m_handlerException = [=](CoConnection* connection) -> int32_t {
-        if (connection->m_flagPendingEof) {
-            CO_SERVER_LOG_WARN("yield/resume socket exception, pendingeof:%d", connection->m_flagPendingEof);
+    if (!CoPeriodicScheduler::get_tasks().empty()) {
+        m_periodic = new CoPeriodicScheduler;
+        if (CO_OK != m_periodic->start(cycle, m_mailbox ? m_mailbox->m_index : 0)) {
+            CO_SERVER_LOG_ERROR("coserver dispatcher start periodic tasks failed");
         }
-        return CO_OK;
-    };
-
-    // add to epoll
-    return cycle->m_coEpoll->modify_connection(resumeReadConnection, EPOLL_EVENTS_ADD, CO_EVENT_READ);
-}
-
-int32_t CoDispatcher::start(CoCycle* cycle)
-{
-    m_run = true;
+    }
 
     for (;;) {
         if (!m_run) {
+            if (m_periodic) {
+                m_periodic->stop();
+            }
             cycle->m_connectionPool->close_all_connection();
 
-            if (cycle->m_timer->empty()) {
+            // 辅助线程池中的任务完成后才能退出 (完成时会访问dispatcher和连接), 周期任务的协程结束后退出
+            if (cycle->m_timer->empty() && m_offloadPending == 0 && (!m_periodic || m_periodic->is_idle())) {
                 CO_SERVER_LOG_INFO("coserver dispatcher exit");
                 break;
             }
@@ -110,8 +102,18 @@ int32_t CoDispatcher::start(CoCycle* cycle)
         }
 
         process_events_and_timers(cycle);
+        cycle->m_coCoroutineMain->trim_buffers();
+        log_stats(cycle);
     }
 
+    if (m_watchdog) {
+        m_watchdog->stop();
+    }
+
+    // 退出后投递的任务不再唤醒 CoServer释放邮箱时清理
+    if (m_mailbox) {
+        m_mailbox->m_dispatcher.store(NULL);
+    }
     return CO_OK;
 }
 
@@ -121,64 +123,289 @@ int32_t CoDispatcher::stop()
     return CO_OK;
 }
 
+void CoDispatcher::log_stats(CoCycle* cycle)
+{
+    int32_t statsInterval = cycle->m_conf->m_conf.m_statsInterval;
+    if (statsInterval <= 0) {
+        return ;
+    }
+
+    uint64_t now = CoClock::now_ms();
+    if (now - m_lastStatsTime < (uint64_t)statsInterval) {
+        return ;
+    }
+
+    uint64_t elapsed = now - m_lastStatsTime;
+    m_lastStatsTime = now;
+
+    CoCoroutineMain* coroutineMain = cycle->m_coCoroutineMain;
+    coroutineMain->check_stack_paint();
+    const CoCoroutineStats &coStats = coroutineMain->get_stats();
+
+    uint64_t copyBytesPerSec = elapsed ? (coStats.m_copyBytes - m_lastCopyBytes) * 1000 / elapsed : 0;
+    m_lastCopyBytes = coStats.m_copyBytes;
+
+    CO_SERVER_LOG_INFO("stats coroutine stack copies:%lu copy skips:%lu copy bytes:%lu (%lu/s), buffer allocs:%lu cache hits:%lu cached:%lu inuse:%lu", coStats.m_stackCopies, coStats.m_stackCopySkips, 
+            coStats.m_copyBytes, copyBytesPerSec, coStats.m_bufferAllocs, coStats.m_bufferCacheHits, coStats.m_bufferCached, coStats.m_bufferInUse);
+
+    // 切出时栈深度分布 [2^i, 2^(i+1))
+    std::string histogram;
+    for (int32_t i=0; i<STACK_DEPTH_BUCKETS; ++i) {
+        if (coStats.m_depthHistogram[i]) {
+            histogram += " " + std::to_string(1UL << i) + ":" + std::to_string(coStats.m_depthHistogram[i]);
+        }
+    }
+    CO_SERVER_LOG_INFO("stats coroutine yields:%lu max depth:%u paint high water:%u stack size:%u, depth histogram:%s", coStats.m_yields, coStats.m_maxDepth, 
+            coStats.m_paintHighWater, coroutineMain->get_stack_size(), histogram.c_str());
+
+    uint64_t requests = 0;
+    for (auto &serverControl : m_serverControls) {
+        requests += serverControl->m_requests;
+        CO_SERVER_LOG_INFO("stats handler:%s requests:%lu peak stack depth:%u watchdog events:%u deferred accepts:%lu", serverControl->m_confServer->m_handlerName.c_str(), serverControl->m_requests, 
+                serverControl->m_peakStackDepth, serverControl->m_watchdogEvents.load(), serverControl->m_deferredAccepts);
+    }
+
+    // 连接在worker之间的分布 (accept_mode)
+    int32_t connections = 0;
+    uint64_t accepts = 0;
+    uint64_t localAccepts = 0;
+    for (auto &serverControl : m_serverControls) {
+        connections += serverControl->m_curConnectionSize;
+        accepts += serverControl->m_accepts;
+        localAccepts += serverControl->m_localAccepts;
+    }
+    int32_t worker = m_mailbox ? m_mailbox->m_index : 0;
+    if (cycle->m_conf->m_conf.m_acceptMode == ACCEPT_MODE_CPU) {
+        CO_SERVER_LOG_INFO("stats accept worker:%d mode:cpu cpu:%d connections:%d accepts:%lu, local cpu accepts:%lu", worker, cycle->m_cpu, connections, accepts, localAccepts);
+    } else if (m_load) {
+        CO_SERVER_LOG_INFO("stats accept worker:%d mode:acceptor connections:%d accepts:%lu, handoffs:%lu drops:%lu loop lag:%luus", worker, connections, accepts, 
+                m_load->m_handoffs.load(), m_load->m_drops.load(), m_load->m_loopLagUs.load());
+    } else {
+        CO_SERVER_LOG_INFO("stats accept worker:%d mode:reuseport connections:%d accepts:%lu", worker, connections, accepts);
+    }
+
+    const CoTimerStats &timerStats = cycle->m_timer->get_stats();
+    uint64_t timerOps = timerStats.m_adds + timerStats.m_dels + timerStats.m_rearms;
+    CO_SERVER_LOG_INFO("stats timer adds:%lu dels:%lu rearms:%lu (lazy:%lu) relinks:%lu expires:%lu, ops per request:%.2f", timerStats.m_adds, timerStats.m_dels, 
+            timerStats.m_rearms, timerStats.m_rearmLazy, timerStats.m_relinks, timerStats.m_expires, requests ? (double)timerOps / requests : 0.0);
+
+    CoEventBackend* backend = cycle->m_coEpoll->get_backend();
+    const CoEventBackendStats &backendStats = backend->get_stats();
+    CO_SERVER_LOG_INFO("stats event backend:%s ctls:%lu waits:%lu syscalls:%lu, syscalls per request:%.2f", backend->name(), backendStats.m_ctls, backendStats.m_waits, 
+            backendStats.m_syscalls, requests ? (double)backendStats.m_syscalls / requests : 0.0);
+
+    // 忙轮询时间占比 idle为没有等到事件的轮询时间占比 (统计周期内)
+    double spinPercent = elapsed ? (m_loopStats.m_spinUs - m_lastSpinUs) / (elapsed * 10.0) : 0.0;
+    double idleSpinPercent = elapsed ? (m_loopStats.m_spinIdleUs - m_lastSpinIdleUs) / (elapsed * 10.0) : 0.0;
+    m_lastSpinUs = m_loopStats.m_spinUs;
+    m_lastSpinIdleUs = m_loopStats.m_spinIdleUs;
+    CO_SERVER_LOG_INFO("stats event loop busy poll:%dus spins:%lu hits:%lu, spin time:%.1f%% idle spin:%.1f%%, events batch:%d", cycle->m_conf->m_conf.m_busyPollUs, 
+            m_loopStats.m_spins, m_loopStats.m_spinHits, spinPercent, idleSpinPercent, cycle->m_coEpoll->get_events_batch());
+
+    // 其他线程恢复协程 notifies/pushes为需要唤醒worker线程的比例, allocs为没有使用连接内嵌节点的次数
+    uint64_t resumePushes = m_resumePushes.load(std::memory_order_relaxed);
+    uint64_t resumeNotifies = m_resumeNotifies.load(std::memory_order_relaxed);
+    CO_SERVER_LOG_INFO("stats resume queue pushes:%lu notifies:%lu (%.1f%%) allocs:%lu", resumePushes, resumeNotifies, resumePushes ? resumeNotifies * 100.0 / resumePushes : 0.0, 
+            m_resumeAllocs.load(std::memory_order_relaxed));
+
+    // 邮箱 posts为其他线程投递到当前线程的任务数 runs/notifies为一次唤醒平均处理的任务数
+    if (m_mailbox) {
+        uint64_t mailPosts = m_mailbox->m_posts.load(std::memory_order_relaxed);
+        uint64_t mailNotifies = m_mailbox->m_notifies.load(std::memory_order_relaxed);
+        CO_SERVER_LOG_INFO("stats mailbox worker:%d posts:%lu runs:%lu notifies:%lu (%.1f runs per notify), max depth:%lu", m_mailbox->m_index, mailPosts, m_loopStats.m_mailRuns, 
+                mailNotifies, mailNotifies ? (double)m_loopStats.m_mailRuns / mailNotifies : 0.0, m_loopStats.m_maxMailDepth);
+    }
+
+    // 调度循环 处理时间不包括等待事件 max为统计周期内的最大值
+    uint64_t iterations = m_loopStats.m_iterations - m_lastIterations;
+    CO_SERVER_LOG_INFO("stats dispatch loop iterations:%lu busy avg:%.1fus max:%luus, budget exhausted:%lu, max depth delay:%lu resume:%lu", iterations, 
+            iterations ? (double)(m_loopStats.m_busyUs - m_lastBusyUs) / iterations : 0.0, m_loopStats.m_maxBusyUs, m_loopStats.m_budgetExhausted, 
+            m_loopStats.m_maxDelayDepth, m_loopStats.m_maxResumeDepth);
+    // 运行队列各优先级处理的任务数 aged为低优先级等待超时先于高优先级处理的次数
+    CO_SERVER_LOG_INFO("stats run queue pops high:%lu normal:%lu low:%lu aged:%lu, yield nows:%lu", m_delayConnections.get_pops(PRIORITY_HIGH), m_delayConnections.get_pops(PRIORITY_NORMAL), 
+            m_delayConnections.get_pops(PRIORITY_LOW), m_delayConnections.get_aged(), m_loopStats.m_yieldNows);
+
+    // 辅助线程池 wait为协程等待的平均时间(排队+执行) run为平均执行时间; 线程池 depth为当前队列长度/上限
+    std::string pools;
+    for (auto &itr : CoOffloadPool::get_pools()) {
+        CoOffloadPool* pool = itr.second;
+        pools += " " + pool->get_name() + ":" + std::to_string(pool->get_threads()) + "t depth:" + std::to_string(pool->get_depth()) + "/" + std::to_string(pool->get_queue_limit()) 
+                + " peak:" + std::to_string(pool->get_peak_depth()) + " rejects:" + std::to_string(pool->get_rejects()) + " expired:" + std::to_string(pool->get_expired());
+    }
+    uint64_t offloadDone = m_loopStats.m_offloads - m_loopStats.m_offloadRejects - m_offloadPending;
+    CO_SERVER_LOG_INFO("stats offload submits:%lu rejects:%lu expired:%lu pending:%d, wait avg:%.1fus run avg:%.1fus, pools:%s", m_loopStats.m_offloads, m_loopStats.m_offloadRejects, 
+            m_loopStats.m_offloadExpired, m_offloadPending, offloadDone ? (double)m_loopStats.m_offloadWaitUs / offloadDone : 0.0, 
+            offloadDone ? (double)m_loopStats.m_offloadRunUs / offloadDone : 0.0, pools.c_str());
+
+    if (m_periodic) {
+        for (auto &itr : m_periodic->get_states()) {
+            CoPeriodicState* state = itr;
+            CO_SERVER_LOG_INFO("stats periodic task:%s worker:%d runs:%lu skips:%lu failures:%lu running:%d, run last:%luus max:%luus", state->m_task->m_name.c_str(), 
+                    m_mailbox ? m_mailbox->m_index : 0, state->m_runs, state->m_skips, state->m_failures, state->m_runner ? 1 : 0, state->m_lastRunUs, state->m_maxRunUs);
+        }
+    }
+
+    m_lastIterations = m_loopStats.m_iterations;
+    m_lastBusyUs = m_loopStats.m_busyUs;
+    m_loopStats.m_maxBusyUs = 0;
+    m_loopStats.m_maxDelayDepth = 0;
+    m_loopStats.m_maxResumeDepth = 0;
+    m_loopStats.m_maxMailDepth = 0;
+}
+
 int32_t CoDispatcher::process_events_and_timers(CoCycle* cycle)
 {
     CoTimer* timer = cycle->m_timer;
     uint64_t timerTime = timer->find_timer();
+    uint64_t timerCheckTime = CoClock::now_ms();
+    if (timer->is_precise()) {
+        cycle->m_coEpoll->arm_timer(timer->find_precise_timer());
+    }
+
+    // 等待事件前清除唤醒标记 之后其他线程恢复协程时需要eventfd唤醒; 清除后还有任务时不阻塞
+    m_resumeAwake.store(false);
+    if (!m_resumeQueue.empty() || !m_delayConnections.empty() || !m_yieldConnections.empty() || (m_mailbox && !m_mailbox->m_queue.empty())) {
+        timerTime = 0;
+    }
+    if (m_load && timerTime != 0) {
+        // 没有待处理的任务 阻塞等待事件 当前worker没有延迟
+        m_load->m_loopLagUs.store(0, std::memory_order_relaxed);
+    }
+
+    // epoll process  epoll_wait返回后会更新缓存时间
+    int32_t busyPollUs = cycle->m_conf->m_conf.m_busyPollUs;
+    if (busyPollUs > 0 && m_run) {
+        busy_poll_events(cycle, busyPollUs, timerTime);
+    } else {
+        cycle->m_coEpoll->process_events(timerTime);
+    }
+    m_resumeAwake.store(true);
+    uint64_t busyStartUs = CoClock::now_us();
 
-    // epoll process
-    uint64_t processEventsTime = GET_CURRENTTIME_MS();
-    cycle->m_coEpoll->process_events(timerTime);
-    processEventsTime = GET_CURRENTTIME_MS() - processEventsTime;
+    // 上一次循环中主动让出的协程 排在新事件之后
+    for (auto &yieldConnection : m_yieldConnections) {
+        m_delayConnections.push(yieldConnection, yieldConnection.first->m_priority);
+    }
+    m_yieldConnections.clear();
+
+    /*
+        处理完epoll事件后 轮流处理各个来源的任务: 延迟处理的连接 / 其他线程恢复的协程 / 其他线程投递的邮箱任务, 每轮之后检查定时器
+        每个来源每轮最多处理DISPATCH_QUANTUM个 一次循环中每个来源各自最多处理dispatch_budget个(共DISPATCH_SOURCES个来源 0表示不限制)
+        超过预算的任务留到下一次循环 下一次循环不阻塞等待 防止突发任务一直占用线程 饿死epoll事件和定时器
+    */
+    int32_t budget = cycle->m_conf->m_conf.m_dispatchBudget;
+    int32_t remains[DISPATCH_SOURCES];
+    for (int32_t i=0; i<DISPATCH_SOURCES; ++i) {
+        remains[i] = budget > 0 ? budget : INT32_MAX;
+    }
 
     bool needContinue = false;
+    bool hasRemain = true;
     do {
-        // 下面三个步骤 可能会出现乱序添加任务 一次性执行完毕后再等待epoll
-        // todo 避免循环次数过多, 后续可以添加循环次数限制
         needContinue = false;
 
-        static auto funcResumeProcess = [&](int32_t type, std::pair<CoConnection*, uint32_t> &coroutineData) {
-            CoConnection* connection = coroutineData.first;
-            uint32_t version = coroutineData.second;
-            if (connection->m_version != version) {
-                // 连接版本号 防止客户端的连接已经被销毁
-                CO_SERVER_LOG_ERROR("(cid:%u) type:%d resume connection, oldversion:%u not equal curversion:%u", connection->m_connId, type, version, connection->m_version);
-                return ;
+        for (int32_t i=0; i<DISPATCH_SOURCES; ++i) {
+            int32_t source = (m_sourceStart + i) % DISPATCH_SOURCES;
+            int32_t quantum = remains[source] < DISPATCH_QUANTUM ? remains[source] : DISPATCH_QUANTUM;
+            if (quantum <= 0) {
+                continue;
             }
 
+            int32_t processed = 0;
+            if (DISPATCH_SOURCE_DELAY == source) {
+                processed = process_delay_connections(quantum);
+            } else if (DISPATCH_SOURCE_RESUME == source) {
+                processed = process_resume_queue(quantum);
+            } else {
+                processed = process_mailbox(quantum);
+            }
+            if (processed > 0) {
+                remains[source] -= processed;
+                needContinue = true;
+            }
+        }
+        // 下一轮从下一个来源开始
+        m_sourceStart = (m_sourceStart + 1) % DISPATCH_SOURCES;
+
+        // 每轮只读取一次时钟 时间前进了才需要检查定时器
+        CoClock::update();
+        uint64_t now = CoClock::now_ms();
+        CO_SERVER_LOG_DEBUG("process events elapsed time:%lu, next timer:%lu, need continue:%d", now - timerCheckTime, timerTime, needContinue);
+
+        // timer process
+        if (timerTime == 0 || now > timerCheckTime || timer->precise_expired()) {
             needContinue = true;
-            CoDispatcher::func_dispatcher(connection);
-        };
+            timer->process_timer();
 
-        // wait process events
-        uint64_t processDelayEventsTime = GET_CURRENTTIME_MS();
-        while (!m_delayConnections.empty()) {
-            std::pair<CoConnection*, uint32_t> waitConnection = m_delayConnections.front();
-            m_delayConnections.pop();
+            timerCheckTime = now;
+            timerTime = timer->find_timer();
+        }
 
-            funcResumeProcess(0, waitConnection);
+        hasRemain = false;
+        for (int32_t i=0; i<DISPATCH_SOURCES; ++i) {
+            hasRemain = hasRemain || remains[i] > 0;
         }
-        processDelayEventsTime = GET_CURRENTTIME_MS() - processDelayEventsTime;
 
-        // wait process resume  内部socketpair进行通信 防止阻塞在epoll长时间无法处理
-        uint64_t processResumeTime = GET_CURRENTTIME_MS();
-        while(!m_waitResumes.empty()) {
-            m_mtxResume.lock();
-            std::pair<CoConnection*, uint32_t> coroutineData = m_waitResumes.front();
-            m_waitResumes.pop();
-            m_mtxResume.unlock();
+    } while(needContinue && hasRemain);
+
+    // 统计 循环处理时间(不包括等待)和剩余任务
+    uint64_t busyUs = CoClock::now_us() - busyStartUs;
+    m_loopStats.m_iterations ++;
+    m_loopStats.m_busyUs += busyUs;
+    m_loopStats.m_maxBusyUs = busyUs > m_loopStats.m_maxBusyUs ? busyUs : m_loopStats.m_maxBusyUs;
+    if (m_load) {
+        // 滑动平均 acceptor线程选择worker使用
+        uint64_t lagUs = m_load->m_loopLagUs.load(std::memory_order_relaxed);
+        m_load->m_loopLagUs.store((lagUs * 7 + busyUs) / 8, std::memory_order_relaxed);
+    }
+    m_saturated = (remains[DISPATCH_SOURCE_DELAY] <= 0 && !m_delayConnections.empty()) || (remains[DISPATCH_SOURCE_RESUME] <= 0 && !m_resumeQueue.empty()) 
+            || (remains[DISPATCH_SOURCE_MAIL] <= 0 && m_mailbox && !m_mailbox->m_queue.empty());
+    if (m_saturated) {
+        m_loopStats.m_budgetExhausted ++;
+    }
 
-            funcResumeProcess(1, coroutineData);
+    return CO_OK;
+}
+
+int32_t CoDispatcher::process_delay_connections(int32_t maxCount)
+{
+    uint64_t depth = m_delayConnections.size();
+    m_loopStats.m_maxDelayDepth = depth > m_loopStats.m_maxDelayDepth ? depth : m_loopStats.m_maxDelayDepth;
+
+    int32_t count = 0;
+    std::pair<CoConnection*, uint32_t> waitConnection;
+    for ( ; count < maxCount && m_delayConnections.pop(waitConnection); ++count) {
+        // yield_now让出的协程 和sleep定时器相同 切入前清除阻塞标志 连接异常时也能切入返回错误
+        CoConnection* connection = waitConnection.first;
+        if (connection->m_flagYieldNow && connection->m_version == waitConnection.second) {
+            connection->m_flagYieldNow = 0;
+            connection->m_flagThirdFuncBlocking = 0;
         }
-        processResumeTime = GET_CURRENTTIME_MS() - processResumeTime;
+        resume_connection(0, waitConnection);
+    }
+    return count;
+}
 
-        uint64_t processSingleResumeTime = GET_CURRENTTIME_MS();
-        while(!m_waitSingles.empty()) {
-            m_mtxResume.lock();
-            std::pair<CoConnection*, uint32_t> coroutineData = m_waitSingles.front();
-            m_waitSingles.pop();
-            m_mtxResume.unlock();
+int32_t CoDispatcher::process_resume_queue(int32_t maxCount)
+{
+    // 其他线程恢复的协程 无锁队列取出 不需要加锁
+    uint64_t depth = m_resumePushes.load(std::memory_order_relaxed) - m_resumePops;
+    m_loopStats.m_maxResumeDepth = depth > m_loopStats.m_maxResumeDepth ? depth : m_loopStats.m_maxResumeDepth;
+
+    int32_t count = 0;
+    CoResumeNode* node = NULL;
+    for ( ; count < maxCount && (node = m_resumeQueue.pop()) != NULL; ++count) {
+        std::pair<CoConnection*, uint32_t> coroutineData = std::make_pair(node->m_connection, node->m_version);
+        int32_t resumeType = node->m_type;
+        if (node == &node->m_connection->m_resumeNode) {
+            // 取出数据后 其他线程才能再次使用连接的节点
+            node->m_queued.store(false, std::memory_order_release);
+        } else {
+            SAFE_DELETE(node);
+        }
+        m_resumePops ++;
 
+        if (RESUME_TYPE_SINGLE == resumeType) {
             CoConnection* connection = coroutineData.first;
             CoSingle* single = CoSingle::get_instance();
             if (! (single->find_block_mutex(connection)) ) {
@@ -186,24 +413,85 @@ int32_t CoDispatcher::process_events_and_timers(CoCycle* cycle)
                 continue;
             }
 
-            funcResumeProcess(2, coroutineData);
+        } else if (RESUME_TYPE_OFFLOAD == resumeType) {
+            // 任务完成 和sleep定时器相同 切入前清除阻塞标志 连接异常时也能切入返回
+            CoConnection* connection = coroutineData.first;
+            if (connection->m_flagOffload && connection->m_version == coroutineData.second) {
+                connection->m_flagOffload = 0;
+                connection->m_flagThirdFuncBlocking = 0;
+            }
         }
-        processSingleResumeTime = GET_CURRENTTIME_MS() - processSingleResumeTime;
-        
-        CO_SERVER_LOG_DEBUG("process events time:%lu delayevents time:%lu, resume time:%lu, single resume time:%lu, next timer:%lu, need continue:%d", processEventsTime, processDelayEventsTime, processResumeTime, processSingleResumeTime, timerTime, needContinue);
 
-        // timer process
-        if (timerTime == 0 || processEventsTime > 0 || processDelayEventsTime > 0 || processResumeTime > 0 || processSingleResumeTime > 0) {
-            needContinue = true;
-            timer->process_timer();
+        resume_connection(resumeType, coroutineData);
+    }
+    return count;
+}
 
-            processEventsTime = 0;
-            timerTime = timer->find_timer();
-        }
+int32_t CoDispatcher::process_mailbox(int32_t maxCount)
+{
+    if (!m_mailbox) {
+        return 0;
+    }
 
-    } while(needContinue);
+    uint64_t depth = m_mailbox->m_posts.load(std::memory_order_relaxed) - m_loopStats.m_mailRuns;
+    m_loopStats.m_maxMailDepth = depth > m_loopStats.m_maxMailDepth ? depth : m_loopStats.m_maxMailDepth;
+
+    // 任务在调度循环中执行 不属于任何连接
+    int32_t count = 0;
+    CoMailNode* node = NULL;
+    for ( ; count < maxCount && (node = m_mailbox->m_queue.pop()) != NULL; ++count) {
+        m_loopStats.m_mailRuns ++;
+        GET_TLS()->m_curConnection = NULL;
+        node->m_func();
+        SAFE_DELETE(node);
+    }
+    return count;
+}
 
-    return CO_OK;
+void CoDispatcher::resume_connection(int32_t type, std::pair<CoConnection*, uint32_t> &coroutineData)
+{
+    CoConnection* connection = coroutineData.first;
+    uint32_t version = coroutineData.second;
+    if (connection->m_version != version) {
+        // 连接版本号 防止客户端的连接已经被销毁
+        CO_SERVER_LOG_ERROR("(cid:%u) type:%d resume connection, oldversion:%u not equal curversion:%u", connection->m_connId, type, version, connection->m_version);
+        return ;
+    }
+
+    CoDispatcher::func_dispatcher(connection);
+}
+
+void CoDispatcher::busy_poll_events(CoCycle* cycle, uint64_t busyPollUs, uint64_t timerTime)
+{
+    /*
+        用CPU换延迟: 没有待处理的任务时 线程不立即睡眠, 先以超时0等待事件
+        事件在轮询期间到达时 省去线程睡眠/唤醒的调度延迟 (io_uring后端轮询只检查完成队列 不需要系统调用)
+        轮询时间不超过下一个定时器的超时时间 使用单调时钟计时 (clock_source coarse精度不够)
+    */
+    uint64_t spinUs = timerTime * 1000 < busyPollUs ? timerTime * 1000 : busyPollUs;
+    uint64_t startUs = CoClock::mono_us();
+    uint64_t nowUs = startUs;
+    m_loopStats.m_spins ++;
+
+    do {
+        // 返回处理的事件数, 出错(CO_ERROR 比如EINTR)不算命中 继续轮询
+        if (cycle->m_coEpoll->process_events(0) > 0) {
+            m_loopStats.m_spinHits ++;
+            m_loopStats.m_spinUs += CoClock::mono_us() - startUs;
+            return ;
+        }
+        // CPU上有其他可运行线程时让出 (单核或线程数多于CPU时 轮询不能阻塞其他线程)
+        sched_yield();
+        nowUs = CoClock::mono_us();
+    } while (nowUs - startUs < spinUs);
+
+    uint64_t spentUs = nowUs - startUs;
+    m_loopStats.m_spinUs += spentUs;
+    m_loopStats.m_spinIdleUs += spentUs;
+
+    // 轮询时间内没有事件 阻塞等待剩余的定时器时间
+    uint64_t spentMs = spentUs / 1000;
+    cycle->m_coEpoll->process_events(timerTime > spentMs ? timerTime - spentMs : 0);
 }
 
 void CoDispatcher::func_dispatcher(CoConnection* connection)
@@ -211,18 +499,42 @@ void CoDispatcher::func_dispatcher(CoConnection* connection)
     CoThreadLocalInfo* threadInfo = GET_TLS();
     threadInfo->m_curConnection = connection;   // 设置当前线程处理的连接
 
+    // 看门狗记录本次调度 协程切出或结束后调度结束
+    CoWatchdog* watchdog = connection->m_cycle->m_dispatcher->m_watchdog;
+    if (watchdog) {
+        watchdog->run_begin(connection);
+    }
+    co_defer(
+        if (watchdog) {
+            watchdog->run_end();
+        }
+    )
+
     // 处理超时/断开连接等异常问题
     if (CO_EXCEPTION == connection->m_handlerException(connection)) {
         CO_SERVER_LOG_WARN("(cid:%u) event handler exception", connection->m_connId);
         return ;
     }
 
+#if (CO_AWAIT)
+    // C++20协程处理的连接 不切入有栈协程 直接恢复挂起的协程
+    if (connection->m_flagAwait || (connection->m_flagBlockConn && connection->m_blockOriginConn->m_flagAwait)) {
+        CoAwait::dispatch(connection);
+        threadInfo->m_curConnection = NULL;
+        return ;
+    }
+#endif
+
     CoCoroutine* coroutine = connection->m_coroutine;
     CoCoroutineMain* coroutineMain = connection->m_cycle->m_coCoroutineMain;
 
+    CoServerControl* serverControl = connection->m_serverControl;
+    CoConnection* coroutineConnection = connection;
     if (connection->m_flagBlockConn) {
         // 阻塞连接没有协程数据  对第三方阻塞socket触发的事件 使用原始连接的协程栈数据
-        coroutine = connection->m_blockOriginConn->m_coroutine;
+        coroutineConnection = connection->m_blockOriginConn;
+        coroutine = coroutineConnection->m_coroutine;
+        serverControl = coroutineConnection->m_serverControl;
         CO_SERVER_LOG_DEBUG("(cid:%u) func dispatcher block connection, use origin connection id:%u", connection->m_connId, connection->m_blockOriginConn->m_connId);
     }
 
@@ -232,8 +544,11 @@ void CoDispatcher::func_dispatcher(CoConnection* connection)
         case COROUTINE_READY: {
             // 第一次切入协程
             CO_SERVER_LOG_DEBUG("(cid:%u) coroutine ready, first use coroutine", connection->m_connId);
+            if (CO_OK != coroutineMain->init_coroutine( [connection]{ func_proc_coroutine(connection); }, coroutine)) {
+                CO_SERVER_LOG_ERROR("(cid:%u) coroutine init failed", connection->m_connId);
+                break;
+            }
             coroutine->m_coroutineStatus = CoroutineStatus::COROUTINE_SUSPEND;
-            coroutineMain->init_coroutine( [connection]{ func_proc_coroutine(connection); }, coroutine);
             coroutineMain->swap_in(coroutine);
             break;
         }
@@ -256,6 +571,16 @@ void CoDispatcher::func_dispatcher(CoConnection* connection)
         }
     }
 
+    // 统计处理函数的协程栈深度 (协程运行期间连接可能被重置 使用切入前的server)
+    if (serverControl && coroutine->m_runPeakDepth > serverControl->m_peakStackDepth) {
+        serverControl->m_peakStackDepth = coroutine->m_runPeakDepth;
+    }
+
+    // 子协程执行完毕 协程已经切出(状态为ready) 不再使用连接的m_handler和协程栈, 此时才能归还连接
+    if (coroutineConnection->m_flagTaskFinished && coroutine->m_coroutineStatus == CoroutineStatus::COROUTINE_READY) {
+        coroutineConnection->m_cycle->m_connectionPool->free_task_connection(coroutineConnection);
+    }
+
     threadInfo->m_curConnection = NULL;
 }
 
@@ -373,6 +698,11 @@ int32_t CoDispatcher::yield_thirdsocket(int32_t socketFd, uint32_t eventOP, int3
 }
 
 int32_t CoDispatcher::yield_timer(CoConnection* connection, uint32_t sleepMs) 
+{
+    return yield_timer_us(connection, sleepMs * 1000ULL);
+}
+
+int32_t CoDispatcher::yield_timer_us(CoConnection* connection, uint64_t sleepUs) 
 {
     CoCycle* cycle = connection->m_cycle;
     CoEvent* event = connection->m_sleepEvent;
@@ -387,7 +717,7 @@ int32_t CoDispatcher::yield_timer(CoConnection* connection, uint32_t sleepMs)
     connection->m_flagThirdFuncBlocking = 1;
     
     // 添加事件定时器
-    cycle->m_timer->add_timer(event, sleepMs);
+    cycle->m_timer->add_timer_us(event, sleepUs);
 
     // 切出协程
     CO_SERVER_LOG_DEBUG("(cid:%u) dispactch timer yield, swap out", connection->m_connId);
@@ -410,6 +740,154 @@ int32_t CoDispatcher::yield_timer(CoConnection* connection, uint32_t sleepMs)
     return CO_OK;
 }
 
+int32_t CoDispatcher::yield_now(CoConnection* connection)
+{
+    if (!connection) {
+        connection = GET_TLS()->m_curConnection;
+        if (connection && connection->m_flagBlockConn) {
+            connection = connection->m_blockOriginConn;
+        }
+    }
+    if (!connection) {
+        CO_SERVER_LOG_ERROR("dispactch yield now, not in coroutine");
+        return CO_ERROR;
+    }
+    if (connection->m_flagAwait) {
+        CO_SERVER_LOG_ERROR("(cid:%u) dispactch yield now, await connection use CoAwait::yield_now", connection->m_connId);
+        return CO_ERROR;
+    }
+
+    CoCycle* cycle = connection->m_cycle;
+    CoDispatcher* dispatcher = cycle->m_dispatcher;
+    dispatcher->m_loopStats.m_yieldNows ++;
+
+    // 和yield_timer相同 让出期间连接异常时不切入, 等待运行队列切入后返回错误
+    connection->m_flagThirdFuncBlocking = 1;
+    connection->m_flagYieldNow = 1;
+    dispatcher->m_yieldConnections.emplace_back(connection, connection->m_version);
+
+    CO_SERVER_LOG_DEBUG("(cid:%u) dispactch yield now, swap out", connection->m_connId);
+    cycle->m_coCoroutineMain->swap_out(connection->m_coroutine);
+    CO_SERVER_LOG_DEBUG("(cid:%u) dispactch yield now, swap in", connection->m_connId);
+
+    connection->m_flagThirdFuncBlocking = 0;
+    connection->m_flagYieldNow = 0;
+
+    if (connection->m_flagDying) {
+        CO_SERVER_LOG_WARN("(cid:%u) dispactch yield now, after swap out connection dying", connection->m_connId);
+        return CO_ERROR;
+    }
+    return CO_OK;
+}
+
+int32_t CoDispatcher::offload(std::function<void ()> func, int32_t timeoutMs, const std::string &poolName)
+{
+    CoConnection* connection = GET_TLS()->m_curConnection;
+    if (connection && connection->m_flagBlockConn) {
+        connection = connection->m_blockOriginConn;
+    }
+    if (!connection) {
+        CO_SERVER_LOG_ERROR("dispactch offload, not in coroutine");
+        return CO_ERROR;
+    }
+    if (connection->m_flagAwait) {
+        CO_SERVER_LOG_ERROR("(cid:%u) dispactch offload, await connection use CoAwait::offload", connection->m_connId);
+        return CO_ERROR;
+    }
+
+    CoOffloadJob* job = submit_offload(connection, std::move(func), timeoutMs, poolName);
+    if (!job) {
+        return CO_ERROR;
+    }
+
+    // 其他唤醒(比如子请求完成)切入时 任务还没有完成 继续等待
+    while (connection->m_flagOffload) {
+        CO_SERVER_LOG_DEBUG("(cid:%u) dispactch offload, swap out", connection->m_connId);
+        connection->m_cycle->m_coCoroutineMain->swap_out(connection->m_coroutine);
+        CO_SERVER_LOG_DEBUG("(cid:%u) dispactch offload, swap in, done:%d", connection->m_connId, !connection->m_flagOffload);
+    }
+
+    return finish_offload(connection, job);
+}
+
+CoOffloadJob* CoDispatcher::submit_offload(CoConnection* connection, std::function<void ()> func, int32_t timeoutMs, const std::string &poolName)
+{
+    if (connection->m_flagDying) {
+        CO_SERVER_LOG_WARN("(cid:%u) dispactch offload, connection dying", connection->m_connId);
+        return NULL;
+    }
+
+    CoOffloadPool* pool = CoOffloadPool::get_pool(poolName);
+    if (!pool) {
+        CO_SERVER_LOG_ERROR("(cid:%u) dispactch offload, pool:%s not found", connection->m_connId, poolName.c_str());
+        return NULL;
+    }
+
+    CoDispatcher* dispatcher = connection->m_cycle->m_dispatcher;
+    CoOffloadJob* job = new CoOffloadJob;
+    job->m_func = std::move(func);
+    job->m_connection = connection;
+    job->m_version = connection->m_version;
+    job->m_deadlineUs = offload_deadline(connection, timeoutMs);
+
+    dispatcher->m_loopStats.m_offloads ++;
+    if (CO_OK != pool->submit(job)) {
+        dispatcher->m_loopStats.m_offloadRejects ++;
+        CO_SERVER_LOG_WARN("(cid:%u) dispactch offload, pool:%s queue full, limit:%d", connection->m_connId, poolName.c_str(), pool->get_queue_limit());
+        SAFE_DELETE(job);
+        return NULL;
+    }
+    dispatcher->m_offloadPending ++;
+
+    // 和yield_timer相同 任务完成前连接异常时不切入 (func可能还在使用请求的数据), 恢复队列切入时清除
+    connection->m_flagThirdFuncBlocking = 1;
+    connection->m_flagOffload = 1;
+    return job;
+}
+
+int32_t CoDispatcher::finish_offload(CoConnection* connection, CoOffloadJob* job)
+{
+    CoDispatcher* dispatcher = connection->m_cycle->m_dispatcher;
+    connection->m_flagThirdFuncBlocking = 0;
+
+    dispatcher->m_offloadPending --;
+    dispatcher->m_loopStats.m_offloadWaitUs += CoClock::mono_us() - job->m_submitUs;
+    dispatcher->m_loopStats.m_offloadRunUs += job->m_runUs;
+
+    int32_t ret = CO_OK;
+    if (OFFLOAD_STATE_EXPIRED == job->m_state) {
+        dispatcher->m_loopStats.m_offloadExpired ++;
+        CO_SERVER_LOG_WARN("(cid:%u) dispactch offload, job expired before run, waited:%luus", connection->m_connId, CoClock::mono_us() - job->m_submitUs);
+        ret = CO_TIMEOUT;
+    }
+    SAFE_DELETE(job);
+
+    if (connection->m_flagDying) {
+        CO_SERVER_LOG_WARN("(cid:%u) dispactch offload, after swap out connection dying", connection->m_connId);
+        return CO_ERROR;
+    }
+    return ret;
+}
+
+uint64_t CoDispatcher::offload_deadline(CoConnection* connection, int32_t timeoutMs)
+{
+    // 请求的截止时间: 请求处理中读事件定时器为请求的最长处理时间(keepalive时间)
+    uint64_t nowUs = CoClock::mono_us();
+    uint64_t deadlineUs = 0;
+    int64_t remainUs = connection->m_cycle->m_timer->get_remain_us(connection->m_readEvent);
+    if (remainUs >= 0) {
+        deadlineUs = nowUs + remainUs;
+    }
+
+    if (timeoutMs >= 0) {
+        uint64_t timeoutUs = nowUs + timeoutMs * 1000ULL;
+        if (deadlineUs == 0 || timeoutUs < deadlineUs) {
+            deadlineUs = timeoutUs;
+        }
+    }
+    return deadlineUs;
+}
+
 int32_t CoDispatcher::yield(std::pair<void*, uint32_t> &coroutineData)
 {
     CoConnection* connection = (CoConnection*)coroutineData.first;
@@ -429,51 +907,53 @@ int32_t CoDispatcher::yield(std::pair<void*, uint32_t> &coroutineData)
 
 int32_t CoDispatcher::resume_async(std::pair<void*, uint32_t> &transforData)
 {
-    std::pair<CoConnection*, uint32_t> coroutineData = std::make_pair((CoConnection*)(transforData.first), transforData.second);
-
-    // 确定连接后 即可确定对应处理线程
-    CoConnection* connection = coroutineData.first;
-    CoDispatcher* dispatcher = connection->m_cycle->m_dispatcher;
-    bool writeSocket = false;
-    
-    dispatcher->m_mtxResume.lock();
-    if (dispatcher->m_waitResumes.empty()) {
-        // write优化 如果queue不为空 表示待处理或者正在处理 不需要在发送socket数据
-        writeSocket = true;
-    }
-    dispatcher->m_waitResumes.push(coroutineData);
-    dispatcher->m_mtxResume.unlock();
+    return push_resume((CoConnection*)(transforData.first), transforData.second, RESUME_TYPE_ASYNC);
+}
 
-    if (writeSocket) {
-        dispatcher->m_writeResumeConnection->m_coTcp->tcp_write(g_oneByteA.c_str(), 1);
-    }
-    CO_SERVER_LOG_DEBUG("(cid:%u) prepare resume, push codata and tcpwrite flag(%d) a byte", connection->m_connId, writeSocket);
+int32_t CoDispatcher::resume_single_async(std::pair<CoConnection*, uint32_t> &coroutineData)
+{
+    return push_resume(coroutineData.first, coroutineData.second, RESUME_TYPE_SINGLE);
+}
 
-    return CO_OK;
+int32_t CoDispatcher::resume_offload(std::pair<CoConnection*, uint32_t> &coroutineData)
+{
+    return push_resume(coroutineData.first, coroutineData.second, RESUME_TYPE_OFFLOAD);
 }
 
-int32_t CoDispatcher::resume_single_async(std::pair<CoConnection*, uint32_t> &coroutineData)
+int32_t CoDispatcher::push_resume(CoConnection* connection, uint32_t version, int32_t resumeType)
 {
     // 确定连接后 即可确定对应处理线程
-    CoConnection* connection = coroutineData.first;
     CoDispatcher* dispatcher = connection->m_cycle->m_dispatcher;
-    bool writeSocket = false;
-    
-    dispatcher->m_mtxResume.lock();
-    if (dispatcher->m_waitSingles.empty()) {
-        // write优化 如果queue不为空 表示待处理或者正在处理 不需要在发送socket数据
-        writeSocket = true;
-    }
-    dispatcher->m_waitSingles.push(coroutineData);
-    dispatcher->m_mtxResume.unlock();
 
-    if (writeSocket) {
-        dispatcher->m_writeResumeConnection->m_coTcp->tcp_write(g_oneByteA.c_str(), 1);
+    // 使用连接内嵌的节点 节点还在队列中(上一次恢复没有处理/连接重置后的旧版本)时分配新节点
+    CoResumeNode* node = &connection->m_resumeNode;
+    if (node->m_queued.exchange(true, std::memory_order_acquire)) {
+        node = new CoResumeNode;
+        dispatcher->m_resumeAllocs.fetch_add(1, std::memory_order_relaxed);
+    }
+    node->m_connection = connection;
+    node->m_version = version;
+    node->m_type = resumeType;
+    dispatcher->m_resumeQueue.push(node);
+    dispatcher->m_resumePushes.fetch_add(1, std::memory_order_relaxed);
+
+    bool notify = dispatcher->wake_up();
+    if (notify) {
+        dispatcher->m_resumeNotifies.fetch_add(1, std::memory_order_relaxed);
     }
-    CO_SERVER_LOG_DEBUG("(cid:%u) prepare single resume, push codata and tcpwrite flag(%d) a byte", connection->m_connId, writeSocket);
+    CO_SERVER_LOG_DEBUG("(cid:%u) prepare resume, type:%d push codata and notify flag(%d)", connection->m_connId, resumeType, notify);
 
     return CO_OK;
 }
 
+bool CoDispatcher::wake_up()
+{
+    // 唤醒优化 worker线程没有阻塞等待时 等待前会检查队列 不需要写eventfd
+    if (m_resumeAwake.exchange(true)) {
+        return false;
+    }
+    m_cycle->m_coEpoll->notify();
+    return true;
 }
 
+}
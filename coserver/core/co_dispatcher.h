@@ -3,7 +3,13 @@
 
 #include <vector>
 #include <queue>
-#include "base/co_spinlock.h"
+#include <atomic>
+#include <memory>
+#include <functional>
+#include "base/co_mpsc_queue.h"
+#include "base/co_run_queue.h"
+#include "core/co_offload.h"
+#include "core/co_mailbox.h"
 
 
 namespace coserver
@@ -12,6 +18,58 @@ namespace coserver
 struct CoCycle;
 struct CoConnection;
 class CoServerControl;
+class CoWatchdog;
+class CoPeriodicScheduler;
+struct CoWorkerLoad;
+
+
+// 其他线程恢复协程的类型
+const int32_t RESUME_TYPE_ASYNC = 1;
+const int32_t RESUME_TYPE_SINGLE = 2;
+const int32_t RESUME_TYPE_OFFLOAD = 3;     // 辅助线程任务完成 (offload)
+
+// 其他线程恢复协程的数据 (无锁队列节点)
+// 节点内嵌在连接中(CoConnection::m_resumeNode) 连接同时只有一个恢复等待处理, 节点还在队列中时才临时分配
+struct CoResumeNode
+{
+    std::atomic<CoResumeNode*>  m_mpscNext;
+    std::atomic<bool>           m_queued{false};    // 内嵌节点在队列中 worker线程取出后清除
+    CoConnection*               m_connection = NULL;
+    uint32_t                    m_version = 0;
+    int32_t                     m_type = RESUME_TYPE_ASYNC;
+};
+
+// 调度循环中轮流处理的任务来源
+const int32_t DISPATCH_SOURCE_DELAY = 0;    // m_delayConnections
+const int32_t DISPATCH_SOURCE_RESUME = 1;   // m_resumeQueue
+const int32_t DISPATCH_SOURCE_MAIL = 2;     // m_mailbox 其他线程投递的任务
+const int32_t DISPATCH_SOURCES = 3;
+const int32_t DISPATCH_QUANTUM = 16;        // 每轮每个来源最多处理的任务数
+
+// 事件循环统计 (conf busy_poll_us/dispatch_budget)
+struct CoEventLoopStats
+{
+    uint64_t m_spins       = 0;    // 阻塞等待前开始忙轮询的次数
+    uint64_t m_spinHits    = 0;    // 忙轮询期间等到事件的次数
+    uint64_t m_spinUs      = 0;    // 忙轮询的总时间 (us)
+    uint64_t m_spinIdleUs  = 0;    // 忙轮询没有等到事件的时间 (us)
+
+    uint64_t m_iterations      = 0;    // 调度循环次数
+    uint64_t m_busyUs          = 0;    // 调度循环处理任务的总时间 不包括等待事件 (us)
+    uint64_t m_maxBusyUs       = 0;    // 统计周期内 一次循环的最长处理时间 (us)
+    uint64_t m_budgetExhausted = 0;    // 预算用完 任务留到下一次循环的次数
+    uint64_t m_maxDelayDepth   = 0;    // 统计周期内 延迟处理队列的最大长度
+    uint64_t m_maxResumeDepth  = 0;    // 统计周期内 恢复队列的最大长度
+    uint64_t m_maxMailDepth    = 0;    // 统计周期内 邮箱的最大长度
+    uint64_t m_mailRuns        = 0;    // 执行邮箱任务的次数
+    uint64_t m_yieldNows       = 0;    // yield_now主动让出的次数
+
+    uint64_t m_offloads        = 0;    // offload放入辅助线程池的任务数
+    uint64_t m_offloadRejects  = 0;    // 线程池队列已满 拒绝的任务数
+    uint64_t m_offloadExpired  = 0;    // 开始执行前超过截止时间 没有执行的任务数
+    uint64_t m_offloadWaitUs   = 0;    // 协程从放入任务到切入的总时间 (us)
+    uint64_t m_offloadRunUs    = 0;    // 辅助线程执行任务的总时间 (us)
+};
 
 
 // 总体调度
@@ -27,6 +85,12 @@ public:
     int32_t stop();
 
     static void func_dispatcher(CoConnection* connection);
+
+    const CoEventLoopStats &get_loop_stats() { return m_loopStats; }
+    // 上一次调度循环预算用完 还有任务留到下一次循环
+    bool is_saturated() { return m_saturated; }
+    // 其他线程放入恢复队列/邮箱后调用 worker线程阻塞等待时eventfd唤醒, 返回是否需要唤醒
+    bool wake_up();
     static void func_proc_coroutine(CoConnection* connection);
 
 public:
@@ -64,6 +128,47 @@ public:
         返回值: CO_OK成功 其他错误
     */
     static int32_t yield_timer(CoConnection* connection, uint32_t sleepMs);
+    // us精度 timer_resolution us时短定时器由timerfd唤醒, 否则向上取整到ms
+    static int32_t yield_timer_us(CoConnection* connection, uint64_t sleepUs);
+
+    /*
+        函数功能: 主动让出 当前协程在下一次处理epoll事件后 按连接的优先级放到运行队列末尾, 先处理新事件/定时器和已经在队列中的任务
+                  长时间计算的处理函数定期调用(或者使用CoYielder) 不会一直占用worker线程
+
+        参数: 
+            connection: 当前协程的连接 NULL时使用当前线程正在处理的连接
+        
+        返回值: CO_OK成功 连接即将销毁(让出期间超时/对端关闭)或者不在协程中时CO_ERROR
+    */
+    static int32_t yield_now(CoConnection* connection = NULL);
+
+    /*
+        函数功能: 把hook无法异步化的调用(压缩/加解密/阻塞的文件和数据库客户端等)放到辅助线程池执行, 当前协程切出等待
+                  func执行完成后 通过恢复队列在原来的worker线程切入协程 (参考core/co_offload.h)
+
+        参数: 
+            func: 辅助线程中执行的函数
+                  共享栈模式下协程切出后栈上的数据不可访问, func按值捕获 结果写入堆内存(比如std::shared_ptr 或者使用offload_value)
+            timeoutMs: 截止时间 和请求的超时时间取较早的一个, -1表示只使用请求的超时时间;
+                  排队超过截止时间的任务不执行, 执行中可以调用CoOffloadPool::expired检查
+            poolName: 线程池名称 默认为conf offload_threads/offload_queue配置的线程池 (CoServer::add_offload_pool添加其他线程池)
+        
+        返回值: CO_OK执行完成, CO_TIMEOUT超过截止时间没有执行, 队列已满/线程池不存在/连接即将销毁时CO_ERROR
+                func开始执行后 即使连接超时也会等待func执行完成再返回
+    */
+    static int32_t offload(std::function<void ()> func, int32_t timeoutMs = -1, const std::string &poolName = OFFLOAD_POOL_DEFAULT);
+
+    // offload 返回值通过value返回 (CO_OK时有效)
+    template <typename T>
+    static int32_t offload_value(std::function<T ()> func, T &value, int32_t timeoutMs = -1, const std::string &poolName = OFFLOAD_POOL_DEFAULT)
+    {
+        std::shared_ptr<T> result = std::make_shared<T>();
+        int32_t ret = offload([func, result]() { *result = func(); }, timeoutMs, poolName);
+        if (CO_OK == ret) {
+            value = std::move(*result);
+        }
+        return ret;
+    }
 
     // 切出当前事件的协程（客户端可以配合独立线程使用）
     static int32_t yield(std::pair<void*, uint32_t> &coroutineData);
@@ -74,29 +179,78 @@ public:
     // 异步切入当前事件的协程 全局single使用
     static int32_t resume_single_async(std::pair<CoConnection*, uint32_t> &coroutineData);
 
+    // 辅助线程任务完成 切入等待的协程 (CoOffloadPool使用)
+    static int32_t resume_offload(std::pair<CoConnection*, uint32_t> &coroutineData);
+
+    // offload的两个阶段 (CoAwaitOffload使用): 放入线程池并设置等待标志, 失败时返回NULL; 切入后统计并释放任务 返回offload的返回值
+    static CoOffloadJob* submit_offload(CoConnection* connection, std::function<void ()> func, int32_t timeoutMs, const std::string &poolName);
+    static int32_t finish_offload(CoConnection* connection, CoOffloadJob* job);
+
 private:
-    // yield后需要resume的连接 通信socket
-    int32_t init_yieldresume_comm(CoCycle* cycle);
+    // 其他线程调用 放入恢复队列 worker线程阻塞等待时eventfd唤醒
+    static int32_t push_resume(CoConnection* connection, uint32_t version, int32_t resumeType);
+    // offload任务的截止时间(单调时钟us): 请求超时定时器和timeoutMs中较早的一个 0表示没有
+    static uint64_t offload_deadline(CoConnection* connection, int32_t timeoutMs);
     int32_t process_events_and_timers(CoCycle* cycle);
+    // 处理延迟/恢复队列中最多maxCount个任务 返回取出的任务数
+    int32_t process_delay_connections(int32_t maxCount);
+    int32_t process_resume_queue(int32_t maxCount);
+    int32_t process_mailbox(int32_t maxCount);
+    void resume_connection(int32_t type, std::pair<CoConnection*, uint32_t> &coroutineData);
+    // 阻塞等待事件前 先非阻塞轮询busyPollUs时间
+    void busy_poll_events(CoCycle* cycle, uint64_t busyPollUs, uint64_t timerTime);
+
+    // 定期输出统计信息 (conf stats_interval)
+    void log_stats(CoCycle* cycle);
 
 
 private:
     bool    m_run = false;
+    CoCycle* m_cycle = NULL;
+    uint64_t m_lastStatsTime = 0;
+    uint64_t m_lastCopyBytes = 0;
+
+    CoEventLoopStats m_loopStats;
+    uint64_t m_lastSpinUs = 0;
+    uint64_t m_lastSpinIdleUs = 0;
+    uint64_t m_lastIterations = 0;
+    uint64_t m_lastBusyUs = 0;
+
+    int32_t  m_sourceStart = 0;     // 下一轮第一个处理的任务来源
+    bool     m_saturated = false;
+    uint64_t m_resumePops = 0;      // 恢复队列取出的次数 (worker线程)
+    int32_t  m_offloadPending = 0;  // 辅助线程池中还没有完成的任务数 退出前需要等待全部完成
 
 
 public:
     std::vector<CoServerControl*> m_serverControls;
 
+    // 看门狗 conf watchdog_budget大于0时创建
+    CoWatchdog* m_watchdog = NULL;
+
+    // 本线程的周期任务 (CoServer::add_periodic_task/add_oneshot_task)
+    CoPeriodicScheduler* m_periodic = NULL;
+
+    // 本线程还没有结束的spawn子协程数 (conf max_tasks)
+    int32_t m_curTasks = 0;
+
     // 在一个事件的协程中触发其他时间  因为其他事件也需要协程支持  所以其他事件暂存 等待处理
-    std::queue<std::pair<CoConnection*, uint32_t>>  m_delayConnections;
-
-    // resume
-    CoSpinlock                m_mtxResume;
-    CoConnection*             m_writeResumeConnection = NULL;
-    // 用于内部恢复协议的通信socket
-    std::queue<std::pair<CoConnection*, uint32_t>>  m_waitResumes;     // 等待resume的连接协程数据
-    // 用于全局single的处理
-    std::queue<std::pair<CoConnection*, uint32_t>>  m_waitSingles;     // 等待resume的single连接
+    // 按连接的优先级(m_priority)排队 高优先级先处理 低优先级等待超过priority_aging后提前处理
+    CoRunQueue<std::pair<CoConnection*, uint32_t>>  m_delayConnections;
+    // yield_now让出的协程 处理完下一次epoll事件后再放入运行队列 (同一次循环中不会被马上切入)
+    std::vector<std::pair<CoConnection*, uint32_t>> m_yieldConnections;
+
+    // resume 其他线程恢复的协程(resume_async/全局single)
+    CoMpscQueue<CoResumeNode>   m_resumeQueue;
+    std::atomic<bool>           m_resumeAwake{true};    // worker线程没有阻塞等待事件 不需要eventfd唤醒
+    std::atomic<uint64_t>       m_resumePushes{0};      // 放入恢复队列的次数
+    std::atomic<uint64_t>       m_resumeNotifies{0};    // eventfd唤醒的次数
+    std::atomic<uint64_t>       m_resumeAllocs{0};      // 连接内嵌节点还在队列中 分配节点的次数
+
+    // worker线程的邮箱 (CoMailbox) CoServer启动worker线程时绑定
+    CoWorkerMailbox*            m_mailbox = NULL;
+    // acceptor模式 worker线程的负载 (CoAcceptor) acceptor线程按负载选择worker
+    CoWorkerLoad*               m_load = NULL;
 };
 
 }
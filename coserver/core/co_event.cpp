@@ -1,5 +1,6 @@
 #include "core/co_event.h"
 #include "core/co_connection.h"
+#include "core/co_cycle.h"
 
 
 namespace coserver
@@ -7,6 +8,8 @@ namespace coserver
 
 CoEvent::CoEvent(int32_t type, CoConnection* connection): m_eventType(type), m_connection(connection), m_flagActive(0), m_flagTimerSet(0) 
 {
+    m_timerNode.m_event = this;
+
     if (EVENT_TYPE_SLEEP == m_eventType) {
         m_timerPreHandler = [=](CoEvent* event) {
             // sleep事件超时不置标志位 正常继续执行后续流程即可
@@ -16,10 +19,14 @@ CoEvent::CoEvent(int32_t type, CoConnection* connection): m_eventType(type), m_c
     }
 }
 
-void CoEvent::reset() 
+void CoEvent::reset(bool keepTimer) 
 {
+    // 还在时间轮中的定时器 需要从链表中删除
+    if (m_flagTimerSet && !keepTimer) {
+        m_connection->m_cycle->m_timer->del_timer(this);
+    }
+
     m_flagActive = 0;
-    m_flagTimerSet = 0;
 }
 
 }
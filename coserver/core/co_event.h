@@ -19,7 +19,7 @@ struct CoEvent
     int32_t         m_eventType   = EVENT_TYPE_READ; // 事件类型
 
     CoConnection*   m_connection  = NULL;   // 事件所属的CoConnection
-    TimerNode       m_timerNode;            // 定时器节点
+    CoTimerNode     m_timerNode;            // 定时器时间轮节点
 
     std::function<void (CoEvent* event)> m_timerPreHandler = NULL;    // 超时时预处理函数
 
@@ -31,7 +31,8 @@ struct CoEvent
     CoEvent(int32_t type, CoConnection* connection);
     CoEvent() = delete;
 
-    void reset();
+    // keepTimer: 保留时间轮中的定时器(keepalive连接之后重置)
+    void reset(bool keepTimer = false);
 };
 
 }
@@ -0,0 +1,107 @@
+#include <atomic>
+#include "core/co_local.h"
+#include "core/co_cycle.h"
+#include "core/co_request.h"
+#include "base/co_log.h"
+
+
+namespace coserver
+{
+
+static std::atomic<uint32_t> g_localIndex(0);
+
+
+CoLocalStorage::CoLocalStorage()
+{
+}
+
+CoLocalStorage::~CoLocalStorage()
+{
+    clear();
+
+    for (auto &slot : m_slots) {
+        if (slot.m_data) {
+            ::operator delete(slot.m_data);
+        }
+    }
+    m_slots.clear();
+}
+
+void* CoLocalStorage::get(uint32_t index, uint32_t size, CoLocalConstruct construct, CoLocalDestruct destruct)
+{
+    if (index >= m_slots.size()) {
+        m_slots.resize(index + 1);
+    }
+
+    CoLocalSlot* slot = &m_slots[index];
+    if (slot->m_destruct) {
+        return slot->m_data;
+    }
+
+    // 第一次使用 申请槽位内存 之后的请求复用
+    if (!slot->m_data) {
+        slot->m_data = ::operator new(size);
+        slot->m_size = size;
+    }
+
+    // 构造函数中可能使用下标更大的CoLocal(m_slots扩容) 构造后重新取槽位, 槽位内存单独申请 地址不变
+    void* data = slot->m_data;
+    construct(data);
+
+    slot = &m_slots[index];
+    slot->m_destruct = destruct;
+    m_constructed.emplace_back(index);
+    return data;
+}
+
+void CoLocalStorage::clear()
+{
+    // 逆序析构 后构造的对象可能依赖先构造的对象
+    while (!m_constructed.empty()) {
+        CoLocalSlot &slot = m_slots[m_constructed.back()];
+        m_constructed.pop_back();
+
+        CoLocalDestruct destruct = slot.m_destruct;
+        slot.m_destruct = NULL;
+        destruct(slot.m_data);
+    }
+}
+
+uint32_t CoLocalStorage::alloc_index()
+{
+    return g_localIndex++;
+}
+
+
+static CoLocalStorage* get_connection_storage(CoConnection* connection)
+{
+    if (!connection) {
+        return NULL;
+    }
+
+    // 阻塞连接和原始连接共用协程
+    if (connection->m_flagBlockConn && connection->m_blockOriginConn) {
+        connection = connection->m_blockOriginConn;
+    }
+
+    if (!connection->m_localStorage) {
+        connection->m_localStorage = new CoLocalStorage;
+    }
+    return connection->m_localStorage;
+}
+
+CoLocalStorage* co_local_storage()
+{
+    return get_connection_storage(GET_TLS()->m_curConnection);
+}
+
+CoLocalStorage* co_local_storage(CoUserHandlerData* userData)
+{
+    if (!userData) {
+        return NULL;
+    }
+
+    return get_connection_storage((CoConnection*)(userData->m_coroutineData.first));
+}
+
+}
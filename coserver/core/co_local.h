@@ -0,0 +1,123 @@
+#ifndef _CO_LOCAL_H_
+#define _CO_LOCAL_H_
+
+#include <new>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace coserver
+{
+
+/*
+    协程本地存储 (coroutine local storage)
+    协程交错执行时 thread_local变量会被同线程的其他请求覆盖, 请求级别的临时数据(解析器/缓存等)使用CoLocal保存
+
+    每个CoLocal对象在构造时分配一个全局槽位下标, 数据存放在协程所属连接的CoLocalStorage中, 按下标O(1)访问
+    槽位第一次get时构造对象, 请求结束(连接reset)时析构对象 但保留内存
+    连接复用(keepalive或连接池复用)时 直接在原内存上重新构造 不会每个请求申请堆内存
+
+    使用示例:
+        static CoLocal<std::string> g_requestBody;
+        int32_t BusinessProcess(CoUserHandlerData* userData) {
+            std::string* body = g_requestBody.get(userData);
+            ...
+        }
+
+    注意: CoLocal对象需要在run_server之前定义(全局/静态变量), 对象内存按 alignof(std::max_align_t) 对齐
+*/
+
+struct CoConnection;
+struct CoUserHandlerData;
+
+typedef void (*CoLocalConstruct)(void* data);
+typedef void (*CoLocalDestruct)(void* data);
+
+
+class CoLocalStorage
+{
+public:
+    CoLocalStorage();
+    ~CoLocalStorage();
+
+    // 获取槽位数据 未构造时在槽位内存上构造
+    void* get(uint32_t index, uint32_t size, CoLocalConstruct construct, CoLocalDestruct destruct);
+
+    // 析构所有已构造的对象(构造的逆序) 内存保留复用
+    void clear();
+
+    // 分配全局槽位下标
+    static uint32_t alloc_index();
+
+
+private:
+    struct CoLocalSlot
+    {
+        void*           m_data = NULL;      // 槽位内存 连接销毁时释放
+        uint32_t        m_size = 0;
+        CoLocalDestruct m_destruct = NULL;  // 非NULL表示对象已构造
+    };
+
+    std::vector<CoLocalSlot>    m_slots;        // 按槽位下标索引
+    std::vector<uint32_t>       m_constructed;  // 已构造的槽位下标 按构造顺序
+};
+
+
+// 当前线程正在执行的协程所属连接的存储 (阻塞连接使用原始连接), 没有则创建
+CoLocalStorage* co_local_storage();
+// 请求所属连接的存储
+CoLocalStorage* co_local_storage(CoUserHandlerData* userData);
+
+
+template <typename T>
+class CoLocal
+{
+public:
+    CoLocal() : m_index(CoLocalStorage::alloc_index()) {}
+    CoLocal(const CoLocal&) = delete;
+    CoLocal& operator=(const CoLocal&) = delete;
+
+    // 当前协程的对象 不在协程中调用返回NULL
+    T* get()
+    {
+        return get(co_local_storage());
+    }
+
+    // 请求对应的对象
+    T* get(CoUserHandlerData* userData)
+    {
+        return get(co_local_storage(userData));
+    }
+
+    uint32_t index() const
+    {
+        return m_index;
+    }
+
+
+private:
+    T* get(CoLocalStorage* storage)
+    {
+        if (!storage) {
+            return NULL;
+        }
+        return (T*)storage->get(m_index, sizeof(T), &CoLocal::construct, &CoLocal::destruct);
+    }
+
+    static void construct(void* data)
+    {
+        new (data) T();
+    }
+
+    static void destruct(void* data)
+    {
+        ((T*)data)->~T();
+    }
+
+    const uint32_t m_index;
+};
+
+}
+
+#endif //_CO_LOCAL_H_
@@ -0,0 +1,111 @@
+#include <vector>
+#include "core/co_mailbox.h"
+#include "base/co_log.h"
+#include "core/co_cycle.h"
+
+
+namespace coserver
+{
+
+// worker线程的邮箱 按worker序号
+static std::vector<CoWorkerMailbox*> g_workerMailboxes;
+
+
+int32_t CoMailbox::worker_count()
+{
+    return g_workerMailboxes.size();
+}
+
+int32_t CoMailbox::cur_worker()
+{
+    CoCycle* cycle = GET_TLS()->m_coCycle;
+    if (!cycle || !cycle->m_dispatcher || !cycle->m_dispatcher->m_mailbox) {
+        return -1;
+    }
+    return cycle->m_dispatcher->m_mailbox->m_index;
+}
+
+int32_t CoMailbox::owner(uint64_t key)
+{
+    if (g_workerMailboxes.empty()) {
+        return -1;
+    }
+    return key % g_workerMailboxes.size();
+}
+
+int32_t CoMailbox::owner(const std::string &key)
+{
+    return owner((uint64_t)std::hash<std::string>()(key));
+}
+
+int32_t CoMailbox::post(int32_t worker, std::function<void ()> func)
+{
+    if (worker < 0 || worker >= (int32_t)g_workerMailboxes.size()) {
+        CO_SERVER_LOG_ERROR("mailbox post, worker:%d out of range, workers:%lu", worker, g_workerMailboxes.size());
+        return CO_ERROR;
+    }
+
+    CoWorkerMailbox* mailbox = g_workerMailboxes[worker];
+    CoMailNode* node = new CoMailNode;
+    node->m_func = std::move(func);
+    mailbox->m_queue.push(node);
+    mailbox->m_posts.fetch_add(1, std::memory_order_relaxed);
+
+    // worker线程还没有启动时不需要唤醒 启动后第一次循环处理
+    CoDispatcher* dispatcher = mailbox->m_dispatcher.load();
+    if (dispatcher && dispatcher->wake_up()) {
+        mailbox->m_notifies.fetch_add(1, std::memory_order_relaxed);
+    }
+    return CO_OK;
+}
+
+int32_t CoMailbox::broadcast(std::function<void ()> func)
+{
+    int32_t count = 0;
+    for (int32_t i=0; i<(int32_t)g_workerMailboxes.size(); ++i) {
+        if (CO_OK == post(i, func)) {
+            count ++;
+        }
+    }
+    return count;
+}
+
+void CoMailbox::init_workers(int32_t workerCount)
+{
+    clear_workers();
+
+    g_workerMailboxes.reserve(workerCount);
+    for (int32_t i=0; i<workerCount; ++i) {
+        CoWorkerMailbox* mailbox = new CoWorkerMailbox;
+        mailbox->m_index = i;
+        g_workerMailboxes.push_back(mailbox);
+    }
+}
+
+int32_t CoMailbox::bind_worker(int32_t worker, CoDispatcher* dispatcher)
+{
+    if (worker < 0 || worker >= (int32_t)g_workerMailboxes.size()) {
+        CO_SERVER_LOG_ERROR("mailbox bind, worker:%d out of range, workers:%lu", worker, g_workerMailboxes.size());
+        return CO_ERROR;
+    }
+
+    CoWorkerMailbox* mailbox = g_workerMailboxes[worker];
+    dispatcher->m_mailbox = mailbox;
+    mailbox->m_dispatcher.store(dispatcher);
+    return CO_OK;
+}
+
+void CoMailbox::clear_workers()
+{
+    for (auto &mailbox : g_workerMailboxes) {
+        // worker线程退出后没有处理的任务
+        CoMailNode* node = NULL;
+        while ((node = mailbox->m_queue.pop()) != NULL) {
+            SAFE_DELETE(node);
+        }
+        SAFE_DELETE(mailbox);
+    }
+    g_workerMailboxes.clear();
+}
+
+}
@@ -0,0 +1,124 @@
+#ifndef _CO_MAILBOX_H_
+#define _CO_MAILBOX_H_
+
+#include <memory>
+#include <string>
+#include <functional>
+#include "base/co_common.h"
+#include "base/co_mpsc_queue.h"
+
+
+namespace coserver
+{
+
+/*
+    worker线程之间的消息传递 (每个worker线程一个邮箱)
+
+    worker线程之间不共享数据, resume_async只能恢复已经存在的协程; 邮箱可以从任意线程(worker线程或外部线程)
+    把任务/消息投递给指定的worker线程或者全部worker线程, 在目标worker线程的调度循环中执行
+    用途: 每个线程的缓存失效 / 配置下发到所有线程 / 按key把请求路由到数据所属的线程(各线程独占数据 不加锁)
+
+    投递: 无锁队列(CoMpscQueue) 一次原子交换, 目标线程阻塞等待事件时通过eventfd唤醒, 没有等待时不唤醒(多次投递只唤醒一次)
+    处理: 和延迟队列/恢复队列轮流处理 每轮最多DISPATCH_QUANTUM个, 受dispatch_budget限制
+    限制:
+        任务在调度循环中执行(不在协程中), 不能阻塞; 需要阻塞调用时在任务中CoTask::spawn创建子协程
+        同一个线程投递给同一个worker的任务按投递顺序执行, 不同线程之间没有顺序保证
+        run_server之后才能投递 (worker线程启动前投递的任务在启动后执行)
+
+    使用示例:
+        // 所有worker线程清除线程本地缓存
+        CoMailbox::broadcast([]() { t_cache.clear(); });
+
+        // 按key路由到所属线程
+        CoTypedMailbox<std::string> invalidate([](std::string &key) { t_cache.erase(key); });
+        invalidate.post_key(key, key);
+*/
+
+class CoDispatcher;
+
+// 邮箱中的任务 (无锁队列节点)
+struct CoMailNode
+{
+    std::atomic<CoMailNode*>    m_mpscNext;
+    std::function<void ()>      m_func;
+};
+
+// 一个worker线程的邮箱 run_server时创建 worker线程启动后绑定dispatcher
+struct CoWorkerMailbox
+{
+    int32_t                     m_index = 0;                // worker线程序号
+    CoMpscQueue<CoMailNode>     m_queue;
+    std::atomic<CoDispatcher*>  m_dispatcher{NULL};         // NULL表示worker线程还没有启动或者已经退出
+    std::atomic<uint64_t>       m_posts{0};                 // 投递的任务数
+    std::atomic<uint64_t>       m_notifies{0};              // eventfd唤醒的次数
+};
+
+
+class CoMailbox
+{
+public:
+    // worker线程数量
+    static int32_t worker_count();
+    // 当前线程的worker序号 不是worker线程时返回-1
+    static int32_t cur_worker();
+    // key所属的worker序号
+    static int32_t owner(uint64_t key);
+    static int32_t owner(const std::string &key);
+
+    /*
+        函数功能: 投递任务到指定worker线程 (任意线程调用)
+
+        参数:
+            worker: worker序号 [0, worker_count)
+            func: 在worker线程调度循环中执行的任务
+
+        返回值: CO_OK成功 其他错误(worker序号错误/服务没有运行)
+    */
+    static int32_t post(int32_t worker, std::function<void ()> func);
+
+    // 投递任务到所有worker线程(包括当前线程) 每个线程执行一份func的拷贝, 返回投递成功的线程数
+    static int32_t broadcast(std::function<void ()> func);
+
+public:
+    // CoServer使用: 创建/绑定/释放worker线程的邮箱
+    static void init_workers(int32_t workerCount);
+    static int32_t bind_worker(int32_t worker, CoDispatcher* dispatcher);
+    static void clear_workers();
+};
+
+
+// 类型化的邮箱: 所有worker线程使用同一个处理函数 处理投递的消息, 消息按值拷贝
+template <typename T>
+class CoTypedMailbox
+{
+public:
+    explicit CoTypedMailbox(std::function<void (T &message)> handler) : m_handler(std::make_shared<std::function<void (T &message)>>(std::move(handler))) {}
+
+    int32_t post(int32_t worker, const T &message)
+    {
+        // 处理函数共享 邮箱对象释放后 已经投递的消息仍然可以处理; 消息拷贝一份(捕获const引用会得到const成员)
+        std::shared_ptr<std::function<void (T &message)>> handler = m_handler;
+        T copy = message;
+        return CoMailbox::post(worker, [handler, copy]() mutable { (*handler)(copy); });
+    }
+
+    template <typename K>
+    int32_t post_key(const K &key, const T &message)
+    {
+        return post(CoMailbox::owner(key), message);
+    }
+
+    int32_t broadcast(const T &message)
+    {
+        std::shared_ptr<std::function<void (T &message)>> handler = m_handler;
+        T copy = message;
+        return CoMailbox::broadcast([handler, copy]() mutable { (*handler)(copy); });
+    }
+
+private:
+    std::shared_ptr<std::function<void (T &message)>> m_handler;
+};
+
+}
+
+#endif //_CO_MAILBOX_H_
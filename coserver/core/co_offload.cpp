@@ -0,0 +1,174 @@
+#include <sys/prctl.h>
+#include "core/co_offload.h"
+#include "base/co_log.h"
+#include "base/co_clock.h"
+#include "core/co_dispatcher.h"
+
+
+namespace coserver
+{
+
+static std::unordered_map<std::string, CoOffloadPool*> g_offloadPools;
+// 辅助线程正在执行的任务
+static thread_local CoOffloadJob* g_offloadJob = NULL;
+
+
+CoOffloadPool::CoOffloadPool(const std::string &name, int32_t threads, int32_t queueLimit)
+: m_name(name), m_threadSize(threads), m_queueLimit(queueLimit)
+{
+}
+
+CoOffloadPool::~CoOffloadPool()
+{
+    stop();
+}
+
+int32_t CoOffloadPool::start()
+{
+    if (m_threadSize <= 0 || m_queueLimit <= 0) {
+        CO_SERVER_LOG_ERROR("offload pool:%s threads:%d queue:%d invalid", m_name.c_str(), m_threadSize, m_queueLimit);
+        return CO_ERROR;
+    }
+
+    m_threads.reserve(m_threadSize);
+    for (int32_t i=0; i<m_threadSize; ++i) {
+        m_threads.push_back(std::thread([this, i]() {
+            std::string threadName = "offload_" + std::to_string(i);
+            prctl(PR_SET_NAME, threadName.c_str(), 0, 0, 0);
+            this->run();
+        }));
+    }
+
+    CO_SERVER_LOG_INFO("offload pool:%s start, threads:%d queue:%d", m_name.c_str(), m_threadSize, m_queueLimit);
+    return CO_OK;
+}
+
+void CoOffloadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+int32_t CoOffloadPool::submit(CoOffloadJob* job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stop || m_jobs.size() >= (size_t)m_queueLimit) {
+            m_rejects.fetch_add(1, std::memory_order_relaxed);
+            return CO_ERROR;
+        }
+
+        job->m_submitUs = CoClock::mono_us();
+        job->m_state = OFFLOAD_STATE_QUEUED;
+        m_jobs.push_back(job);
+        if (m_jobs.size() > m_peakDepth.load(std::memory_order_relaxed)) {
+            m_peakDepth.store(m_jobs.size(), std::memory_order_relaxed);
+        }
+    }
+    m_cond.notify_one();
+
+    m_submits.fetch_add(1, std::memory_order_relaxed);
+    return CO_OK;
+}
+
+size_t CoOffloadPool::get_depth()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.size();
+}
+
+void CoOffloadPool::run()
+{
+    for (;;) {
+        CoOffloadJob* job = NULL;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+            if (m_jobs.empty()) {
+                // 停止时队列中的任务全部执行完再退出
+                return ;
+            }
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        // 排队期间已经超过截止时间 请求已经不需要结果 不再执行
+        uint64_t startUs = CoClock::mono_us();
+        if (job->m_deadlineUs && startUs >= job->m_deadlineUs) {
+            job->m_state = OFFLOAD_STATE_EXPIRED;
+            m_expired.fetch_add(1, std::memory_order_relaxed);
+
+        } else {
+            g_offloadJob = job;
+            job->m_func();
+            g_offloadJob = NULL;
+
+            job->m_runUs = CoClock::mono_us() - startUs;
+            job->m_state = OFFLOAD_STATE_DONE;
+        }
+
+        // 放入恢复队列后 worker线程可能马上释放任务 之后不能再访问job
+        std::pair<CoConnection*, uint32_t> coroutineData = std::make_pair(job->m_connection, job->m_version);
+        CoDispatcher::resume_offload(coroutineData);
+    }
+}
+
+int32_t CoOffloadPool::add_pool(const std::string &name, int32_t threads, int32_t queueLimit)
+{
+    if (g_offloadPools.find(name) != g_offloadPools.end()) {
+        CO_SERVER_LOG_ERROR("offload pool:%s already exists", name.c_str());
+        return CO_ERROR;
+    }
+
+    CoOffloadPool* pool = new CoOffloadPool(name, threads, queueLimit);
+    if (CO_OK != pool->start()) {
+        SAFE_DELETE(pool);
+        return CO_ERROR;
+    }
+
+    g_offloadPools[name] = pool;
+    return CO_OK;
+}
+
+CoOffloadPool* CoOffloadPool::get_pool(const std::string &name)
+{
+    auto itr = g_offloadPools.find(name);
+    if (itr == g_offloadPools.end()) {
+        return NULL;
+    }
+    return itr->second;
+}
+
+const std::unordered_map<std::string, CoOffloadPool*> &CoOffloadPool::get_pools()
+{
+    return g_offloadPools;
+}
+
+void CoOffloadPool::clear_pools()
+{
+    for (auto &itr : g_offloadPools) {
+        SAFE_DELETE(itr.second);
+    }
+    g_offloadPools.clear();
+}
+
+uint64_t CoOffloadPool::deadline_us()
+{
+    return g_offloadJob ? g_offloadJob->m_deadlineUs : 0;
+}
+
+bool CoOffloadPool::expired()
+{
+    uint64_t deadlineUs = deadline_us();
+    return deadlineUs && CoClock::mono_us() >= deadlineUs;
+}
+
+}
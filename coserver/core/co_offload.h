@@ -0,0 +1,114 @@
+#ifndef _CO_OFFLOAD_H_
+#define _CO_OFFLOAD_H_
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include "base/co_common.h"
+
+
+namespace coserver
+{
+
+/*
+    辅助线程池 (CoDispatcher::offload)
+
+    压缩/加解密/阻塞的文件和数据库客户端等 hook无法异步化的调用, 放到辅助线程执行, 调用的协程切出 不阻塞worker线程
+    执行完成后通过恢复队列(push_resume)唤醒原来的worker线程 在原来的协程中继续执行
+
+    每个线程池有自己的线程数和队列上限, 队列满时直接拒绝(返回错误 不排队), 避免辅助线程处理不过来时请求无限堆积
+    任务带有请求的截止时间(请求超时定时器/调用时指定的超时时间), 开始执行前已经超时的任务不再执行;
+    执行中的函数可以调用CoOffloadPool::expired检查截止时间 提前结束
+
+    线程池在run_server时创建(conf offload_threads/offload_queue为默认线程池), shut_down时所有worker线程退出后销毁
+*/
+
+struct CoConnection;
+
+const std::string OFFLOAD_POOL_DEFAULT = "default";
+
+// 任务状态
+const int32_t OFFLOAD_STATE_QUEUED = 0;
+const int32_t OFFLOAD_STATE_DONE = 1;       // 执行完成
+const int32_t OFFLOAD_STATE_EXPIRED = 2;    // 开始执行前已经超过截止时间 没有执行
+
+// 辅助线程任务 worker线程创建和释放, 辅助线程执行完成后只通过恢复队列通知 之后不再访问
+struct CoOffloadJob
+{
+    std::function<void ()>  m_func;
+    CoConnection*           m_connection = NULL;    // 等待任务的连接
+    uint32_t                m_version = 0;
+
+    uint64_t                m_deadlineUs = 0;       // 截止时间 (单调时钟us) 0表示没有
+    uint64_t                m_submitUs = 0;         // 放入队列的时间
+    uint64_t                m_runUs = 0;            // 执行时间
+    int32_t                 m_state = OFFLOAD_STATE_QUEUED;
+};
+
+
+class CoOffloadPool
+{
+public:
+    CoOffloadPool(const std::string &name, int32_t threads, int32_t queueLimit);
+    ~CoOffloadPool();
+
+    int32_t start();
+    // 等待队列中的任务执行完毕后 退出所有辅助线程
+    void stop();
+
+    // 放入队列 队列已满或线程池已经停止时返回CO_ERROR
+    int32_t submit(CoOffloadJob* job);
+
+    const std::string &get_name() { return m_name; }
+    int32_t get_threads() { return m_threadSize; }
+    int32_t get_queue_limit() { return m_queueLimit; }
+    size_t  get_depth();
+
+    // 统计 (任意线程读取)
+    uint64_t get_submits() { return m_submits.load(std::memory_order_relaxed); }
+    uint64_t get_rejects() { return m_rejects.load(std::memory_order_relaxed); }
+    uint64_t get_expired() { return m_expired.load(std::memory_order_relaxed); }
+    uint64_t get_peak_depth() { return m_peakDepth.load(std::memory_order_relaxed); }
+
+public:
+    /*
+        线程池管理 run_server之前/run_server中调用, worker线程中只查找
+        同名线程池已经存在时返回CO_ERROR
+    */
+    static int32_t add_pool(const std::string &name, int32_t threads, int32_t queueLimit);
+    static CoOffloadPool* get_pool(const std::string &name);
+    static const std::unordered_map<std::string, CoOffloadPool*> &get_pools();
+    static void clear_pools();
+
+    // 辅助线程中调用: 当前任务的截止时间(单调时钟us 0表示没有) / 是否已经超过截止时间
+    static uint64_t deadline_us();
+    static bool expired();
+
+private:
+    void run();
+
+private:
+    std::string             m_name;
+    int32_t                 m_threadSize = 0;
+    int32_t                 m_queueLimit = 0;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    std::deque<CoOffloadJob*> m_jobs;
+    bool                    m_stop = false;
+    std::vector<std::thread> m_threads;
+
+    std::atomic<uint64_t>   m_submits{0};       // 放入队列的任务数
+    std::atomic<uint64_t>   m_rejects{0};       // 队列已满拒绝的任务数
+    std::atomic<uint64_t>   m_expired{0};       // 超过截止时间没有执行的任务数
+    std::atomic<uint64_t>   m_peakDepth{0};     // 队列最大长度
+};
+
+}
+
+#endif //_CO_OFFLOAD_H_
@@ -0,0 +1,219 @@
+#include "core/co_periodic.h"
+#include "base/co_log.h"
+#include "base/co_clock.h"
+#include "core/co_dispatcher.h"
+
+
+namespace coserver
+{
+
+static std::vector<CoPeriodicTask*> g_periodicTasks;
+
+
+static void push_delay_connection(CoConnection* connection)
+{
+    connection->m_cycle->m_dispatcher->m_delayConnections.push(std::make_pair(connection, connection->m_version), connection->m_priority);
+}
+
+
+CoPeriodicScheduler::CoPeriodicScheduler()
+{
+}
+
+CoPeriodicScheduler::~CoPeriodicScheduler()
+{
+    for (auto &itr : m_states) {
+        SAFE_DELETE(itr);
+    }
+    m_states.clear();
+}
+
+int32_t CoPeriodicScheduler::start(CoCycle* cycle, int32_t worker)
+{
+    m_cycle = cycle;
+    m_worker = worker;
+    // 每个worker线程的随机序列不同 同一个任务在各线程错开执行
+    m_random.seed(CoClock::mono_us() + worker);
+
+    for (auto &itr : g_periodicTasks) {
+        CoPeriodicTask* task = itr;
+        if (task->m_worker >= 0 && task->m_worker != worker) {
+            continue;
+        }
+
+        CoConnection* connection = cycle->m_connectionPool->get_task_connection();
+        if (!connection) {
+            CO_SERVER_LOG_ERROR("periodic task:%s worker:%d get ticker connection failed", task->m_name.c_str(), worker);
+            return CO_ERROR;
+        }
+
+        CoPeriodicState* state = new CoPeriodicState;
+        state->m_task = task;
+        state->m_ticker = connection;
+        m_states.push_back(state);
+
+        connection->m_priority = PRIORITY_LOW;
+        connection->m_handler = [this, state](CoConnection* connection) {
+            run_ticker(state, connection);
+        };
+        push_delay_connection(connection);
+
+        CO_SERVER_LOG_INFO("periodic task:%s worker:%d start, interval:%ums delay:%ums jitter:%ums", task->m_name.c_str(), worker, task->m_intervalMs, task->m_delayMs, task->m_jitterMs);
+    }
+
+    return CO_OK;
+}
+
+void CoPeriodicScheduler::stop()
+{
+    if (m_stopped) {
+        return ;
+    }
+    m_stopped = true;
+
+    for (auto &itr : m_states) {
+        CoPeriodicState* state = itr;
+
+        // 正在执行的任务 之后的阻塞调用返回错误 尽快结束
+        if (state->m_runner && state->m_runner->m_version == state->m_runnerVersion) {
+            state->m_runner->m_flagDying = 1;
+        }
+
+        // 定时器协程在sleep中 删除定时器后切入 yield_timer返回错误结束循环
+        CoConnection* ticker = state->m_ticker;
+        if (ticker) {
+            if (ticker->m_sleepEvent->m_flagTimerSet) {
+                m_cycle->m_timer->del_timer(ticker->m_sleepEvent);
+            }
+            ticker->m_flagThirdFuncBlocking = 0;
+            ticker->m_flagDying = 1;
+            push_delay_connection(ticker);
+        }
+    }
+}
+
+bool CoPeriodicScheduler::is_idle()
+{
+    for (auto &itr : m_states) {
+        if (itr->m_ticker || itr->m_runner) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CoPeriodicScheduler::run_ticker(CoPeriodicState* state, CoConnection* connection)
+{
+    const CoPeriodicTask* task = state->m_task;
+
+    uint32_t delayMs = next_delay(task, task->m_delayMs);
+    while (!m_stopped) {
+        if (CO_OK != CoDispatcher::yield_timer(connection, delayMs) || m_stopped) {
+            break;
+        }
+
+        on_tick(state);
+        if (task->m_intervalMs == 0) {
+            break;
+        }
+        delayMs = next_delay(task, task->m_intervalMs);
+    }
+
+    CO_SERVER_LOG_DEBUG("(cid:%u) periodic task:%s worker:%d ticker exit", connection->m_connId, task->m_name.c_str(), m_worker);
+    state->m_ticker = NULL;
+    // 协程切出后由func_dispatcher归还连接
+    connection->m_flagTaskFinished = 1;
+}
+
+void CoPeriodicScheduler::on_tick(CoPeriodicState* state)
+{
+    const CoPeriodicTask* task = state->m_task;
+
+    if (state->m_runner) {
+        ++(state->m_skips);
+        CO_SERVER_LOG_DEBUG("periodic task:%s worker:%d still running, skip", task->m_name.c_str(), m_worker);
+        return ;
+    }
+
+    CoConnection* connection = m_cycle->m_connectionPool->get_task_connection();
+    if (!connection) {
+        ++(state->m_skips);
+        CO_SERVER_LOG_ERROR("periodic task:%s worker:%d get connection failed, skip", task->m_name.c_str(), m_worker);
+        return ;
+    }
+
+    state->m_runner = connection;
+    state->m_runnerVersion = connection->m_version;
+
+    // 后台任务 不和请求竞争
+    connection->m_priority = PRIORITY_LOW;
+    connection->m_handler = [this, state](CoConnection* connection) {
+        run_task(state, connection);
+    };
+    push_delay_connection(connection);
+}
+
+void CoPeriodicScheduler::run_task(CoPeriodicState* state, CoConnection* connection)
+{
+    const CoPeriodicTask* task = state->m_task;
+    uint64_t startUs = CoClock::mono_us();
+
+    // 任务使用普通请求 可以add_upstream/run_upstreams发起子请求
+    int32_t ret = CO_ERROR;
+    CoRequest* request = new CoRequest(CO_REQUEST_NORMAL);
+    if (CO_OK == request->init(connection, PROTOCOL_TCP_SERVER)) {
+        CoUserHandlerData* userData = request->m_userData;
+        userData->m_userData = task->m_userData;
+        ret = task->m_process(userData);
+
+        // 添加的子请求没有等待完成 子请求结束时会访问当前请求
+        while (request->m_count > 1) {
+            CO_SERVER_LOG_WARN("(cid:%u) periodic task:%s return with upstreams running, count:%d, wait", connection->m_connId, task->m_name.c_str(), request->m_count);
+            CoDispatcher::yield(userData->m_coroutineData);
+        }
+    }
+    SAFE_DELETE(request);
+
+    uint64_t runUs = CoClock::mono_us() - startUs;
+    ++(state->m_runs);
+    if (ret != CO_OK) {
+        ++(state->m_failures);
+        CO_SERVER_LOG_WARN("(cid:%u) periodic task:%s worker:%d failed, ret:%d cost:%luus", connection->m_connId, task->m_name.c_str(), m_worker, ret, runUs);
+    }
+    state->m_lastRunUs = runUs;
+    if (runUs > state->m_maxRunUs) {
+        state->m_maxRunUs = runUs;
+    }
+    state->m_runner = NULL;
+
+    // 协程切出后由func_dispatcher归还连接
+    connection->m_flagTaskFinished = 1;
+}
+
+uint32_t CoPeriodicScheduler::next_delay(const CoPeriodicTask* task, uint32_t delayMs)
+{
+    if (task->m_jitterMs == 0) {
+        return delayMs;
+    }
+    return delayMs + m_random() % (task->m_jitterMs + 1);
+}
+
+void CoPeriodicScheduler::add_task(CoPeriodicTask* task)
+{
+    g_periodicTasks.push_back(task);
+}
+
+const std::vector<CoPeriodicTask*> &CoPeriodicScheduler::get_tasks()
+{
+    return g_periodicTasks;
+}
+
+void CoPeriodicScheduler::clear_tasks()
+{
+    for (auto &itr : g_periodicTasks) {
+        SAFE_DELETE(itr);
+    }
+    g_periodicTasks.clear();
+}
+
+}
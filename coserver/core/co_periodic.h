@@ -0,0 +1,96 @@
+#ifndef _CO_PERIODIC_H_
+#define _CO_PERIODIC_H_
+
+#include <vector>
+#include <random>
+#include "core/co_request.h"
+
+
+namespace coserver
+{
+
+/*
+    worker线程内的周期/一次性后台任务 (CoServer::add_periodic_task/add_oneshot_task)
+
+    刷新查找表/批量上报计数/预热缓存等周期性工作 不需要再单独创建线程和worker线程竞争
+    每个worker线程(或者指定的一个worker线程)各自调度: 定时器使用CoTimer, 每次执行创建一个子协程连接(低优先级)
+    任务函数和server处理函数相同: 可以使用hook的阻塞调用, 可以add_upstream/run_upstreams发起子请求
+
+    jitter: 每次的间隔增加[0, jitter]的随机时间, 多个worker线程/多个进程的任务错开执行
+    上一次执行还没有结束时 本次跳过(不排队 不并发执行), 统计跳过次数
+    服务停止时不再调度新的执行, 正在执行的任务设置连接销毁标志(之后的阻塞调用返回错误), 执行完毕后worker线程退出
+    任务函数添加子请求后需要run_upstreams等待完成再返回
+*/
+
+// 注册的任务
+struct CoPeriodicTask
+{
+    std::string         m_name;
+    CoFuncUserProcess   m_process = NULL;
+    void*               m_userData = NULL;
+
+    uint32_t            m_intervalMs = 0;   // 执行间隔 0表示一次性任务
+    uint32_t            m_delayMs = 0;      // 第一次执行的延迟
+    uint32_t            m_jitterMs = 0;     // 每次延迟增加的随机时间上限
+    int32_t             m_worker = -1;      // 执行任务的worker序号 -1表示所有worker
+};
+
+// worker线程中任务的调度状态
+struct CoPeriodicState
+{
+    const CoPeriodicTask*   m_task = NULL;
+    CoConnection*           m_ticker = NULL;    // 定时器协程的连接 (sleep事件)
+    CoConnection*           m_runner = NULL;    // 正在执行任务的子协程连接 NULL表示没有执行
+    uint32_t                m_runnerVersion = 0;
+
+    uint64_t                m_runs = 0;         // 执行次数
+    uint64_t                m_skips = 0;        // 到达时间时上一次还在执行 跳过的次数
+    uint64_t                m_failures = 0;     // 任务函数返回非0的次数
+    uint64_t                m_lastRunUs = 0;    // 上一次执行时间
+    uint64_t                m_maxRunUs = 0;     // 最长执行时间
+};
+
+
+class CoPeriodicScheduler
+{
+public:
+    CoPeriodicScheduler();
+    ~CoPeriodicScheduler();
+
+    // worker线程开始调度前调用 为本线程需要执行的任务添加定时器
+    int32_t start(CoCycle* cycle, int32_t worker);
+    // 服务停止 删除定时器 不再执行新的任务
+    void stop();
+    // 定时器协程和执行中的任务全部结束 (worker线程退出前需要等待)
+    bool is_idle();
+
+    const std::vector<CoPeriodicState*> &get_states() { return m_states; }
+
+public:
+    // 注册任务 run_server之前调用, 任务对象由clear_tasks释放
+    static void add_task(CoPeriodicTask* task);
+    static const std::vector<CoPeriodicTask*> &get_tasks();
+    static void clear_tasks();
+
+private:
+    // 定时器协程: 等待间隔时间后开始一次执行 服务停止时结束
+    void run_ticker(CoPeriodicState* state, CoConnection* connection);
+    // 到达执行时间 上一次还在执行时跳过, 否则创建子协程执行
+    void on_tick(CoPeriodicState* state);
+    // 执行任务的子协程
+    void run_task(CoPeriodicState* state, CoConnection* connection);
+    // 下一次执行的等待时间 增加随机jitter
+    uint32_t next_delay(const CoPeriodicTask* task, uint32_t delayMs);
+
+private:
+    CoCycle*    m_cycle = NULL;
+    int32_t     m_worker = 0;
+    bool        m_stopped = false;
+    std::minstd_rand m_random;
+
+    std::vector<CoPeriodicState*> m_states;
+};
+
+}
+
+#endif //_CO_PERIODIC_H_
@@ -21,6 +21,20 @@ CoUserHandlerData::~CoUserHandlerData()
     m_upstreamInfos.clear();
 }
 
+void CoUserHandlerData::set_priority(int32_t priority)
+{
+    if (priority < PRIORITY_HIGH || priority >= PRIORITY_LEVELS) {
+        CO_SERVER_LOG_WARN("user handler data set priority:%d unexpected", priority);
+        return ;
+    }
+    ((CoConnection*)(m_coroutineData.first))->m_priority = priority;
+}
+
+int32_t CoUserHandlerData::get_priority()
+{
+    return ((CoConnection*)(m_coroutineData.first))->m_priority;
+}
+
 
 CoRequest::CoRequest(int32_t requestType) 
 : m_count(0)
@@ -59,7 +73,7 @@ int32_t CoRequest::init(CoConnection* connection, int32_t protocolType, CoProtoc
 
     m_protocol = protocol;
     m_protocol->set_clientip(connection->m_coTcp->get_ip());
-    m_startUs = GET_CURRENTTIME_US();
+    m_startUs = CoClock::now_us();
     m_requestId = ++g_requestId;
     m_count ++;
 
@@ -70,6 +84,8 @@ int32_t CoRequest::init(CoConnection* connection, int32_t protocolType, CoProtoc
 
     // 非upstream
     if (connection->m_serverControl) {
+        // keepalive连接的每个请求 优先级恢复为server配置
+        connection->m_priority = connection->m_serverControl->m_confServer->m_priority;
         m_userProcess = connection->m_serverControl->m_userFuncs->m_userProcess;
         m_userDestroy = connection->m_serverControl->m_userFuncs->m_userDestroy;
         m_userData->m_userData = connection->m_serverControl->m_userFuncs->m_userData;
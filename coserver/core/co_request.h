@@ -4,6 +4,7 @@
 #include "core/co_event.h"
 #include "core/co_cycle.h"
 #include "core/co_connection.h"
+#include "core/co_await.h"
 #include "protocol/co_protocol.h"
 
 
@@ -20,6 +21,10 @@ struct CoUserFuncs
     CoFuncUserProcess   m_userProcess = NULL;       // 业务处理函数
     CoFuncUserDestroy   m_userDestroy = NULL;       // 业务销毁函数
     void*               m_userData    = NULL;
+
+#if (CO_AWAIT)
+    CoFuncAwaitProcess  m_awaitProcess = NULL;      // C++20协程业务处理函数 非NULL时替代m_userProcess
+#endif
 };
 
 
@@ -37,6 +42,10 @@ struct CoUserHandlerData
 
     CoUserHandlerData();
     ~CoUserHandlerData();
+
+    // 当前请求的调度优先级(CoPriority) 之后的切入(子请求完成/恢复等)按新的优先级排队, 下一个请求恢复为server配置
+    void set_priority(int32_t priority);
+    int32_t get_priority();
 };
 
 struct CoRequest 
@@ -0,0 +1,145 @@
+#include <map>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include "core/co_reuseport.h"
+#include "base/co_log.h"
+
+
+namespace coserver
+{
+
+const int32_t REUSEPORT_LISTEN_BACKLOG = 512;   // 和worker线程监听相同
+
+
+CoReuseport::CoReuseport(const CoConfig* conf, const std::vector<int32_t> &workerCpus)
+: m_conf(conf)
+, m_workerCpus(workerCpus)
+{
+}
+
+CoReuseport::~CoReuseport()
+{
+    // 没有被worker取出的监听socket
+    for (auto &workerListeners : m_listeners) {
+        for (auto &itr : workerListeners) {
+            SAFE_DELETE(itr);
+        }
+    }
+    m_listeners.clear();
+}
+
+int32_t CoReuseport::start()
+{
+    int32_t workerCount = m_workerCpus.size();
+    m_listeners.resize(workerCount);
+
+    int32_t socketBusyPoll = m_conf->m_conf.m_socketBusyPoll;
+    for (auto &itr : m_conf->m_confServers) {
+        CoConfServer* confServer = itr;
+
+        // 按worker顺序listen 加入reuseport组的顺序即CBPF程序返回的序号
+        for (int32_t i=0; i<workerCount; ++i) {
+            CoTCP* listener = new CoTCP;
+            m_listeners[i].push_back(listener);
+
+            if (CO_OK != listener->init_ipport(confServer->m_listenIP, confServer->m_listenPort) || CO_OK != listener->set_nonblock() || CO_OK != listener->set_reused()) {
+                CO_SERVER_LOG_ERROR("reuseport worker:%d init listen socket failed, port:%d", i, confServer->m_listenPort);
+                return CO_ERROR;
+            }
+            if (m_workerCpus[i] >= 0 && CO_OK != listener->set_incoming_cpu(m_workerCpus[i])) {
+                CO_SERVER_LOG_WARN("reuseport worker:%d listen socket:%d set incoming cpu:%d failed", i, listener->get_socketfd(), m_workerCpus[i]);
+            }
+            if (socketBusyPoll > 0 && CO_OK != listener->set_busypoll(socketBusyPoll)) {
+                CO_SERVER_LOG_WARN("reuseport worker:%d listen socket:%d set busy poll:%d failed", i, listener->get_socketfd(), socketBusyPoll);
+            }
+            if (CO_OK != listener->server_bind() || CO_OK != listener->server_listen(REUSEPORT_LISTEN_BACKLOG)) {
+                CO_SERVER_LOG_ERROR("reuseport worker:%d listen ip:%s port:%d failed", i, confServer->m_listenIP.c_str(), confServer->m_listenPort);
+                return CO_ERROR;
+            }
+        }
+
+        // 附加到组中任意一个socket 对整个组生效; 失败时按SO_INCOMING_CPU/哈希选择
+        if (workerCount > 0 && CO_OK != attach_cbpf(m_listeners[0].back()->get_socketfd())) {
+            CO_SERVER_LOG_WARN("reuseport port:%d attach cbpf failed, select by incoming cpu", confServer->m_listenPort);
+        }
+    }
+
+    std::string cpus;
+    for (auto &cpu : m_workerCpus) {
+        cpus += " " + std::to_string(cpu);
+    }
+    CO_SERVER_LOG_INFO("reuseport start, servers:%lu workers:%d, worker cpus:%s", m_conf->m_confServers.size(), workerCount, cpus.c_str());
+    return CO_OK;
+}
+
+std::vector<int32_t> CoReuseport::take_sockets(int32_t worker)
+{
+    std::vector<int32_t> sockets;
+    for (auto &itr : m_listeners[worker]) {
+        sockets.push_back(itr->get_socketfd());
+        // 不关闭socket 由worker的监听连接关闭
+        itr->reset();
+        SAFE_DELETE(itr);
+    }
+    m_listeners[worker].clear();
+    return sockets;
+}
+
+int32_t CoReuseport::attach_cbpf(int32_t socketFd)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    // 按CPU分组 多个worker绑定同一个CPU时(worker数多于CPU数/worker_cpus重复) 组内按连接的哈希选择
+    std::map<int32_t, std::vector<uint32_t>> cpuWorkers;
+    for (uint32_t i=0; i<m_workerCpus.size(); ++i) {
+        if (m_workerCpus[i] >= 0) {
+            cpuWorkers[m_workerCpus[i]].push_back(i);
+        }
+    }
+
+    /*
+        A = 收到连接的CPU; 依次比较每个CPU:
+            相同时 一个worker直接返回worker序号, 多个worker时 A = 连接哈希 % worker数 返回组内对应的worker
+            不同时 跳过这个CPU的指令块
+        都不相同时返回worker数(超出范围 内核按哈希选择)
+    */
+    std::vector<struct sock_filter> code;
+    code.push_back((struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)));
+    for (auto &itr : cpuWorkers) {
+        const std::vector<uint32_t> &workers = itr.second;
+
+        std::vector<struct sock_filter> block;
+        if (workers.size() == 1) {
+            block.push_back((struct sock_filter)BPF_STMT(BPF_RET | BPF_K, workers[0]));
+        } else {
+            CO_SERVER_LOG_WARN("reuseport %lu workers bind cpu:%d, select by connection hash in these workers", workers.size(), itr.first);
+            block.push_back((struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_RXHASH)));
+            block.push_back((struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)workers.size()));
+            for (uint32_t j=0; j<workers.size(); ++j) {
+                block.push_back((struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, j, 0, 1));
+                block.push_back((struct sock_filter)BPF_STMT(BPF_RET | BPF_K, workers[j]));
+            }
+            block.push_back((struct sock_filter)BPF_STMT(BPF_RET | BPF_K, workers[0]));
+        }
+
+        // 条件跳转偏移只有8位 不相同时用BPF_JA跳过指令块
+        code.push_back((struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)itr.first, 1, 0));
+        code.push_back((struct sock_filter)BPF_STMT(BPF_JMP | BPF_JA, (uint32_t)block.size()));
+        code.insert(code.end(), block.begin(), block.end());
+    }
+    code.push_back((struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (uint32_t)m_workerCpus.size()));
+
+    struct sock_fprog program;
+    program.len = code.size();
+    program.filter = code.data();
+    if (0 != setsockopt(socketFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program))) {
+        CO_SERVER_LOG_ERROR("attach reuseport cbpf setsockopt failed, socket:%d error:%s", socketFd, strerror(errno));
+        return CO_ERROR;
+    }
+    return CO_OK;
+#else
+    CO_SERVER_LOG_ERROR("attach reuseport cbpf SO_ATTACH_REUSEPORT_CBPF not supported");
+    return CO_ERROR;
+#endif
+}
+
+}
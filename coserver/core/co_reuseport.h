@@ -0,0 +1,48 @@
+#ifndef _CO_REUSEPORT_H_
+#define _CO_REUSEPORT_H_
+
+#include <vector>
+#include "base/co_config.h"
+#include "base/co_tcp.h"
+
+
+namespace coserver
+{
+
+/*
+    按CPU选择worker的reuseport组 (conf accept_mode cpu)
+
+    reuseport模式每个worker线程各自创建监听socket加入同一个reuseport组, 内核按四元组哈希选择socket:
+    处理连接的worker和收到数据包的CPU(网卡队列中断所在CPU)无关, 协议栈和worker在不同CPU上处理同一个连接 缓存失效, 双路机器上还会跨NUMA节点
+    cpu模式worker线程绑定CPU(worker_cpus), 主线程按worker顺序为每个server创建监听socket(在reuseport组中的序号和worker序号相同),
+    附加reuseport CBPF程序 按收到连接的CPU返回绑定该CPU的worker序号(多个worker绑定同一个CPU时 按连接哈希在这些worker中选择),
+    其他CPU收到的连接返回超出范围的序号 由内核按哈希选择;
+    同时设置SO_INCOMING_CPU (CBPF程序附加失败时 内核也会优先选择CPU相同的监听socket)
+
+    网卡队列的中断需要绑定到worker所在的CPU(RSS/irq affinity) 每个worker才能收到连接
+    worker只在自己的监听socket上接受连接, worker连接数已满时新连接在监听队列中等待 不会交给其他worker
+*/
+class CoReuseport
+{
+public:
+    // workerCpus: 每个worker绑定的CPU -1表示没有绑定(不会选择这个worker)
+    CoReuseport(const CoConfig* conf, const std::vector<int32_t> &workerCpus);
+    ~CoReuseport();
+
+    // 创建所有worker的监听socket 附加CBPF程序, worker线程启动前调用
+    int32_t start();
+    // worker线程取出自己的监听socket(按server配置顺序) 之后由worker的监听连接关闭
+    std::vector<int32_t> take_sockets(int32_t worker);
+
+private:
+    int32_t attach_cbpf(int32_t socketFd);
+
+private:
+    const CoConfig*                     m_conf = NULL;
+    std::vector<int32_t>                m_workerCpus;
+    std::vector<std::vector<CoTCP*>>    m_listeners;    // 按worker序号 每个worker按server配置顺序
+};
+
+}
+
+#endif //_CO_REUSEPORT_H_
@@ -1,11 +1,54 @@
+#include <sched.h>
+#include <unistd.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #include "core/co_server.h"
 #include "base/co_log.h"
+#include "core/co_periodic.h"
+#include "core/co_acceptor.h"
+#include "core/co_reuseport.h"
 
 
 namespace coserver
 {
 
+const int32_t WORKER_MPOL_PREFERRED = 1;    // <numaif.h> MPOL_PREFERRED 不依赖libnuma
+const int32_t WORKER_NODE_MASK_BITS = 1024;
+
+/*
+    worker线程绑定CPU 之后分配的内存优先使用CPU所在的NUMA节点
+    连接池/缓冲区/协程栈都在worker线程中分配和首次访问 绑定放在创建CoCycle之前; 本地节点内存不足时仍可以使用其他节点
+*/
+static int32_t bind_worker_cpu(int32_t worker, int32_t cpu)
+{
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    if (0 != sched_setaffinity(0, sizeof(cpuSet), &cpuSet)) {
+        CO_SERVER_LOG_ERROR("worker:%d bind cpu:%d failed, errno:%d", worker, cpu, errno);
+        return CO_ERROR;
+    }
+
+    uint32_t curCpu = 0;
+    uint32_t node = 0;
+    if (0 != syscall(SYS_getcpu, &curCpu, &node, NULL)) {
+        CO_SERVER_LOG_WARN("worker:%d bind cpu:%d, getcpu failed errno:%d, skip numa policy", worker, cpu, errno);
+        return CO_OK;
+    }
+
+    unsigned long nodeMask[WORKER_NODE_MASK_BITS / (8 * sizeof(unsigned long))] = {0};
+    if (node < WORKER_NODE_MASK_BITS) {
+        nodeMask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+        // 内核没有开启NUMA时返回ENOSYS 不影响服务
+        if (0 != syscall(SYS_set_mempolicy, WORKER_MPOL_PREFERRED, nodeMask, WORKER_NODE_MASK_BITS + 1)) {
+            CO_SERVER_LOG_WARN("worker:%d bind cpu:%d, set mempolicy node:%u failed errno:%d", worker, cpu, node, errno);
+        }
+    }
+
+    CO_SERVER_LOG_INFO("worker:%d bind cpu:%d numa node:%u", worker, cpu, node);
+    return CO_OK;
+}
+
 extern std::unordered_map<std::string, CoUserFuncs*>  g_userFuncs;
 
 CoServer::CoServer()
@@ -16,6 +59,11 @@ CoServer::~CoServer()
 {
     shut_down();
 
+    // worker线程全部退出后释放 (使用当前线程作为worker时 run_server返回后才会析构)
+    CoOffloadPool::clear_pools();
+    CoMailbox::clear_workers();
+    CoPeriodicScheduler::clear_tasks();
+
     for (auto &itr : g_userFuncs) {
         SAFE_DELETE(itr.second);
     }
@@ -34,6 +82,59 @@ void CoServer::add_user_handlers(const std::string &handlerName, CoFuncUserProce
     g_userFuncs[handlerName] = userFunc;
 }
 
+#if (CO_AWAIT)
+void CoServer::add_await_handlers(const std::string &handlerName, CoFuncAwaitProcess awaitProcess, CoFuncUserDestroy userDestroy, void* userData)
+{
+    CoUserFuncs* userFunc = new CoUserFuncs;
+    userFunc->m_awaitProcess = awaitProcess;
+    userFunc->m_userDestroy = userDestroy;
+    userFunc->m_userData = userData;
+
+    g_userFuncs[handlerName] = userFunc;
+}
+#endif
+
+int32_t CoServer::add_offload_pool(const std::string &poolName, int32_t threads, int32_t queueLimit)
+{
+    return CoOffloadPool::add_pool(poolName, threads, queueLimit);
+}
+
+int32_t CoServer::add_periodic_task(const std::string &taskName, CoFuncUserProcess taskProcess, uint32_t intervalMs, uint32_t jitterMs, int32_t worker, void* userData)
+{
+    if (!taskProcess || intervalMs == 0) {
+        CO_SERVER_LOG_ERROR("periodic task:%s add failed, interval:%u", taskName.c_str(), intervalMs);
+        return CO_ERROR;
+    }
+
+    CoPeriodicTask* task = new CoPeriodicTask;
+    task->m_name = taskName;
+    task->m_process = taskProcess;
+    task->m_userData = userData;
+    task->m_intervalMs = intervalMs;
+    task->m_delayMs = intervalMs;
+    task->m_jitterMs = jitterMs;
+    task->m_worker = worker;
+    CoPeriodicScheduler::add_task(task);
+    return CO_OK;
+}
+
+int32_t CoServer::add_oneshot_task(const std::string &taskName, CoFuncUserProcess taskProcess, uint32_t delayMs, int32_t worker, void* userData)
+{
+    if (!taskProcess) {
+        CO_SERVER_LOG_ERROR("oneshot task:%s add failed, no process", taskName.c_str());
+        return CO_ERROR;
+    }
+
+    CoPeriodicTask* task = new CoPeriodicTask;
+    task->m_name = taskName;
+    task->m_process = taskProcess;
+    task->m_userData = userData;
+    task->m_delayMs = delayMs;
+    task->m_worker = worker;
+    CoPeriodicScheduler::add_task(task);
+    return CO_OK;
+}
+
 int32_t CoServer::run_server(const std::string &configFilename, int32_t useCurThreadServer)
 {
 #ifdef SIGPIPE
@@ -49,10 +150,84 @@ int32_t CoServer::run_server(const std::string &configFilename, int32_t useCurTh
     }
     const CoConfig* conf = m_configParser->get_config();
 
+    // 默认辅助线程池 add_offload_pool已经添加同名线程池时使用添加的
+    if (conf->m_conf.m_offloadThreads > 0 && !CoOffloadPool::get_pool(OFFLOAD_POOL_DEFAULT)) {
+        ret = CoOffloadPool::add_pool(OFFLOAD_POOL_DEFAULT, conf->m_conf.m_offloadThreads, conf->m_conf.m_offloadQueue);
+        if (ret != CO_OK) {
+            CO_SERVER_LOG_ERROR("offload pool init failed, threads:%d queue:%d ret:%d", conf->m_conf.m_offloadThreads, conf->m_conf.m_offloadQueue, ret);
+            return ret;
+        }
+    }
+
     // start worker threads
     int32_t threadSize = conf->m_conf.m_workerThreads;
+    for (auto &itr : CoPeriodicScheduler::get_tasks()) {
+        if (itr->m_worker >= threadSize) {
+            CO_SERVER_LOG_ERROR("periodic task:%s worker:%d invalid, worker threads:%d", itr->m_name.c_str(), itr->m_worker, threadSize);
+            return CO_ERROR;
+        }
+    }
+    if (conf->m_conf.m_busyPollUs > 0 && threadSize >= sysconf(_SC_NPROCESSORS_ONLN)) {
+        // 忙轮询需要独占CPU 线程数不少于CPU数时轮询会抢占其他线程 延迟反而变大
+        CO_SERVER_LOG_WARN("busy poll:%dus with worker threads:%d, online cpus:%ld, busy poll needs dedicated cpus", conf->m_conf.m_busyPollUs, threadSize, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    // worker线程绑定的CPU, cpu模式没有配置worker_cpus时 依次使用进程可以运行的CPU
+    m_workerCpus.assign(threadSize, -1);
+    if (!conf->m_conf.m_workerCpus.empty()) {
+        if ((int32_t)conf->m_conf.m_workerCpus.size() != threadSize) {
+            CO_SERVER_LOG_ERROR("worker cpus:%lu not equal worker threads:%d", conf->m_conf.m_workerCpus.size(), threadSize);
+            return CO_ERROR;
+        }
+        m_workerCpus = conf->m_conf.m_workerCpus;
+
+    } else if (conf->m_conf.m_acceptMode == ACCEPT_MODE_CPU) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        std::vector<int32_t> allowedCpus;
+        if (0 == sched_getaffinity(0, sizeof(cpuSet), &cpuSet)) {
+            for (int32_t cpu=0; cpu<CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &cpuSet)) {
+                    allowedCpus.push_back(cpu);
+                }
+            }
+        }
+        for (int32_t i=0; i<threadSize && !allowedCpus.empty(); ++i) {
+            m_workerCpus[i] = allowedCpus[i % allowedCpus.size()];
+        }
+    }
+    for (auto &cpu : m_workerCpus) {
+        if (cpu >= CPU_SETSIZE) {
+            CO_SERVER_LOG_ERROR("worker cpu:%d invalid, max:%d", cpu, CPU_SETSIZE - 1);
+            return CO_ERROR;
+        }
+    }
+
     m_workerDispatchers.resize(threadSize);
     m_workerThreads.reserve(threadSize);
+    // worker线程启动前创建邮箱 启动过程中投递的任务在启动后处理
+    CoMailbox::init_workers(threadSize);
+
+    // acceptor模式 acceptor线程交给worker的连接在worker启动后处理
+    if (conf->m_conf.m_acceptMode == ACCEPT_MODE_ACCEPTOR) {
+        m_acceptor = new CoAcceptor(conf, threadSize);
+        ret = m_acceptor->start();
+        if (ret != CO_OK) {
+            CO_SERVER_LOG_ERROR("acceptor start failed, threads:%d ret:%d", conf->m_conf.m_acceptorThreads, ret);
+            SAFE_DELETE(m_acceptor);
+            return ret;
+        }
+    }
+
+    // cpu模式 worker启动前按worker顺序创建监听socket
+    if (conf->m_conf.m_acceptMode == ACCEPT_MODE_CPU) {
+        m_reuseport = new CoReuseport(conf, m_workerCpus);
+        ret = m_reuseport->start();
+        if (ret != CO_OK) {
+            CO_SERVER_LOG_ERROR("reuseport start failed, ret:%d", ret);
+            SAFE_DELETE(m_reuseport);
+            return ret;
+        }
+    }
 
     for (int32_t i=0; i<threadSize; ++i) {
         if (i == (threadSize - 1) && 1 == useCurThreadServer) {
@@ -72,11 +247,24 @@ int32_t CoServer::run_server(const std::string &configFilename, int32_t useCurTh
 
 void CoServer::run_server_thread(int32_t index)
 {
+    // 先绑定CPU 之后分配的内存在本地NUMA节点
+    int32_t cpu = m_workerCpus.empty() ? -1 : m_workerCpus[index];
+    if (cpu >= 0 && CO_OK != bind_worker_cpu(index, cpu)) {
+        cpu = -1;
+    }
+
     // init thread local cycle, hook判断是否有cycle 即可知道是内部线程还是外部线程
     CoThreadLocalInfo* threadInfo = GET_TLS();
     CoCycle* &tlCoCycle = threadInfo->m_coCycle;
     tlCoCycle = new CoCycle;
     tlCoCycle->m_conf = m_configParser->get_config();
+    tlCoCycle->m_cpu = cpu;
+    if (m_reuseport) {
+        tlCoCycle->m_listenSockets = m_reuseport->take_sockets(index);
+    }
+
+    // 线程缓存时间 定时器/连接时间戳等使用
+    CoClock::init(tlCoCycle->m_conf->m_conf.m_clockSource);
 
     // calc need connection
     int32_t maxConnectionSize = 4;
@@ -88,6 +276,10 @@ void CoServer::run_server_thread(int32_t index)
         CoConfUpstream* confUpstream = itr;
         maxConnectionSize += confUpstream->m_maxConnections;
     }
+    // 周期任务 定时器协程和执行任务的子协程各占用一个连接
+    maxConnectionSize += CoPeriodicScheduler::get_tasks().size() * 2;
+    // spawn子协程单独预留连接 不占用server/upstream的连接
+    maxConnectionSize += tlCoCycle->m_conf->m_conf.m_maxTasks;
     int32_t minConnectionSize = maxConnectionSize / 4;
 
     // init connections
@@ -100,7 +292,7 @@ void CoServer::run_server_thread(int32_t index)
 
     // init epoll
     tlCoCycle->m_coEpoll = new CoEpoll;
-    ret = tlCoCycle->m_coEpoll->init(maxConnectionSize);
+    ret = tlCoCycle->m_coEpoll->init(maxConnectionSize, tlCoCycle->m_conf->m_conf.m_eventBackend);
     if (ret != CO_OK) {
         CO_SERVER_LOG_ERROR("epoll init failed, connections max:%d ret:%d", maxConnectionSize, ret);
         exit(-1);
@@ -108,12 +300,23 @@ void CoServer::run_server_thread(int32_t index)
 
     // init timer
     tlCoCycle->m_timer = new CoTimer;
+    tlCoCycle->m_timer->set_slack(TIMER_CLASS_IO, tlCoCycle->m_conf->m_conf.m_ioTimerSlack);
+    tlCoCycle->m_timer->set_slack(TIMER_CLASS_KEEPALIVE, tlCoCycle->m_conf->m_conf.m_keepaliveTimerSlack);
+    if (tlCoCycle->m_conf->m_conf.m_timerResolution == TIMER_RESOLUTION_US) {
+        ret = tlCoCycle->m_coEpoll->init_timerfd();
+        if (ret != CO_OK) {
+            CO_SERVER_LOG_ERROR("epoll init timerfd failed, ret:%d", ret);
+            exit(-1);
+        }
+        tlCoCycle->m_timer->set_precise(true);
+    }
 
     // init coroutine
     tlCoCycle->m_coCoroutineMain = new CoCoroutineMain;
-    ret = tlCoCycle->m_coCoroutineMain->init(1024 * 1024);
+    const CoConf &conf = tlCoCycle->m_conf->m_conf;
+    ret = tlCoCycle->m_coCoroutineMain->init(conf.m_coroutineStackSize, conf.m_coroutineStackMode, conf.m_coroutineSharedStacks, conf.m_coroutineStackAssign, conf.m_coroutineBufferCache);
     if (ret != CO_OK) {
-        CO_SERVER_LOG_ERROR("coroutine init failed, shared stack size:%d ret:%d", 1024 * 1024, ret);
+        CO_SERVER_LOG_ERROR("coroutine init failed, stack mode:%d stack size:%d ret:%d", conf.m_coroutineStackMode, conf.m_coroutineStackSize, ret);
         exit(-1);
     }
 
@@ -135,7 +338,11 @@ void CoServer::run_server_thread(int32_t index)
         CO_SERVER_LOG_ERROR("dispacther init failed, ret:%d", ret);
         exit(-1);
     }
+    if (m_acceptor) {
+        tlCoCycle->m_dispatcher->m_load = m_acceptor->get_load(index);
+    }
     m_workerDispatchers[index] = tlCoCycle->m_dispatcher;
+    CoMailbox::bind_worker(index, tlCoCycle->m_dispatcher);
 
     // run forever
     tlCoCycle->m_dispatcher->start(tlCoCycle);
@@ -144,6 +351,11 @@ void CoServer::run_server_thread(int32_t index)
 
 int32_t CoServer::shut_down()
 {
+    // 先停止接受新连接 worker线程退出后再释放(连接关闭时更新worker负载)
+    if (m_acceptor) {
+        m_acceptor->stop();
+    }
+
     for (auto &dispatcher : m_workerDispatchers) {
         // 防止还未添加真正的dispatcher 就shut down
         while (!dispatcher) {
@@ -158,6 +370,8 @@ int32_t CoServer::shut_down()
         thread.join();
     }
     m_workerThreads.clear();
+    SAFE_DELETE(m_acceptor);
+    SAFE_DELETE(m_reuseport);
 
     return CO_OK;
 }
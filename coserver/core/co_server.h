@@ -9,6 +9,9 @@
 namespace coserver
 {
 
+class CoAcceptor;
+class CoReuseport;
+
 class CoServer
 {
 public:
@@ -25,6 +28,52 @@ public:
             userData: 用户信息 回调函数时的参数
     */
     void    add_user_handlers(const std::string &handlerName, CoFuncUserProcess userProcess, CoFuncUserDestroy userDestroy, void* userData = NULL);
+
+#if (CO_AWAIT)
+    /*
+        函数功能: 添加server对应的C++20协程处理函数, 请求不使用有栈协程 (参考core/co_await.h)
+
+        参数: 
+            handlerName: 配置文件中server块下的handler_name名称
+            awaitProcess: server新请求时的回调 返回CoAwaitTask的C++20协程
+            userDestroy: server请求结束时的回调 处理函数
+            userData: 用户信息 回调函数时的参数
+    */
+    void    add_await_handlers(const std::string &handlerName, CoFuncAwaitProcess awaitProcess, CoFuncUserDestroy userDestroy, void* userData = NULL);
+#endif
+
+    /*
+        函数功能: 添加辅助线程池 CoDispatcher::offload按名称选择 (run_server之前调用)
+                  不同类型的阻塞调用使用不同的线程池 互不影响; conf offload_threads/offload_queue配置默认线程池
+
+        参数: 
+            poolName: 线程池名称
+            threads: 辅助线程数
+            queueLimit: 队列上限 队列满时offload直接返回错误
+
+        返回值: CO_OK成功 其他错误(名称重复/参数错误)
+    */
+    int32_t add_offload_pool(const std::string &poolName, int32_t threads, int32_t queueLimit);
+
+    /*
+        函数功能: 添加周期任务 在worker线程中按间隔执行 (run_server之前调用, 参考core/co_periodic.h)
+                  任务函数在低优先级的协程中执行 和server处理函数相同, 可以使用hook的阻塞调用和子请求
+                  上一次执行还没有结束时 本次跳过
+
+        参数: 
+            taskName: 任务名称 日志和统计使用
+            taskProcess: 任务函数 userData->m_userData为参数userData, 返回非0记录为失败
+            intervalMs: 执行间隔 第一次在启动后intervalMs执行
+            jitterMs: 每次间隔增加[0, jitterMs]的随机时间 多个worker错开执行
+            worker: 执行任务的worker序号 -1表示每个worker线程都执行
+            userData: 用户信息 任务函数的参数
+
+        返回值: CO_OK成功 其他错误
+    */
+    int32_t add_periodic_task(const std::string &taskName, CoFuncUserProcess taskProcess, uint32_t intervalMs, uint32_t jitterMs = 0, int32_t worker = -1, void* userData = NULL);
+
+    // 添加一次性任务 worker线程启动后delayMs执行一次 (比如预热缓存), 参数同add_periodic_task
+    int32_t add_oneshot_task(const std::string &taskName, CoFuncUserProcess taskProcess, uint32_t delayMs = 0, int32_t worker = -1, void* userData = NULL);
    
     /*
         函数功能: 运行服务
@@ -60,6 +109,13 @@ private:
 
     std::vector<std::thread> m_workerThreads;
     std::vector<CoDispatcher*> m_workerDispatchers;
+
+    // acceptor模式 接受新连接交给worker线程 (conf accept_mode acceptor)
+    CoAcceptor* m_acceptor = NULL;
+    // cpu模式 每个worker的监听socket (conf accept_mode cpu)
+    CoReuseport* m_reuseport = NULL;
+    // 每个worker线程绑定的CPU -1表示不绑定
+    std::vector<int32_t> m_workerCpus;
 };
 
 }
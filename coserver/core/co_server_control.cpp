@@ -3,6 +3,7 @@
 #include "core/co_cycle.h"
 #include "base/co_common.h"
 #include "core/co_callback_request.h"
+#include "core/co_acceptor.h"
 
 
 namespace coserver
@@ -12,8 +13,9 @@ const int32_t MAX_ACCEPT_NUM = 64;
 std::unordered_map<std::string, CoUserFuncs*>  g_userFuncs;
 
 
-CoServerControl::CoServerControl(CoConfServer* confServer)
+CoServerControl::CoServerControl(CoConfServer* confServer, int32_t serverIndex)
 : m_confServer(confServer)
+, m_serverIndex(serverIndex)
 {
 }
 
@@ -31,25 +33,46 @@ int32_t CoServerControl::init(CoCycle* cycle)
     }
     m_userFuncs = itr->second;
 
-    //  listen socket connection
-    m_listenConnection = cycle->m_connectionPool->get_connection(m_confServer->m_listenIP, m_confServer->m_listenPort, true);
+    // acceptor模式 worker线程不监听 新连接由acceptor线程交给worker (accept_handoff)
+    if (cycle->m_conf->m_conf.m_acceptMode == ACCEPT_MODE_ACCEPTOR) {
+        return CO_OK;
+    }
+
+    //  listen socket connection, cpu模式使用主线程创建的监听socket (core/co_reuseport.h)
+    if (cycle->m_conf->m_conf.m_acceptMode == ACCEPT_MODE_CPU) {
+        m_listenConnection = m_serverIndex < (int32_t)cycle->m_listenSockets.size() ? cycle->m_connectionPool->get_connection(cycle->m_listenSockets[m_serverIndex], false) : NULL;
+    } else {
+        m_listenConnection = cycle->m_connectionPool->get_connection(m_confServer->m_listenIP, m_confServer->m_listenPort, true);
+    }
     if (m_listenConnection == NULL) {
         CO_SERVER_LOG_ERROR("server control get connection failed");
         return CO_ERROR;
     }
+    // 设置失败不影响服务 (超过net.core.busy_read时需要CAP_NET_ADMIN)
+    int32_t socketBusyPoll = cycle->m_conf->m_conf.m_socketBusyPoll;
+    if (socketBusyPoll > 0 && CO_OK != m_listenConnection->m_coTcp->set_busypoll(socketBusyPoll)) {
+        CO_SERVER_LOG_WARN("listen socket:%d set busy poll:%d failed", m_listenConnection->m_coTcp->get_socketfd(), socketBusyPoll);
+    }
+
+    m_listenConnection->m_priority = m_confServer->m_priority;
 
     // 监听连接 读事件处理函数
     m_listenConnection->m_handler = [=](CoConnection* connection) {
+        // 延后接受时从运行队列切入 恢复监听, 至少接受一批新连接 防止一直延后
+        bool resumed = resume_accept();
         while(1) {
             int32_t maxAcceptSize = limit();
-            if (0 != maxAcceptSize) {
-                accept(connection, maxAcceptSize);
-
-            } else {
+            if (0 == maxAcceptSize) {
                 // 不能接受新连接 不再监听epoll
                 modify_listening();
                 break;
             }
+
+            if (!resumed && defer_accept(connection)) {
+                break;
+            }
+            resumed = false;
+            accept(connection, maxAcceptSize);
         }
     };
 
@@ -86,6 +109,16 @@ void CoServerControl::accept(CoConnection* connection, int32_t maxAcceptSize)
     return ;
 }
 
+int32_t CoServerControl::accept_handoff(CoCycle* cycle, int32_t socketFd)
+{
+    if (0 == limit() || CO_OK != init_connection(cycle, socketFd)) {
+        CO_SERVER_LOG_ERROR("accept handoff failed, close client socket:%d, cur connectionsize:%d", socketFd, m_curConnectionSize);
+        ::close(socketFd);
+        return CO_ERROR;
+    }
+    return CO_OK;
+}
+
 int32_t CoServerControl::init_connection(CoCycle* cycle, int32_t socketFd)
 {
     // 获取连接
@@ -94,18 +127,34 @@ int32_t CoServerControl::init_connection(CoCycle* cycle, int32_t socketFd)
         CO_SERVER_LOG_ERROR("init connection, get connection failed");
         return CO_ERROR;
     }
+    int32_t socketBusyPoll = cycle->m_conf->m_conf.m_socketBusyPoll;
+    if (socketBusyPoll > 0 && CO_OK != connection->m_coTcp->set_busypoll(socketBusyPoll)) {
+        CO_SERVER_LOG_WARN("(cid:%d) client socket:%d set busy poll:%d failed", connection->m_connId, socketFd, socketBusyPoll);
+    }
     // server及超时时间
     connection->m_serverControl = this;
     connection->m_socketRcvTimeout = m_confServer->m_readTimeout;
     connection->m_socketSndTimeout = m_confServer->m_writeTimeout;
     connection->m_keepaliveTimeout = m_confServer->m_keepaliveTimeout;
+    connection->m_flagRegisterOnce = (cycle->m_conf->m_conf.m_eventRegister == EVENT_REGISTER_ONCE);
+    connection->m_priority = m_confServer->m_priority;
     
     connection->m_handler = CoCallbackRequest::request_init;
+#if (CO_AWAIT)
+    if (m_userFuncs->m_awaitProcess) {
+        connection->m_flagAwait = 1;
+        connection->m_handler = CoAwaitRequest::request_init;
+    }
+#endif
     // 挂载cleanup 释放连接时需要计数
     connection->m_handlerCleanups.push_back(CoServerControl::func_cleanup);
 
     m_curConnectionSize ++;
-    cycle->m_dispatcher->m_delayConnections.push(std::make_pair(connection, connection->m_version));
+    m_accepts ++;
+    if (m_listenConnection && cycle->m_cpu >= 0 && cycle->m_conf->m_conf.m_acceptMode == ACCEPT_MODE_CPU && connection->m_coTcp->get_incoming_cpu() == cycle->m_cpu) {
+        m_localAccepts ++;
+    }
+    cycle->m_dispatcher->m_delayConnections.push(std::make_pair(connection, connection->m_version), connection->m_priority);
     CO_SERVER_LOG_DEBUG("(cid:%d) accept one client socketfd:%d", connection->m_connId, socketFd);
     return CO_OK;
 }
@@ -126,16 +175,57 @@ int32_t CoServerControl::limit()
     return newConnectionSize;
 }
 
+bool CoServerControl::defer_accept(CoConnection* connection)
+{
+    /*
+        接受新连接的优先级: 线程饱和(上一次调度循环预算用完 还有剩余任务)时, 运行队列中有更高优先级的任务等待,
+        监听连接按server的优先级放入运行队列 本次不再接受新连接; 高优先级的任务处理完(或者等待超过priority_aging)后再继续接受
+        新连接留在内核的accept队列中 不会为低优先级的连接继续申请连接和协程
+        延后期间监听连接移出epoll(边缘触发 新连接到达会再次进入处理函数), 运行队列中最多只有一个监听连接 切入时恢复监听
+    */
+    CoDispatcher* dispatcher = connection->m_cycle->m_dispatcher;
+    if (m_acceptDeferred || !dispatcher->is_saturated() || !dispatcher->m_delayConnections.has_higher(m_confServer->m_priority)) {
+        return false;
+    }
+
+    m_acceptDeferred = true;
+    m_deferredAccepts ++;
+    modify_listening();
+    dispatcher->m_delayConnections.push(std::make_pair(connection, connection->m_version), connection->m_priority);
+    CO_SERVER_LOG_DEBUG("(cid:%u) dispatcher saturated, defer accept priority:%d", connection->m_connId, connection->m_priority);
+    return true;
+}
+
+bool CoServerControl::resume_accept()
+{
+    if (!m_acceptDeferred) {
+        return false;
+    }
+
+    m_acceptDeferred = false;
+    modify_listening();
+    return true;
+}
+
 void CoServerControl::func_cleanup(CoConnection* connection)
 {
     CoServerControl* serverControl = connection->m_serverControl;
     serverControl->m_curConnectionSize --;
 
+    CoWorkerLoad* load = connection->m_cycle->m_dispatcher->m_load;
+    if (load) {
+        CoAcceptor::release_connection(load, serverControl->m_serverIndex);
+    }
+
     return connection->m_serverControl->modify_listening();
 }
 
 void CoServerControl::modify_listening()
 {
+    if (!m_listenConnection) {
+        return ;
+    }
+
     if (m_curConnectionSize >= m_confServer->m_maxConnections) {
         if (m_listening) {
             m_listening = false;
@@ -143,6 +233,14 @@ void CoServerControl::modify_listening()
             CO_SERVER_LOG_ERROR("listen socket limit, no accept size, epoll del event");
         }
 
+    } else if (m_acceptDeferred) {
+        // 延后接受新连接 等待运行队列切入后恢复监听
+        if (m_listening) {
+            m_listening = false;
+            m_listenConnection->m_cycle->m_coEpoll->modify_connection(m_listenConnection, EPOLL_EVENTS_DEL, CO_EVENT_READ);
+            CO_SERVER_LOG_DEBUG("listen socket defer accept, epoll del event");
+        }
+
     } else {
         if (!m_listening) {
             m_listening = true;
@@ -1,6 +1,7 @@
 #ifndef _CO_SERVER_CONTROL_H_
 #define _CO_SERVER_CONTROL_H_
 
+#include <atomic>
 #include "base/co_config.h"
 
 
@@ -15,7 +16,7 @@ struct CoConnection;
 class CoServerControl
 {
 public:
-    CoServerControl(CoConfServer* confServer);
+    CoServerControl(CoConfServer* confServer, int32_t serverIndex = 0);
     CoServerControl() = delete;
     ~CoServerControl();
 
@@ -24,24 +25,45 @@ public:
 
     void    accept(CoConnection* connection, int32_t maxAcceptSize);
     int32_t init_connection(CoCycle* cycle, int32_t socketFd);
+    // acceptor模式 acceptor线程交给当前worker的新连接, 连接数已满/初始化失败时关闭socket 返回CO_ERROR
+    int32_t accept_handoff(CoCycle* cycle, int32_t socketFd);
 
     void modify_listening();
     static void func_cleanup(CoConnection* connection);
 
 private:
     int32_t limit();
+    // 线程饱和时 有更高优先级的任务等待 监听连接放入运行队列 延后接受新连接
+    bool    defer_accept(CoConnection* connection);
+    // 延后接受后从运行队列切入 恢复监听, 返回是否处于延后状态
+    bool    resume_accept();
 
 
 public:
     CoConfServer*   m_confServer = NULL;
+    int32_t         m_serverIndex = 0;      // server配置中的序号
     CoUserFuncs*    m_userFuncs = NULL;
 
     // listen监听相关
     bool            m_listening = false;
+    bool            m_acceptDeferred = false;   // 监听连接在运行队列中等待 (不在epoll中)
     CoConnection*   m_listenConnection = NULL;
 
     // todo 限流 ip黑边名单等
     int32_t m_curConnectionSize = 0;
+
+    // 统计 请求数量
+    uint64_t m_requests = 0;
+    // 统计 接受的连接数量 (acceptor模式为acceptor线程交给当前worker的连接)
+    uint64_t m_accepts = 0;
+    // 统计 cpu模式 在worker绑定的CPU上收到的连接数量 (其他为内核按哈希选择)
+    uint64_t m_localAccepts = 0;
+    // 统计 处理函数协程切出时的最大栈深度 (byte)
+    uint32_t m_peakStackDepth = 0;
+    // 统计 处理函数超过看门狗预算没有切出的次数 (看门狗线程写入)
+    std::atomic<uint32_t> m_watchdogEvents{0};
+    // 统计 线程饱和时延后接受新连接的次数
+    uint64_t m_deferredAccepts = 0;
 };
 
 }
@@ -0,0 +1,235 @@
+#include "core/co_task.h"
+#include "base/co_log.h"
+#include "core/co_cycle.h"
+
+
+namespace coserver
+{
+
+static void push_delay_connection(CoConnection* connection, uint32_t version)
+{
+    connection->m_cycle->m_dispatcher->m_delayConnections.push(std::make_pair(connection, version), connection->m_priority);
+}
+
+
+int32_t CoTask::spawn(std::function<void ()> func, CoWaitGroup* waitGroup)
+{
+    CoThreadLocalInfo* threadInfo = GET_TLS();
+    if (!(threadInfo->m_coCycle)) {
+        CO_SERVER_LOG_ERROR("spawn task not inner thread");
+        return CO_ERROR;
+    }
+
+    CoCycle* cycle = threadInfo->m_coCycle;
+    if (cycle->m_dispatcher->m_curTasks >= cycle->m_conf->m_conf.m_maxTasks) {
+        CO_SERVER_LOG_ERROR("spawn task cur tasks:%d large max tasks:%d", cycle->m_dispatcher->m_curTasks, cycle->m_conf->m_conf.m_maxTasks);
+        return CO_ERROR;
+    }
+
+    CoConnection* connection = cycle->m_connectionPool->get_task_connection();
+    if (!connection) {
+        CO_SERVER_LOG_ERROR("spawn task get connection failed");
+        return CO_ERROR;
+    }
+
+    cycle->m_dispatcher->m_curTasks ++;
+
+    // 子协程持有WaitGroup的状态 父协程栈上的WaitGroup对象在共享栈模式下不可访问
+    std::shared_ptr<CoWaitGroupState> waitGroupState;
+    if (waitGroup) {
+        waitGroupState = waitGroup->m_state;
+        CoWaitGroup::add(waitGroupState.get(), 1);
+        waitGroupState->m_tasks.emplace_back(connection, connection->m_version);
+    }
+
+    connection->m_handler = [func, waitGroupState](CoConnection* connection) {
+        func();
+        task_finalize(connection, waitGroupState.get());
+    };
+
+    // 子协程使用创建它的连接的优先级
+    if (threadInfo->m_curConnection) {
+        connection->m_priority = threadInfo->m_curConnection->m_priority;
+    }
+
+    // 下次调度时执行
+    push_delay_connection(connection, connection->m_version);
+
+    CO_SERVER_LOG_DEBUG("(cid:%u) spawn task success, waitgroup:%p", connection->m_connId, waitGroup);
+    return CO_OK;
+}
+
+void CoTask::task_finalize(CoConnection* connection, CoWaitGroupState* waitGroup)
+{
+    CO_SERVER_LOG_DEBUG("(cid:%u) task finalize, dying:%d", connection->m_connId, connection->m_flagDying);
+
+    if (waitGroup) {
+        for (auto itr = waitGroup->m_tasks.begin(); itr != waitGroup->m_tasks.end(); ++itr) {
+            if (itr->first == connection && itr->second == connection->m_version) {
+                waitGroup->m_tasks.erase(itr);
+                break;
+            }
+        }
+        CoWaitGroup::add(waitGroup, -1);
+    }
+
+    // 协程切出后(状态置为ready) 由func_dispatcher归还连接
+    connection->m_flagTaskFinished = 1;
+    connection->m_cycle->m_dispatcher->m_curTasks --;
+}
+
+CoConnection* CoTask::cur_connection()
+{
+    CoConnection* connection = GET_TLS()->m_curConnection;
+    if (connection && connection->m_flagBlockConn) {
+        connection = connection->m_blockOriginConn;
+    }
+    return connection;
+}
+
+int32_t CoTask::wait(CoTaskWaiters &waiters)
+{
+    CoConnection* connection = cur_connection();
+    if (!connection) {
+        CO_SERVER_LOG_ERROR("task wait not in coroutine");
+        return CO_ERROR;
+    }
+
+    uint32_t version = connection->m_version;
+    waiters.emplace_back(connection, version);
+
+    int32_t ret = CoDispatcher::yield(connection);
+    if (ret != CO_OK) {
+        // 非唤醒切入 (连接出错) 从等待队列中删除
+        for (auto itr = waiters.begin(); itr != waiters.end(); ++itr) {
+            if (itr->first == connection && itr->second == version) {
+                waiters.erase(itr);
+                break;
+            }
+        }
+    }
+    return ret;
+}
+
+bool CoTask::wake_one(CoTaskWaiters &waiters)
+{
+    while (!waiters.empty()) {
+        std::pair<CoConnection*, uint32_t> waiter = waiters.front();
+        waiters.pop_front();
+
+        // 连接已经重置 等待的协程已经不存在
+        if (waiter.first->m_version != waiter.second) {
+            continue;
+        }
+
+        push_delay_connection(waiter.first, waiter.second);
+        return true;
+    }
+    return false;
+}
+
+void CoTask::wake_all(CoTaskWaiters &waiters)
+{
+    while (wake_one(waiters)) {
+    }
+}
+
+
+CoWaitGroup::CoWaitGroup()
+: m_state(std::make_shared<CoWaitGroupState>())
+{
+}
+
+void CoWaitGroup::add(int32_t delta)
+{
+    add(m_state.get(), delta);
+}
+
+void CoWaitGroup::done()
+{
+    add(m_state.get(), -1);
+}
+
+void CoWaitGroup::add(CoWaitGroupState* state, int32_t delta)
+{
+    state->m_count += delta;
+    if (state->m_count <= 0) {
+        state->m_count = 0;
+        CoTask::wake_all(state->m_waiters);
+    }
+}
+
+int32_t CoWaitGroup::wait()
+{
+    CoConnection* connection = CoTask::cur_connection();
+    if (m_state->m_count > 0 && !connection) {
+        CO_SERVER_LOG_ERROR("waitgroup wait not in coroutine, count:%d", m_state->m_count);
+        return CO_ERROR;
+    }
+
+    int32_t ret = CO_OK;
+    bool notified = false;
+
+    while (m_state->m_count > 0) {
+        // 当前连接出错 通知子协程尽快结束, 父协程返回前需要等待子协程全部结束
+        if (connection->m_flagDying && !notified) {
+            notified = true;
+            ret = CO_ERROR;
+
+            for (auto &task : m_state->m_tasks) {
+                CoConnection* taskConnection = task.first;
+                if (taskConnection->m_version != task.second) {
+                    continue;
+                }
+
+                CO_SERVER_LOG_WARN("(cid:%u tcid:%u) waitgroup wait, connection dying, notify task dying", connection->m_connId, taskConnection->m_connId);
+                taskConnection->m_flagDying = 1;
+                push_delay_connection(taskConnection, task.second);
+            }
+        }
+
+        if (CO_OK != CoTask::wait(m_state->m_waiters)) {
+            ret = CO_ERROR;
+        }
+    }
+
+    return ret;
+}
+
+CoYielder::CoYielder(uint32_t everyCount, uint64_t everyUs)
+: m_everyCount(everyCount)
+, m_everyUs(everyUs)
+{
+}
+
+bool CoYielder::need_yield()
+{
+    ++m_count;
+
+    bool needYield = m_everyCount > 0 && m_count >= m_everyCount;
+    if (!needYield && m_everyUs > 0) {
+        uint64_t nowUs = CoClock::mono_us();
+        if (m_startUs == 0) {
+            m_startUs = nowUs;
+        }
+        needYield = nowUs - m_startUs >= m_everyUs;
+    }
+
+    if (needYield) {
+        // 下一个周期从切入后开始计时
+        m_count = 0;
+        m_startUs = 0;
+        ++m_yields;
+    }
+    return needYield;
+}
+
+int32_t CoYielder::tick()
+{
+    if (!need_yield()) {
+        return CO_OK;
+    }
+    return CoDispatcher::yield_now();
+}
+
+}
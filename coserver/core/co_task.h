@@ -0,0 +1,233 @@
+#ifndef _CO_TASK_H_
+#define _CO_TASK_H_
+
+#include <deque>
+#include <memory>
+#include <functional>
+#include "base/co_common.h"
+
+
+namespace coserver
+{
+
+/*
+    请求内并发: 子协程(spawn) / CoWaitGroup / CoChannel
+
+    每个子协程占用连接池中的一个连接(没有socket), 使用连接自己的协程和阻塞连接
+    子协程中调用hook的第三方阻塞函数(socket/sleep等)时 和父协程互不影响, 可以并行执行多个第三方客户端调用
+
+    唤醒全部通过dispatcher的延迟队列(m_delayConnections)完成, 不轮询
+    限制:
+        只能在server线程内使用, WaitGroup/Channel不能跨线程
+        共享栈模式下 一个协程栈上的数据在其他协程运行时不可访问(栈内容已换出), 子协程不能引用父协程栈上的变量
+        CoWaitGroup/CoChannel是句柄 状态保存在堆上, 按值捕获传给子协程; 其他共享数据使用堆内存(比如std::shared_ptr)
+        父协程返回前需要wait 等待子协程结束
+        子协程中不支持add_upstream(子协程没有request), upstream请在父协程中添加
+
+    使用示例:
+        CoWaitGroup wg;
+        CoChannel<std::string> ch(2);
+        CoTask::spawn([ch]() mutable { ch.send(call_redis()); }, &wg);
+        CoTask::spawn([ch]() mutable { ch.send(call_mysql()); }, &wg);
+        wg.wait();
+*/
+
+struct CoConnection;
+class CoWaitGroup;
+struct CoWaitGroupState;
+
+// 等待中的协程 <连接, 连接版本>
+typedef std::deque<std::pair<CoConnection*, uint32_t>> CoTaskWaiters;
+
+
+class CoTask
+{
+public:
+    /*
+        函数功能: 在当前线程创建子协程, 下一次调度循环开始执行
+
+        参数:
+            func: 子协程执行函数
+            waitGroup: 非NULL时 创建时add(1), 子协程结束时done
+
+        返回值: CO_OK成功 其他错误(不在server线程中/子协程数达到max_tasks/连接不足)
+    */
+    static int32_t spawn(std::function<void ()> func, CoWaitGroup* waitGroup = NULL);
+
+    // 当前线程正在执行的协程所属连接 (阻塞连接返回原始连接)
+    static CoConnection* cur_connection();
+
+    // 切出当前协程 加入waiters等待唤醒, 连接即将销毁时返回CO_ERROR
+    static int32_t wait(CoTaskWaiters &waiters);
+
+    // 唤醒一个/全部等待的协程 (放入延迟队列)
+    static bool wake_one(CoTaskWaiters &waiters);
+    static void wake_all(CoTaskWaiters &waiters);
+
+private:
+    static void task_finalize(CoConnection* connection, CoWaitGroupState* waitGroup);
+};
+
+
+struct CoWaitGroupState
+{
+    int32_t         m_count = 0;
+    CoTaskWaiters   m_waiters;
+    CoTaskWaiters   m_tasks;    // spawn的子协程 出错时通知子协程结束
+};
+
+class CoWaitGroup
+{
+public:
+    CoWaitGroup();
+
+    void add(int32_t delta = 1);
+    void done();
+
+    /*
+        函数功能: 等待计数归零
+
+        返回值: CO_OK成功; 等待中当前连接出错(超时/关闭)时 先通知spawn的子协程尽快结束 等待子协程全部结束后返回CO_ERROR
+    */
+    int32_t wait();
+
+    int32_t count() const
+    {
+        return m_state->m_count;
+    }
+
+private:
+    friend class CoTask;
+
+    static void add(CoWaitGroupState* state, int32_t delta);
+
+    std::shared_ptr<CoWaitGroupState> m_state;
+};
+
+
+/*
+    长时间计算中定期让出worker线程: 每调用everyCount次 或者距离上次让出(开始)超过everyUs微秒时 调用CoDispatcher::yield_now
+    everyCount/everyUs为0表示不按次数/时间检查, 时间使用单调时钟(计算中线程缓存的时钟不更新)
+
+    使用示例:
+        CoYielder yielder(0, 1000);
+        for (auto &item : items) {
+            transform(item);
+            if (CO_OK != yielder.tick()) {
+                return CO_ERROR;    // 让出期间连接超时/关闭
+            }
+        }
+    C++20协程处理函数中: if (yielder.need_yield()) { co_await CoAwait::yield_now(userData); }
+*/
+class CoYielder
+{
+public:
+    CoYielder(uint32_t everyCount, uint64_t everyUs);
+
+    // 达到次数/时间时返回true 并开始下一个周期
+    bool need_yield();
+
+    // need_yield时让出 返回yield_now的结果, 不需要让出时返回CO_OK
+    int32_t tick();
+
+    // 让出的次数
+    uint32_t yields() const
+    {
+        return m_yields;
+    }
+
+private:
+    uint32_t    m_everyCount = 0;
+    uint64_t    m_everyUs = 0;
+
+    uint32_t    m_count = 0;
+    uint64_t    m_startUs = 0;      // 周期开始时间 0表示下次检查时开始
+    uint32_t    m_yields = 0;
+};
+
+
+/*
+    有界channel, 满时send切出等待, 空时recv切出等待
+    close后: send返回CO_CONNECTION_CLOSE, recv取完剩余数据后返回CO_CONNECTION_CLOSE
+    复制的CoChannel共享同一个队列
+*/
+template <typename T>
+class CoChannel
+{
+public:
+    explicit CoChannel(size_t capacity = 1) : m_state(std::make_shared<CoChannelState>())
+    {
+        m_state->m_capacity = capacity ? capacity : 1;
+    }
+
+    int32_t send(const T &value)
+    {
+        CoChannelState* state = m_state.get();
+        while (!state->m_closed && state->m_queue.size() >= state->m_capacity) {
+            if (CO_OK != CoTask::wait(state->m_sendWaiters)) {
+                return CO_ERROR;
+            }
+        }
+
+        if (state->m_closed) {
+            return CO_CONNECTION_CLOSE;
+        }
+
+        state->m_queue.push_back(value);
+        CoTask::wake_one(state->m_recvWaiters);
+        return CO_OK;
+    }
+
+    int32_t recv(T &value)
+    {
+        CoChannelState* state = m_state.get();
+        while (!state->m_closed && state->m_queue.empty()) {
+            if (CO_OK != CoTask::wait(state->m_recvWaiters)) {
+                return CO_ERROR;
+            }
+        }
+
+        if (state->m_queue.empty()) {
+            return CO_CONNECTION_CLOSE;
+        }
+
+        value = std::move(state->m_queue.front());
+        state->m_queue.pop_front();
+        CoTask::wake_one(state->m_sendWaiters);
+        return CO_OK;
+    }
+
+    void close()
+    {
+        m_state->m_closed = true;
+        CoTask::wake_all(m_state->m_sendWaiters);
+        CoTask::wake_all(m_state->m_recvWaiters);
+    }
+
+    size_t size() const
+    {
+        return m_state->m_queue.size();
+    }
+
+    bool closed() const
+    {
+        return m_state->m_closed;
+    }
+
+private:
+    struct CoChannelState
+    {
+        size_t          m_capacity = 1;
+        bool            m_closed = false;
+        std::deque<T>   m_queue;
+
+        CoTaskWaiters   m_sendWaiters;
+        CoTaskWaiters   m_recvWaiters;
+    };
+
+    std::shared_ptr<CoChannelState> m_state;
+};
+
+}
+
+#endif //_CO_TASK_H_
@@ -0,0 +1,215 @@
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include "core/co_watchdog.h"
+#include "base/co_log.h"
+#include "core/co_connection.h"
+#include "core/co_server_control.h"
+
+
+namespace coserver
+{
+
+const int32_t WATCHDOG_MAX_FRAMES = 32;
+const int32_t WATCHDOG_SAMPLE_WAIT_US = 50000;     // 等待worker线程采样调用栈的最长时间
+
+// 信号处理函数中写入 看门狗线程持有g_sampleMutex时读取
+// g_sampleSize: -1 请求采样, -2 信号处理函数正在采样, >=0 采样完成的帧数
+static std::mutex g_sampleMutex;
+static void* g_sampleFrames[WATCHDOG_MAX_FRAMES];
+static std::atomic<int32_t> g_sampleSize(0);
+
+static int32_t watchdog_signal()
+{
+    return SIGRTMIN + 1;
+}
+
+
+CoWatchdog::CoWatchdog()
+: m_run(false)
+, m_runSeq(0)
+, m_runStartMs(0)
+, m_runConnId(0)
+, m_runServer(NULL)
+{
+}
+
+CoWatchdog::~CoWatchdog()
+{
+    stop();
+}
+
+int32_t CoWatchdog::start(uint32_t budgetMs)
+{
+    static std::once_flag installOnce;
+    std::call_once(installOnce, []() {
+        // 第一次调用backtrace会加载libgcc 不能放在信号处理函数中
+        void* frames[1];
+        backtrace(frames, 1);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = CoWatchdog::signal_backtrace;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(watchdog_signal(), &action, NULL) != 0) {
+            CO_SERVER_LOG_ERROR("watchdog install signal:%d handler failed, errno:%d", watchdog_signal(), errno);
+        }
+    });
+
+    m_budgetMs = budgetMs;
+    m_workerThread = pthread_self();
+    m_run = true;
+    m_thread = std::thread([this]() { watch_loop(); });
+
+    CO_SERVER_LOG_INFO("watchdog start, budget:%u ms", m_budgetMs);
+    return CO_OK;
+}
+
+void CoWatchdog::stop()
+{
+    m_run = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void CoWatchdog::run_begin(CoConnection* connection)
+{
+    CoServerControl* serverControl = connection->m_serverControl;
+    if (connection->m_flagBlockConn) {
+        serverControl = connection->m_blockOriginConn->m_serverControl;
+    }
+
+    m_runConnId.store(connection->m_connId, std::memory_order_relaxed);
+    m_runServer.store(serverControl, std::memory_order_relaxed);
+    m_runStartMs.store(CoClock::mono_ms(), std::memory_order_relaxed);
+    m_runSeq.fetch_add(1, std::memory_order_release);
+}
+
+void CoWatchdog::run_end()
+{
+    m_runSeq.fetch_add(1, std::memory_order_release);
+}
+
+void CoWatchdog::watch_loop()
+{
+    // 预算的1/4检查一次
+    uint32_t intervalUs = m_budgetMs * 250;
+    if (intervalUs < 1000) {
+        intervalUs = 1000;
+    }
+
+    while (m_run) {
+        usleep(intervalUs);
+
+        uint64_t seq = m_runSeq.load(std::memory_order_acquire);
+        if (!(seq & 1) || seq == m_reportedSeq) {
+            continue;
+        }
+
+        uint64_t now = CoClock::mono_ms();
+        uint64_t startMs = m_runStartMs.load(std::memory_order_relaxed);
+        if (now < startMs + m_budgetMs) {
+            continue;
+        }
+
+        // 读取期间调度已经结束
+        if (m_runSeq.load(std::memory_order_acquire) != seq) {
+            continue;
+        }
+
+        m_reportedSeq = seq;
+        report(now - startMs);
+    }
+}
+
+void CoWatchdog::report(uint64_t runMs)
+{
+    uint32_t connId = m_runConnId.load(std::memory_order_relaxed);
+    CoServerControl* serverControl = m_runServer.load(std::memory_order_relaxed);
+
+    std::string handlerName = "-";
+    if (serverControl) {
+        handlerName = serverControl->m_confServer->m_handlerName;
+        serverControl->m_watchdogEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+    CO_SERVER_LOG_WARN("(cid:%u) watchdog handler:%s run %lu ms without yield, budget:%u ms", connId, handlerName.c_str(), runMs, m_budgetMs);
+
+    void* frames[WATCHDOG_MAX_FRAMES];
+    int32_t frameSize = sample_backtrace(frames, WATCHDOG_MAX_FRAMES);
+    if (frameSize <= 0) {
+        CO_SERVER_LOG_WARN("(cid:%u) watchdog sample backtrace failed", connId);
+        return ;
+    }
+
+    char** symbols = backtrace_symbols(frames, frameSize);
+    if (!symbols) {
+        return ;
+    }
+    // 跳过信号处理函数本身
+    for (int32_t i=1; i<frameSize; ++i) {
+        CO_SERVER_LOG_WARN("(cid:%u) watchdog backtrace #%d %s", connId, i - 1, symbols[i]);
+    }
+    free(symbols);
+}
+
+int32_t CoWatchdog::sample_backtrace(void** frames, int32_t maxFrames)
+{
+    std::lock_guard<std::mutex> lock(g_sampleMutex);
+
+    g_sampleSize.store(-1, std::memory_order_release);
+    if (pthread_kill(m_workerThread, watchdog_signal()) != 0) {
+        return CO_ERROR;
+    }
+
+    int32_t sampleSize = -1;
+    for (int32_t waitUs=0; waitUs<WATCHDOG_SAMPLE_WAIT_US; waitUs+=100) {
+        sampleSize = g_sampleSize.load(std::memory_order_acquire);
+        if (sampleSize >= 0) {
+            break;
+        }
+        usleep(100);
+    }
+
+    if (sampleSize < 0) {
+        // 超时 收回请求 之后到达的信号不再采样
+        int32_t expected = -1;
+        if (g_sampleSize.compare_exchange_strong(expected, 0, std::memory_order_acq_rel)) {
+            return CO_ERROR;
+        }
+        // 信号处理函数已经认领(-2) 正在写g_sampleFrames, 等待写完 释放锁后下一次采样才能重新请求
+        while ((sampleSize = g_sampleSize.load(std::memory_order_acquire)) < 0) {
+            usleep(100);
+        }
+    }
+
+    if (sampleSize <= 0) {
+        return CO_ERROR;
+    }
+
+    sampleSize = sampleSize > maxFrames ? maxFrames : sampleSize;
+    memcpy(frames, g_sampleFrames, sampleSize * sizeof(void*));
+    return sampleSize;
+}
+
+void CoWatchdog::signal_backtrace(int32_t signo)
+{
+    UNUSED(signo);
+
+    // 只响应看门狗的采样请求, 认领请求(-1 -> -2)后再写g_sampleFrames 看门狗超时收回请求时不会同时读取
+    int32_t expected = -1;
+    if (!g_sampleSize.compare_exchange_strong(expected, -2, std::memory_order_acq_rel)) {
+        return ;
+    }
+
+    int32_t errnoBak = errno;
+    int32_t frameSize = backtrace(g_sampleFrames, WATCHDOG_MAX_FRAMES);
+    g_sampleSize.store(frameSize, std::memory_order_release);
+    errno = errnoBak;
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef _CO_WATCHDOG_H_
+#define _CO_WATCHDOG_H_
+
+#include <atomic>
+#include <thread>
+#include <pthread.h>
+#include "base/co_common.h"
+
+
+namespace coserver
+{
+
+/*
+    运行时看门狗 (conf watchdog_budget)
+
+    func_dispatcher一次调度会一直执行到协程下一次切出, 处理函数中的CPU密集计算或没有hook的阻塞调用(磁盘IO/getaddrinfo/未hook的锁等)
+    会卡住整个worker线程上的所有连接
+    每个worker一个看门狗线程, 发现一次调度超过预算时间没有返回时:
+        输出连接id/处理函数名称/运行时间, 并向worker线程发送信号采样一次调用栈
+        按处理函数统计次数 (CoServerControl::m_watchdogEvents, stats_interval日志输出)
+    一次超时调度只报告一次
+
+    worker线程每次调度只写几个relaxed原子变量, 看门狗线程定期检查
+*/
+
+struct CoConnection;
+class CoServerControl;
+
+
+class CoWatchdog
+{
+public:
+    CoWatchdog();
+    ~CoWatchdog();
+
+    // 在worker线程中调用 启动看门狗线程
+    int32_t start(uint32_t budgetMs);
+    void stop();
+
+    // func_dispatcher调度开始/结束
+    void run_begin(CoConnection* connection);
+    void run_end();
+
+
+private:
+    void watch_loop();
+    void report(uint64_t runMs);
+
+    // 采样worker线程的调用栈 (全局一次只采样一个线程)
+    int32_t sample_backtrace(void** frames, int32_t maxFrames);
+    static void signal_backtrace(int32_t signo);
+
+
+private:
+    uint32_t        m_budgetMs = 0;
+    pthread_t       m_workerThread;
+    std::thread     m_thread;
+    std::atomic<bool> m_run;
+
+    // 当前调度 m_runSeq为奇数表示调度中
+    std::atomic<uint64_t>           m_runSeq;
+    std::atomic<uint64_t>           m_runStartMs;
+    std::atomic<uint32_t>           m_runConnId;
+    std::atomic<CoServerControl*>   m_runServer;
+
+    uint64_t        m_reportedSeq = 0;      // 已经报告过的调度
+};
+
+}
+
+#endif //_CO_WATCHDOG_H_
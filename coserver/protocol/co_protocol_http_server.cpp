@@ -189,6 +189,10 @@ int32_t CoProtocolHttpServer::encode(CoBuffer* coBuffer)
     respMsg->remove_header(CoProtocolHttp::HEADER_SERVER);
     respMsg->add_header(CoProtocolHttp::HEADER_SERVER, "coserver/http");
 
+    // header Date  每秒格式化一次
+    respMsg->remove_header(CoProtocolHttp::HEADER_DATE);
+    respMsg->add_header(CoProtocolHttp::HEADER_DATE, CoClock::http_date());
+
     // http response not need Host header
 
     // add all header
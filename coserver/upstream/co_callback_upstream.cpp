@@ -49,7 +49,7 @@ void CoCallbackUpstream::upstream_init(CoConnection* connection)
     }
 
     // 建立连接后发送数据
-    connection->m_request->m_connectUs = GET_CURRENTTIME_US() - connection->m_request->m_startUs;
+    connection->m_request->m_connectUs = CoClock::now_us() - connection->m_request->m_startUs;
     return upstream_write(connection);
 }
 
@@ -68,12 +68,8 @@ void CoCallbackUpstream::upstream_write(CoConnection* connection)
         }
     )
 
-    // 添加写事件超时定时器和epoll
+    // 添加写事件超时定时器 直接发送请求 发送返回EAGAIN时hook才添加写事件epoll
     cycle->m_timer->add_timer(writeEvent, connection->m_socketSndTimeout);
-    if (cycle->m_coEpoll->modify_connection(connection, EPOLL_EVENTS_ADD, CO_EVENT_OUT)) {
-        CO_SERVER_LOG_FATAL("(cid:%u rid:%u) upstream epoll add event failed", connection->m_connId, request->m_requestId);
-        return co_defer_return(upstream_finalize(request, CO_ERROR));
-    }
 
     // 构建请求
     CoBuffer* coBuffer = connection->m_coBuffer;
@@ -98,7 +94,7 @@ void CoCallbackUpstream::upstream_write(CoConnection* connection)
         }
         break;
     }
-    request->m_writeUs = GET_CURRENTTIME_US() - request->m_startUs;
+    request->m_writeUs = CoClock::now_us() - request->m_startUs;
 
     // 请求发送完毕 开始读取响应数据
     return co_defer_return(upstream_read(connection));
@@ -162,7 +158,7 @@ void CoCallbackUpstream::upstream_read(CoConnection* connection)
         
         if (CO_OK == ret) {
             // 响应协议解析成功
-            request->m_readUs = GET_CURRENTTIME_US() - request->m_startUs;
+            request->m_readUs = CoClock::now_us() - request->m_startUs;
             CO_SERVER_LOG_DEBUG("(cid:%u rid:%u) upstream protocol decode success", connection->m_connId, request->m_requestId);
 
         } else {
@@ -190,7 +186,7 @@ void CoCallbackUpstream::upstream_process(CoConnection* connection)
 
         // 用户逻辑处理
         ret = request->m_userProcess(request->m_userData);
-        request->m_processUs = GET_CURRENTTIME_US() - request->m_startUs;
+        request->m_processUs = CoClock::now_us() - request->m_startUs;
 
         connection->m_cycle->m_timer->del_timer(connection->m_readEvent);
     }
@@ -231,7 +227,7 @@ void CoCallbackUpstream::upstream_finalize_request(CoRequest* request, int32_t r
 {
     CoUpstreamInfo* upstreamInfo = request->m_upstreamInfo;
     // 记录upstream耗时 响应状态
-    upstreamInfo->m_useTimeUs = GET_CURRENTTIME_US() - request->m_startUs;
+    upstreamInfo->m_useTimeUs = CoClock::now_us() - request->m_startUs;
     upstreamInfo->m_status = retCode;
 
     if (request->m_userDestroy) {
@@ -253,7 +249,7 @@ void CoCallbackUpstream::upstream_finalize_request(CoRequest* request, int32_t r
         (parentRequest->m_count) --;
         if (parentRequest->m_count == 1) {
             // 子请求全部处理完成 唤醒父请求
-            request->m_cycle->m_dispatcher->m_delayConnections.push(std::make_pair(parentRequest->m_connection, parentRequest->m_connection->m_version));
+            request->m_cycle->m_dispatcher->m_delayConnections.push(std::make_pair(parentRequest->m_connection, parentRequest->m_connection->m_version), parentRequest->m_connection->m_priority);
         }
         CO_SERVER_LOG_DEBUG("(rid:%u prid:%u) upstream finalize parent count:%d", request->m_requestId, parentRequest->m_requestId, parentRequest->m_count);
     }
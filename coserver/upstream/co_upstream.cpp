@@ -84,7 +84,7 @@ CoConnection* CoUpstream::get_connection()
             return NULL;
         }
         m_curConnectionSize ++;
-        connection->m_startTimestamp = GET_CURRENTTIME_MS();
+        connection->m_startTimestamp = CoClock::now_ms();
         CO_SERVER_LOG_DEBUG("(cid:%u) upstream name:%s get new connection, cur connections size:%d", connection->m_connId, m_confUpstream->m_name.c_str(), m_curConnectionSize);
     }
 
@@ -133,7 +133,7 @@ void CoUpstream::free_connection(CoConnection* connection, int32_t retCode)
     // 连接建立过久 关闭连接
     if (!closeConnection) {
         if (0 != m_confUpstream->m_connectionMaxTime) {
-            uint64_t timestamp = GET_CURRENTTIME_MS();
+            uint64_t timestamp = CoClock::now_ms();
             if ((int32_t)(timestamp - connection->m_startTimestamp) >= m_confUpstream->m_connectionMaxTime) {
                 closeConnection = true;
                 CO_SERVER_LOG_INFO("(cid:%u) upstream name:%s curtime:%lu starttime:%lu maxtime:%d, free it", connection->m_connId, m_confUpstream->m_name.c_str(), timestamp, connection->m_startTimestamp, m_confUpstream->m_connectionMaxTime);
@@ -234,6 +234,8 @@ CoConnection* CoUpstreamPool::get_upstream_connection(const std::string &name)
     connection->m_socketRcvTimeout = upstream->m_confUpstream->m_readTimeout;
     connection->m_socketSndTimeout = upstream->m_confUpstream->m_writeTimeout;
     connection->m_keepaliveTimeout = upstream->m_confUpstream->m_keepaliveTimeout;
+    connection->m_flagRegisterOnce = (connection->m_cycle->m_conf->m_conf.m_eventRegister == EVENT_REGISTER_ONCE);
+    connection->m_priority = PRIORITY_NORMAL;
 
     connection->m_handler = CoCallbackUpstream::upstream_init;
 
@@ -261,9 +263,12 @@ void CoUpstreamPool::retry_upstream(CoRequest* upstreamRequest, const std::strin
     // upstream request重置协议响应数据 / 重置连接数据
     upstreamRequest->reset_connection(upstreamConnection);
     upstreamRequest->m_protocol->reset_respmsg();
+    if (upstreamRequest->m_parent) {
+        upstreamConnection->m_priority = upstreamRequest->m_parent->m_connection->m_priority;
+    }
 
     // 添加到dispatch进行下次协程执行
-    cycle->m_dispatcher->m_delayConnections.push(std::make_pair(upstreamConnection, upstreamConnection->m_version));
+    cycle->m_dispatcher->m_delayConnections.push(std::make_pair(upstreamConnection, upstreamConnection->m_version), upstreamConnection->m_priority);
 
     CO_SERVER_LOG_DEBUG("(cid:%u rid:%u) add upstream request success, reqeust count:%u, retry:%d", upstreamConnection->m_connId, upstreamRequest->m_requestId, upstreamRequest->m_count, upstreamRequest->m_retryTimes);
     return ;
@@ -305,13 +310,15 @@ int32_t CoUpstreamPool::add_upstream(CoUserHandlerData* userData, const std::str
     upstreamRequest->m_userProcess = NULL;   // 不需要处理业务逻辑
     upstreamRequest->m_parent = request;
     upstreamRequest->m_upstreamInfo = upstreamInfo;
+    // 子请求使用父请求的优先级
+    upstreamConnection->m_priority = connection->m_priority;
 
     // 设置父请求相关参数
     request->m_upstreamRequests[upstreamRequest->m_requestId] = upstreamRequest;
     request->m_count ++;
 
     // 添加到dispatch进行下次协程执行
-    cycle->m_dispatcher->m_delayConnections.push(std::make_pair(upstreamConnection, upstreamConnection->m_version));
+    cycle->m_dispatcher->m_delayConnections.push(std::make_pair(upstreamConnection, upstreamConnection->m_version), upstreamConnection->m_priority);
 
     CO_SERVER_LOG_DEBUG("(cid:%u rid:%u) add upstream request success, reqeust count:%u, parent request count:%d", upstreamConnection->m_connId, upstreamRequest->m_requestId, upstreamRequest->m_count, request->m_count);
     return CO_OK;
@@ -374,7 +381,7 @@ CoUserHandlerData* CoUpstreamPool::add_upstream_detach(const std::string &upstre
     request->m_upstreamInfo = upstreamInfo;
 
     // 添加到dispatch进行下次协程执行
-    cycle->m_dispatcher->m_delayConnections.push(std::make_pair(connection, connection->m_version));
+    cycle->m_dispatcher->m_delayConnections.push(std::make_pair(connection, connection->m_version), connection->m_priority);
 
     CO_SERVER_LOG_DEBUG("(cid:%u rid:%u) init detach upstream request success, reqeust count:%u", connection->m_connId, request->m_requestId, request->m_count);
     return request->m_userData;
@@ -25,7 +25,7 @@ bool CoBackend::avaliable()
     }
 
     // backend down
-    uint64_t timestamp = GET_CURRENTTIME_MS();
+    uint64_t timestamp = CoClock::now_ms();
     if ((int32_t)(timestamp - m_downTimestamp) >= m_confFailTime) {
         m_fail = false;
         m_errNum = 0;
@@ -41,7 +41,7 @@ void CoBackend::comm_failed()
         return ;
     }
 
-    uint64_t timestamp = GET_CURRENTTIME_MS();
+    uint64_t timestamp = CoClock::now_ms();
     if ((int32_t)(timestamp - m_errFirstTimestamp) > m_confFailTime) {
         m_errFirstTimestamp = timestamp;
         m_errNum = 0;
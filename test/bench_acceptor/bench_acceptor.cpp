@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_mailbox.h"
+
+using namespace coserver;
+
+/*
+    连接分布测试: 4个worker线程 每个worker max_connections 64, 客户端建立keepalive长连接 每个连接请求一次 返回处理的worker序号
+        第一阶段: 建立200个连接 统计每个worker的连接数, worker连接已满时新连接得不到响应(1s超时) 记为失败
+        第二阶段: 关闭worker 0上的所有连接 再建立50个连接 (长连接关闭后的不均衡)
+    reuseport.conf由内核按四元组选择worker, acceptor.conf由acceptor线程选择连接数最少的worker
+    cpu.conf按收到连接的CPU选择worker: 回环连接在客户端所在CPU上处理, 连接都交给和客户端同一CPU的worker(单CPU时全部交给worker 0),
+        stats_interval日志中local cpu accepts为在worker绑定的CPU上收到的连接数
+*/
+
+static const uint16_t BENCH_PORT = 15689;
+static const int32_t WORKERS = 4;
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+    httpResp->append_content(std::to_string(CoMailbox::cur_worker()));
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+// 发送一个请求 返回处理的worker序号 失败(超时)返回-1
+static int request_worker(int fd)
+{
+    std::string request = "GET /worker HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.c_str(), request.size()) != (ssize_t)request.size()) {
+        return -1;
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t readSize = 0;
+    while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, readSize);
+
+        size_t pos = response.find("\r\n\r\n");
+        size_t lenPos = response.find("Content-Length: ");
+        if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+            return atoi(response.c_str() + pos + 4);
+        }
+    }
+    return -1;
+}
+
+struct BenchConnection
+{
+    int m_fd = -1;
+    int m_worker = -1;
+};
+
+// 建立count个连接 返回失败数
+static int open_connections(std::vector<BenchConnection> &connections, int count)
+{
+    int failures = 0;
+    for (int i=0; i<count; ++i) {
+        BenchConnection connection;
+        connection.m_fd = connect_server();
+        connection.m_worker = connection.m_fd >= 0 ? request_worker(connection.m_fd) : -1;
+        if (connection.m_worker < 0) {
+            ++failures;
+            close(connection.m_fd);
+            continue;
+        }
+        connections.push_back(connection);
+    }
+    return failures;
+}
+
+static void print_distribution(const char* phase, const std::vector<BenchConnection> &connections, int failures)
+{
+    int counts[WORKERS] = {0};
+    for (auto &connection : connections) {
+        counts[connection.m_worker] ++;
+    }
+
+    std::string workers;
+    for (int i=0; i<WORKERS; ++i) {
+        workers += " " + std::to_string(counts[i]);
+    }
+    int maxCount = *std::max_element(counts, counts + WORKERS);
+    int minCount = *std::min_element(counts, counts + WORKERS);
+    fprintf(stdout, "%-8s connections:%lu failures:%d, per worker:%s (max-min:%d)\n", phase, connections.size(), failures, workers.c_str(), maxCount - minCount);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./acceptor.conf";
+    int openCount = argc > 2 ? atoi(argv[2]) : 0;
+    if (openCount == 0) {
+        openCount = 200;
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    std::vector<BenchConnection> connections;
+    int failures = open_connections(connections, openCount);
+    print_distribution("open", connections, failures);
+
+    // 关闭worker 0上的长连接 之后的新连接应该优先分配给worker 0
+    std::vector<BenchConnection> remains;
+    for (auto &connection : connections) {
+        if (connection.m_worker == 0) {
+            close(connection.m_fd);
+        } else {
+            remains.push_back(connection);
+        }
+    }
+    connections.swap(remains);
+    usleep(100000);
+
+    failures = open_connections(connections, openCount / 4);
+    print_distribution("reopen", connections, failures);
+
+    for (auto &connection : connections) {
+        close(connection.m_fd);
+    }
+    coServer.shut_down();
+    return 0;
+}
+
+// g++ bench_acceptor.cpp -O2 -obench_acceptor -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_acceptor reuseport.conf 200; ./bench_acceptor acceptor.conf 200; ./bench_acceptor cpu.conf 40
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_cycle.h"
+
+using namespace coserver;
+
+/*
+    事件后端测试: 多个keepalive连接并发请求, 统计QPS和每个请求的事件系统调用次数
+    分别使用 event_backend epoll / io_uring 的配置运行
+    epoll: 每次事件修改一次epoll_ctl, 每次循环一次epoll_wait
+    io_uring: 事件修改写入提交队列, 每次循环一次io_uring_enter
+*/
+
+static const uint16_t BENCH_PORT = 15680;
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPRequest* httpReq = (CoHTTPRequest* )(requestData->m_protocol->get_reqmsg());
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    if (httpReq->get_url() == "/stats") {
+        // 处理函数在worker线程中运行 读取当前线程的事件后端统计
+        CoEventBackend* backend = GET_TLS()->m_coCycle->m_coEpoll->get_backend();
+        const CoEventBackendStats &stats = backend->get_stats();
+
+        char result[256];
+        snprintf(result, sizeof(result), "%s %lu %lu %lu", backend->name(), stats.m_ctls, stats.m_waits, stats.m_syscalls);
+        httpResp->append_content(result);
+        return 0;
+    }
+
+    httpResp->append_content("hello");
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// keepalive连接上发送一个请求 按Content-Length读取完整响应
+static bool http_get(int fd, const std::string &url, std::string &body)
+{
+    std::string request = "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.c_str(), request.size()) != (ssize_t)request.size()) {
+        return false;
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t readSize = 0;
+    while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, readSize);
+
+        size_t pos = response.find("\r\n\r\n");
+        size_t lenPos = response.find("Content-Length: ");
+        if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+            body = response.substr(pos + 4);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct BackendStats
+{
+    char        m_name[32];
+    uint64_t    m_ctls;
+    uint64_t    m_waits;
+    uint64_t    m_syscalls;
+};
+
+static bool get_stats(BackendStats &stats)
+{
+    int fd = connect_server();
+    std::string body;
+    bool ret = fd >= 0 && http_get(fd, "/stats", body);
+    close(fd);
+    return ret && sscanf(body.c_str(), "%31s %lu %lu %lu", stats.m_name, &stats.m_ctls, &stats.m_waits, &stats.m_syscalls) == 4;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+    uint32_t connections = argc > 2 ? atoi(argv[2]) : 0;
+    uint32_t requests = argc > 3 ? atoi(argv[3]) : 0;
+    if (connections == 0) {
+        connections = 32;
+    }
+    if (requests == 0) {
+        requests = 10000;
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    BackendStats begin, end;
+    if (!get_stats(begin)) {
+        fprintf(stdout, "get stats failed\n");
+        coServer.shut_down();
+        return -1;
+    }
+
+    std::atomic<uint64_t> success(0);
+    std::vector<std::thread> clients;
+    uint64_t startUs = now_us();
+    for (uint32_t i=0; i<connections; ++i) {
+        clients.emplace_back([&]() {
+            int fd = connect_server();
+            std::string body;
+            for (uint32_t n=0; fd >= 0 && n<requests; ++n) {
+                if (!http_get(fd, "/hello", body)) {
+                    break;
+                }
+                success ++;
+            }
+            close(fd);
+        });
+    }
+    for (auto &client : clients) {
+        client.join();
+    }
+    uint64_t costUs = now_us() - startUs;
+
+    get_stats(end);
+    uint64_t total = success.load();
+    fprintf(stdout, "backend:%s connections:%u requests:%lu cost:%.2fs qps:%.0f\n", end.m_name, connections, total, costUs / 1000000.0, total * 1000000.0 / costUs);
+    fprintf(stdout, "per request  ctls:%.2f waits:%.2f syscalls:%.2f\n", (double)(end.m_ctls - begin.m_ctls) / total, (double)(end.m_waits - begin.m_waits) / total, 
+            (double)(end.m_syscalls - begin.m_syscalls) / total);
+
+    coServer.shut_down();
+    return 0;
+}
+
+// g++ bench_backend.cpp -O2 -obench_backend -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_backend coserver.conf 32 10000           (event_backend epoll)
+// ./bench_backend coserver_uring.conf 32 10000     (event_backend io_uring)
+// ./bench_backend coserver_once.conf 32 10000      (event_backend epoll, event_register once)
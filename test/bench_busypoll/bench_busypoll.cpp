@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <string>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_cycle.h"
+
+using namespace coserver;
+
+/*
+    忙轮询测试: 少量keepalive连接 每个请求之间间隔gapUs, 统计请求往返延迟和服务端轮询统计
+    分别使用 busy_poll_us 0 / 200 的配置运行
+    busy_poll_us 0: 请求间隔期间worker线程阻塞在epoll_wait, 请求到达时需要唤醒线程
+    busy_poll_us 200: 间隔小于轮询时间时 请求在轮询期间到达 不需要唤醒线程
+*/
+
+static const uint16_t BENCH_PORT = 15681;
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPRequest* httpReq = (CoHTTPRequest* )(requestData->m_protocol->get_reqmsg());
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    if (httpReq->get_url() == "/stats") {
+        // 处理函数在worker线程中运行 读取当前线程的事件循环统计
+        CoCycle* cycle = GET_TLS()->m_coCycle;
+        const CoEventLoopStats &stats = cycle->m_dispatcher->get_loop_stats();
+
+        char result[256];
+        snprintf(result, sizeof(result), "%lu %lu %lu %lu %d", stats.m_spins, stats.m_spinHits, stats.m_spinUs, stats.m_spinIdleUs, cycle->m_coEpoll->get_events_batch());
+        httpResp->append_content(result);
+        return 0;
+    }
+
+    httpResp->append_content("hello");
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// keepalive连接上发送一个请求 按Content-Length读取完整响应
+static bool http_get(int fd, const std::string &url, std::string &body)
+{
+    std::string request = "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.c_str(), request.size()) != (ssize_t)request.size()) {
+        return false;
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t readSize = 0;
+    while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, readSize);
+
+        size_t pos = response.find("\r\n\r\n");
+        size_t lenPos = response.find("Content-Length: ");
+        if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+            body = response.substr(pos + 4);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct LoopStats
+{
+    uint64_t    m_spins;
+    uint64_t    m_spinHits;
+    uint64_t    m_spinUs;
+    uint64_t    m_spinIdleUs;
+    int32_t     m_eventsBatch;
+};
+
+static bool get_stats(LoopStats &stats)
+{
+    int fd = connect_server();
+    std::string body;
+    bool ret = fd >= 0 && http_get(fd, "/stats", body);
+    close(fd);
+    return ret && sscanf(body.c_str(), "%lu %lu %lu %lu %d", &stats.m_spins, &stats.m_spinHits, &stats.m_spinUs, &stats.m_spinIdleUs, &stats.m_eventsBatch) == 5;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+    uint32_t connections = argc > 2 ? atoi(argv[2]) : 0;
+    uint32_t requests = argc > 3 ? atoi(argv[3]) : 0;
+    uint32_t gapUs = argc > 4 ? atoi(argv[4]) : 20;
+    if (connections == 0) {
+        connections = 1;
+    }
+    if (requests == 0) {
+        requests = 20000;
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    LoopStats begin, end;
+    if (!get_stats(begin)) {
+        fprintf(stdout, "get stats failed\n");
+        coServer.shut_down();
+        return -1;
+    }
+
+    std::vector<std::vector<uint32_t>> latencies(connections);
+    std::vector<std::thread> clients;
+    uint64_t startUs = now_us();
+    for (uint32_t i=0; i<connections; ++i) {
+        clients.emplace_back([&, i]() {
+            int fd = connect_server();
+            std::string body;
+            for (uint32_t n=0; fd >= 0 && n<requests; ++n) {
+                uint64_t beginUs = now_us();
+                if (!http_get(fd, "/hello", body)) {
+                    break;
+                }
+                uint64_t endUs = now_us();
+                latencies[i].push_back(endUs - beginUs);
+
+                // 请求间隔 忙等保证间隔精确 (usleep精度不够)
+                while (now_us() - endUs < gapUs) {
+                }
+            }
+            close(fd);
+        });
+    }
+    for (auto &client : clients) {
+        client.join();
+    }
+    uint64_t costUs = now_us() - startUs;
+    get_stats(end);
+
+    std::vector<uint32_t> all;
+    uint64_t sumUs = 0;
+    for (auto &latency : latencies) {
+        all.insert(all.end(), latency.begin(), latency.end());
+    }
+    if (all.empty()) {
+        fprintf(stdout, "no request success\n");
+        coServer.shut_down();
+        return -1;
+    }
+    std::sort(all.begin(), all.end());
+    for (auto us : all) {
+        sumUs += us;
+    }
+
+    uint64_t spins = end.m_spins - begin.m_spins;
+    fprintf(stdout, "connections:%u requests:%lu gap:%uus cost:%.2fs\n", connections, all.size(), gapUs, costUs / 1000000.0);
+    fprintf(stdout, "latency us  avg:%.1f p50:%u p99:%u p999:%u max:%u\n", (double)sumUs / all.size(), all[all.size() / 2], all[all.size() * 99 / 100], 
+            all[all.size() * 999 / 1000], all.back());
+    fprintf(stdout, "busy poll  spins:%lu hits:%.1f%% spin time:%.1f%% idle spin:%.1f%% events batch:%d\n", spins, spins ? (end.m_spinHits - begin.m_spinHits) * 100.0 / spins : 0.0, 
+            (end.m_spinUs - begin.m_spinUs) * 100.0 / costUs, (end.m_spinIdleUs - begin.m_spinIdleUs) * 100.0 / costUs, end.m_eventsBatch);
+
+    coServer.shut_down();
+    return 0;
+}
+
+// g++ bench_busypoll.cpp -O2 -obench_busypoll -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_busypoll coserver.conf 1 20000 20             (busy_poll_us 0)
+// ./bench_busypoll coserver_busypoll.conf 1 20000 20    (busy_poll_us 200)
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include "coserver/base/co_context.h"
+
+using namespace coserver;
+
+/*
+    协程上下文切换延迟测试: glibc swapcontext vs coserver co_context_swap
+    每轮 main -> coroutine -> main 两次切换
+*/
+
+static const uint32_t STACK_SIZE = 128 * 1024;
+
+static uint64_t now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+
+// ucontext
+static ucontext_t g_ucMain;
+static ucontext_t g_ucCo;
+
+static void uc_func()
+{
+    for (;;) {
+        swapcontext(&g_ucCo, &g_ucMain);
+    }
+}
+
+static uint64_t bench_ucontext(uint64_t loops)
+{
+    char* stack = (char*)malloc(STACK_SIZE);
+    getcontext(&g_ucCo);
+    g_ucCo.uc_stack.ss_sp = stack;
+    g_ucCo.uc_stack.ss_size = STACK_SIZE;
+    g_ucCo.uc_link = NULL;
+    makecontext(&g_ucCo, &uc_func, 0);
+
+    uint64_t start = now_us();
+    for (uint64_t i=0; i<loops; ++i) {
+        swapcontext(&g_ucMain, &g_ucCo);
+    }
+    uint64_t useTime = now_us() - start;
+
+    free(stack);
+    return useTime;
+}
+
+// co_context
+static CoContext g_ctxMain;
+static CoContext g_ctxCo;
+
+static void ctx_func(void* arg)
+{
+    for (;;) {
+        co_context_swap(&g_ctxCo, &g_ctxMain);
+    }
+}
+
+static uint64_t bench_cocontext(uint64_t loops)
+{
+    char* stack = (char*)malloc(STACK_SIZE);
+    co_context_init(&g_ctxCo, stack, STACK_SIZE, &ctx_func, NULL);
+
+    uint64_t start = now_us();
+    for (uint64_t i=0; i<loops; ++i) {
+        co_context_swap(&g_ctxMain, &g_ctxCo);
+    }
+    uint64_t useTime = now_us() - start;
+
+    free(stack);
+    return useTime;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t loops = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    if (loops == 0) {
+        loops = 10000000;
+    }
+
+    uint64_t ucTime = bench_ucontext(loops);
+    uint64_t ctxTime = bench_cocontext(loops);
+
+    fprintf(stdout, "loops:%lu (2 switches per loop)\n", loops);
+    fprintf(stdout, "ucontext   total:%luus  per switch:%.2fns\n", ucTime, ucTime * 1000.0 / (loops * 2));
+    fprintf(stdout, "%-10s total:%luus  per switch:%.2fns\n", co_context_backend(), ctxTime, ctxTime * 1000.0 / (loops * 2));
+    return 0;
+}
+
+// g++ bench_context.cpp -O2 -obench_context -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_context 10000000
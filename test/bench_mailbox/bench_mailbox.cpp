@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_mailbox.h"
+
+using namespace coserver;
+
+/*
+    邮箱测试: 多个外部线程按key把消息投递到所属的worker线程, 消息在worker线程中更新线程独占的计数(不加锁)
+    统计投递吞吐 和投递到执行的延迟; 最后broadcast收集每个worker线程的数据 检查消息数量和路由是否正确
+*/
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+struct BenchMessage
+{
+    uint64_t m_key = 0;
+    uint64_t m_postUs = 0;
+};
+
+// worker线程独占的数据
+static thread_local uint64_t t_messages = 0;
+static thread_local uint64_t t_misrouted = 0;
+static thread_local std::vector<uint64_t> t_latencies;
+
+static std::atomic<uint64_t> g_handled(0);
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+    httpResp->append_content("ok");
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+    uint32_t producers = argc > 2 ? atoi(argv[2]) : 0;
+    uint32_t messages = argc > 3 ? atoi(argv[3]) : 0;
+    if (producers == 0) {
+        producers = 4;
+    }
+    if (messages == 0) {
+        messages = 200000;
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    CoTypedMailbox<BenchMessage> mailbox([](BenchMessage &message) {
+        t_messages ++;
+        if (CoMailbox::owner(message.m_key) != CoMailbox::cur_worker()) {
+            t_misrouted ++;
+        }
+        t_latencies.push_back(now_us() - message.m_postUs);
+        g_handled ++;
+    });
+
+    uint64_t total = (uint64_t)producers * messages;
+    uint64_t startUs = now_us();
+    std::vector<std::thread> threads;
+    for (uint32_t i=0; i<producers; ++i) {
+        threads.emplace_back([&mailbox, i, messages]() {
+            for (uint32_t j=0; j<messages; ++j) {
+                BenchMessage message;
+                message.m_key = (uint64_t)i * messages + j;
+                message.m_postUs = now_us();
+                mailbox.post_key(message.m_key, message);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    uint64_t postUs = now_us() - startUs;
+    while (g_handled.load() < total) {
+        usleep(1000);
+    }
+    uint64_t costUs = now_us() - startUs;
+
+    // 收集每个worker线程的数据
+    std::mutex mutex;
+    std::vector<uint64_t> latencies;
+    std::vector<uint64_t> workerMessages(CoMailbox::worker_count());
+    uint64_t misrouted = 0;
+    std::atomic<int32_t> collected(0);
+    int32_t workers = CoMailbox::broadcast([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies.insert(latencies.end(), t_latencies.begin(), t_latencies.end());
+        workerMessages[CoMailbox::cur_worker()] = t_messages;
+        misrouted += t_misrouted;
+        collected ++;
+    });
+    while (collected.load() < workers) {
+        usleep(1000);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t count = latencies.size();
+    fprintf(stdout, "producers:%u messages:%lu post:%.0f/s handle:%.0f/s, latency p50:%luus p99:%luus max:%luus, misrouted:%lu\n", producers, total, total * 1000000.0 / postUs, 
+            total * 1000000.0 / costUs, count ? latencies[count / 2] : 0, count ? latencies[count * 99 / 100] : 0, count ? latencies[count - 1] : 0, misrouted);
+    for (size_t i=0; i<workerMessages.size(); ++i) {
+        fprintf(stdout, "worker:%lu messages:%lu\n", i, workerMessages[i]);
+    }
+
+    coServer.shut_down();
+    return 0;
+}
+
+// g++ bench_mailbox.cpp -O2 -obench_mailbox -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_mailbox coserver.conf 4 200000
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_dispatcher.h"
+
+using namespace coserver;
+
+/*
+    辅助线程池测试: 一个worker线程 阻塞请求每个请求调用5ms不能hook的阻塞调用(直接系统调用nanosleep 模拟阻塞的文件/数据库客户端)
+    短请求(/short)直接返回, 统计短请求的延迟和阻塞请求的qps
+    /block在worker线程中直接调用 整个阻塞期间worker线程不能处理其他请求; /offload使用CoDispatcher::offload_value放到辅助线程池执行
+*/
+
+static const uint16_t BENCH_PORT = 15686;
+static const uint64_t BLOCK_US = 5000;          // 阻塞调用的时间
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+// 不经过hook的阻塞调用
+static std::string blocking_call(uint64_t us)
+{
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    syscall(SYS_nanosleep, &ts, NULL);
+    return "ok";
+}
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPRequest* httpReq = (CoHTTPRequest* )(requestData->m_protocol->get_reqmsg());
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    std::string result = "ok";
+    if (httpReq->get_url() == "/block") {
+        result = blocking_call(BLOCK_US);
+
+    } else if (httpReq->get_url() == "/offload") {
+        if (CO_OK != CoDispatcher::offload_value<std::string>([]() { return blocking_call(BLOCK_US); }, result)) {
+            return -1;
+        }
+    }
+
+    httpResp->append_content(result);
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// keepalive连接上发送一个请求 按Content-Length读取完整响应
+static bool http_get(int fd, const std::string &url)
+{
+    std::string request = "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.c_str(), request.size()) != (ssize_t)request.size()) {
+        return false;
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t readSize = 0;
+    while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, readSize);
+
+        size_t pos = response.find("\r\n\r\n");
+        size_t lenPos = response.find("Content-Length: ");
+        if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 阻塞请求客户端持续发送 同时测量短请求的延迟
+static void run_case(const std::string &blockUrl, uint32_t blockClients, uint32_t shortRequests)
+{
+    std::atomic<bool> run(true);
+    std::atomic<uint64_t> blockRequests(0);
+    std::vector<std::thread> clients;
+    for (uint32_t i=0; i<blockClients; ++i) {
+        clients.emplace_back([&]() {
+            int fd = connect_server();
+            while (fd >= 0 && run && http_get(fd, blockUrl)) {
+                blockRequests ++;
+            }
+            close(fd);
+        });
+    }
+    usleep(100000);
+
+    std::vector<uint64_t> latencies;
+    int fd = connect_server();
+    uint64_t startUs = now_us();
+    uint64_t startBlock = blockRequests.load();
+    for (uint32_t i=0; fd >= 0 && i<shortRequests; ++i) {
+        uint64_t requestUs = now_us();
+        if (!http_get(fd, "/short")) {
+            break;
+        }
+        latencies.push_back(now_us() - requestUs);
+        usleep(5000);
+    }
+    close(fd);
+    uint64_t costUs = now_us() - startUs;
+    uint64_t blockTotal = blockRequests.load() - startBlock;
+
+    run = false;
+    for (auto &client : clients) {
+        client.join();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t count = latencies.size();
+    fprintf(stdout, "%-10s block clients:%u block qps:%.1f, short:%lu latency p50:%luus p99:%luus max:%luus\n", blockUrl.c_str(), blockClients, blockTotal * 1000000.0 / costUs, count,
+            count ? latencies[count / 2] : 0, count ? latencies[count * 99 / 100] : 0, count ? latencies[count - 1] : 0);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+    uint32_t blockClients = argc > 2 ? atoi(argv[2]) : 0;
+    uint32_t shortRequests = argc > 3 ? atoi(argv[3]) : 0;
+    if (blockClients == 0) {
+        blockClients = 4;
+    }
+    if (shortRequests == 0) {
+        shortRequests = 200;
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    run_case("/block", blockClients, shortRequests);
+    run_case("/offload", blockClients, shortRequests);
+
+    CoOffloadPool* pool = CoOffloadPool::get_pool(OFFLOAD_POOL_DEFAULT);
+    fprintf(stdout, "offload pool submits:%lu rejects:%lu expired:%lu peak depth:%lu\n", pool->get_submits(), pool->get_rejects(), pool->get_expired(), pool->get_peak_depth());
+
+    coServer.shut_down();
+    return 0;
+}
+
+// g++ bench_offload.cpp -O2 -obench_offload -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_offload coserver.conf 4 200
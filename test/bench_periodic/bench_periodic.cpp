@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/upstream/co_upstream.h"
+
+using namespace coserver;
+
+/*
+    周期任务测试: 两个worker线程 每个线程运行两个周期任务, 同时客户端持续请求/get 统计请求延迟
+        refresh: 每20ms(jitter 10ms) 通过upstream子请求访问本服务的/version 更新线程本地的表版本, 再hook usleep 5ms模拟加载
+        slow:    每10ms执行 每次hook usleep 35ms, 上一次还在执行 大部分调度被跳过
+        warmup:  worker 0启动后执行一次
+    任务中的阻塞调用切出协程 不占用worker线程, /get的延迟不受影响; /get返回线程本地的表版本 检查刷新是否生效
+*/
+
+static const uint16_t BENCH_PORT = 15688;
+static const uint32_t REFRESH_INTERVAL_MS = 20;
+static const uint32_t REFRESH_JITTER_MS = 10;
+static const uint32_t SLOW_INTERVAL_MS = 10;
+static const uint32_t SLOW_RUN_MS = 35;
+
+static std::atomic<uint64_t> g_version(0);
+static std::atomic<uint64_t> g_refreshRuns(0);
+static std::atomic<uint64_t> g_refreshFails(0);
+static std::atomic<uint64_t> g_slowRuns(0);
+static std::atomic<uint64_t> g_warmups(0);
+static thread_local uint64_t t_tableVersion = 0;
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPRequest* httpReq = (CoHTTPRequest* )(requestData->m_protocol->get_reqmsg());
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    if (httpReq->get_url() == "/version") {
+        httpResp->append_content(std::to_string(++g_version));
+    } else {
+        httpResp->append_content(std::to_string(t_tableVersion));
+    }
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+int RefreshTask(CoUserHandlerData* taskData)
+{
+    if (CO_OK != CoUpstreamPool::add_upstream(taskData, "self", PROTOCOL_HTTP_CLIENT)) {
+        ++g_refreshFails;
+        return -1;
+    }
+    CoUpstreamInfo* upstreamInfo = taskData->m_upstreamInfos.back();
+    CoHTTPRequest* httpReq = (CoHTTPRequest* )(upstreamInfo->m_protocol->get_reqmsg());
+    httpReq->set_method("GET");
+    httpReq->set_url("/version");
+    httpReq->add_header("Connection", "Keep-Alive");
+
+    CoUpstreamPool::run_upstreams(taskData);
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(upstreamInfo->m_protocol->get_respmsg());
+    if (upstreamInfo->m_status != 0 || httpResp->get_content().empty()) {
+        ++g_refreshFails;
+        return -1;
+    }
+
+    // 模拟加载数据
+    usleep(5000);
+    t_tableVersion = strtoull(httpResp->get_content().c_str(), NULL, 10);
+    ++g_refreshRuns;
+    return 0;
+}
+
+int SlowTask(CoUserHandlerData* taskData)
+{
+    usleep(SLOW_RUN_MS * 1000);
+    ++g_slowRuns;
+    return 0;
+}
+
+int WarmupTask(CoUserHandlerData* taskData)
+{
+    ++g_warmups;
+    return 0;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// keepalive连接上发送一个请求 按Content-Length读取完整响应 返回响应内容
+static bool http_get(int fd, const std::string &url, std::string &content)
+{
+    std::string request = "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.c_str(), request.size()) != (ssize_t)request.size()) {
+        return false;
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t readSize = 0;
+    while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, readSize);
+
+        size_t pos = response.find("\r\n\r\n");
+        size_t lenPos = response.find("Content-Length: ");
+        if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+            content = response.substr(pos + 4);
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+    uint32_t seconds = argc > 2 ? atoi(argv[2]) : 0;
+    if (seconds == 0) {
+        seconds = 2;
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    coServer.add_periodic_task("refresh", RefreshTask, REFRESH_INTERVAL_MS, REFRESH_JITTER_MS);
+    coServer.add_periodic_task("slow", SlowTask, SLOW_INTERVAL_MS);
+    coServer.add_oneshot_task("warmup", WarmupTask, 0, 0);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    std::vector<uint64_t> latencies;
+    uint64_t staleVersions = 0;
+    int fd = connect_server();
+    uint64_t startUs = now_us();
+    while (fd >= 0 && now_us() - startUs < seconds * 1000000UL) {
+        std::string content;
+        uint64_t requestUs = now_us();
+        if (!http_get(fd, "/get", content)) {
+            break;
+        }
+        latencies.push_back(now_us() - requestUs);
+        if (strtoull(content.c_str(), NULL, 10) == 0) {
+            ++staleVersions;
+        }
+        usleep(1000);
+    }
+    close(fd);
+    double costSec = (now_us() - startUs) / 1000000.0;
+
+    uint64_t stopUs = now_us();
+    coServer.shut_down();
+    uint64_t shutdownUs = now_us() - stopUs;
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t count = latencies.size();
+    fprintf(stdout, "requests:%lu latency p50:%luus p99:%luus max:%luus, never refreshed:%lu\n", count, count ? latencies[count / 2] : 0,
+            count ? latencies[count * 99 / 100] : 0, count ? latencies[count - 1] : 0, staleVersions);
+    // 两个worker线程: refresh期望约 2*1000/(20+5)次/s, slow每次35ms 期望约 2*1000/40次/s
+    fprintf(stdout, "refresh runs:%lu (%.1f/s) fails:%lu, slow runs:%lu (%.1f/s), warmups:%lu, shutdown:%luus\n", g_refreshRuns.load(), g_refreshRuns.load() / costSec,
+            g_refreshFails.load(), g_slowRuns.load(), g_slowRuns.load() / costSec, g_warmups.load(), shutdownUs);
+    return 0;
+}
+
+// g++ bench_periodic.cpp -O2 -obench_periodic -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_periodic coserver.conf 2
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_task.h"
+
+using namespace coserver;
+
+/*
+    优先级调度测试: 一个worker线程 批量请求(bulk)每个请求创建多个计算型子协程, 延迟队列中一直积压任务
+    健康检查(probe)每次使用新连接 新连接在延迟队列中排队, 统计健康检查的延迟
+    coserver.conf两个server都是normal优先级(FIFO), coserver_priority.conf中probe为high bulk为low
+*/
+
+static const uint16_t BULK_PORT = 15683;
+static const uint16_t PROBE_PORT = 15684;
+static const int32_t BULK_TASKS = 16;           // 每个批量请求创建的子协程数量
+static const uint64_t BULK_TASK_US = 200;       // 每个子协程的计算时间
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static void burn_cpu(uint64_t us)
+{
+    uint64_t startUs = now_us();
+    while (now_us() - startUs < us) {
+    }
+}
+
+int BulkProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    CoWaitGroup waitGroup;
+    for (int32_t i=0; i<BULK_TASKS; ++i) {
+        CoTask::spawn([]() { burn_cpu(BULK_TASK_US); }, &waitGroup);
+    }
+    waitGroup.wait();
+
+    httpResp->append_content("bulk");
+    return 0;
+}
+
+int ProbeProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+    httpResp->append_content("ok");
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+static int connect_server(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// 发送一个请求 按Content-Length读取完整响应
+static bool http_get(int fd, const std::string &url)
+{
+    std::string request = "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.c_str(), request.size()) != (ssize_t)request.size()) {
+        return false;
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t readSize = 0;
+    while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, readSize);
+
+        size_t pos = response.find("\r\n\r\n");
+        size_t lenPos = response.find("Content-Length: ");
+        if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+    uint32_t bulkClients = argc > 2 ? atoi(argv[2]) : 0;
+    uint32_t probes = argc > 3 ? atoi(argv[3]) : 0;
+    if (bulkClients == 0) {
+        bulkClients = 16;
+    }
+    if (probes == 0) {
+        probes = 200;
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("bulk", BulkProcess, BusinessDestroy);
+    coServer.add_user_handlers("probe", ProbeProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    // 批量请求 keepalive连接持续发送
+    std::atomic<bool> run(true);
+    std::atomic<uint64_t> bulkRequests(0);
+    std::vector<std::thread> clients;
+    for (uint32_t i=0; i<bulkClients; ++i) {
+        clients.emplace_back([&]() {
+            int fd = connect_server(BULK_PORT);
+            while (fd >= 0 && run && http_get(fd, "/bulk")) {
+                bulkRequests ++;
+            }
+            close(fd);
+        });
+    }
+    usleep(100000);
+
+    // 健康检查 每次新连接 间隔10ms
+    std::vector<uint64_t> latencies;
+    uint64_t startUs = now_us();
+    uint64_t startBulk = bulkRequests.load();
+    for (uint32_t i=0; i<probes; ++i) {
+        uint64_t probeUs = now_us();
+        int fd = connect_server(PROBE_PORT);
+        if (fd >= 0 && http_get(fd, "/probe")) {
+            latencies.push_back(now_us() - probeUs);
+        }
+        close(fd);
+        usleep(10000);
+    }
+    uint64_t costUs = now_us() - startUs;
+    uint64_t bulkTotal = bulkRequests.load() - startBulk;
+
+    run = false;
+    for (auto &client : clients) {
+        client.join();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t count = latencies.size();
+    fprintf(stdout, "bulk clients:%u bulk qps:%.0f, probes:%lu latency p50:%luus p99:%luus max:%luus\n", bulkClients, bulkTotal * 1000000.0 / costUs, count,
+            count ? latencies[count / 2] : 0, count ? latencies[count * 99 / 100] : 0, count ? latencies[count - 1] : 0);
+
+    coServer.shut_down();
+    return 0;
+}
+
+// g++ bench_priority.cpp -O2 -obench_priority -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_priority coserver.conf 16 200
+// ./bench_priority coserver_priority.conf 16 200
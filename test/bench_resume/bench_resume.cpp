@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_cycle.h"
+
+using namespace coserver;
+
+/*
+    异步恢复测试: 处理函数把协程数据交给外部线程后切出, 外部线程调用CoDispatcher::resume_async恢复协程
+    多个外部线程同时恢复同一个worker线程的协程, 统计QPS和需要eventfd唤醒worker线程的次数
+    worker线程没有阻塞等待事件时(正在处理其他请求) 恢复只放入无锁队列 不需要唤醒
+*/
+
+static const uint16_t BENCH_PORT = 15682;
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+// 外部线程 模拟第三方异步库的回调线程
+struct Resumer
+{
+    std::mutex                                  m_mutex;
+    std::condition_variable                     m_cond;
+    std::deque<std::pair<void*, uint32_t>>      m_tasks;
+};
+
+static std::vector<Resumer*> g_resumers;
+static std::atomic<uint32_t> g_resumerIndex(0);
+static std::atomic<bool> g_run(true);
+
+static void resumer_func(Resumer* resumer)
+{
+    while (g_run) {
+        std::pair<void*, uint32_t> coroutineData;
+        {
+            std::unique_lock<std::mutex> lock(resumer->m_mutex);
+            resumer->m_cond.wait_for(lock, std::chrono::milliseconds(100), [resumer]{ return !resumer->m_tasks.empty(); });
+            if (resumer->m_tasks.empty()) {
+                continue;
+            }
+            coroutineData = resumer->m_tasks.front();
+            resumer->m_tasks.pop_front();
+        }
+        CoDispatcher::resume_async(coroutineData);
+    }
+}
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPRequest* httpReq = (CoHTTPRequest* )(requestData->m_protocol->get_reqmsg());
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    if (httpReq->get_url() == "/stats") {
+        // 处理函数在worker线程中运行 读取当前线程的统计
+        CoCycle* cycle = GET_TLS()->m_coCycle;
+        const CoEventBackendStats &stats = cycle->m_coEpoll->get_backend()->get_stats();
+
+        char result[256];
+        snprintf(result, sizeof(result), "%lu %lu %lu", stats.m_waits, cycle->m_dispatcher->m_resumePushes.load(), cycle->m_dispatcher->m_resumeNotifies.load());
+        httpResp->append_content(result);
+        return 0;
+    }
+
+    // 交给外部线程 切出协程等待恢复
+    Resumer* resumer = g_resumers[g_resumerIndex ++ % g_resumers.size()];
+    {
+        std::lock_guard<std::mutex> lock(resumer->m_mutex);
+        resumer->m_tasks.push_back(requestData->m_coroutineData);
+    }
+    resumer->m_cond.notify_one();
+    CoDispatcher::yield(requestData->m_coroutineData);
+
+    httpResp->append_content("hello");
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// keepalive连接上发送一个请求 按Content-Length读取完整响应
+static bool http_get(int fd, const std::string &url, std::string &body)
+{
+    std::string request = "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.c_str(), request.size()) != (ssize_t)request.size()) {
+        return false;
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t readSize = 0;
+    while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, readSize);
+
+        size_t pos = response.find("\r\n\r\n");
+        size_t lenPos = response.find("Content-Length: ");
+        if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+            body = response.substr(pos + 4);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct ResumeStats
+{
+    uint64_t    m_waits;
+    uint64_t    m_pushes;
+    uint64_t    m_notifies;
+};
+
+static bool get_stats(ResumeStats &stats)
+{
+    int fd = connect_server();
+    std::string body;
+    bool ret = fd >= 0 && http_get(fd, "/stats", body);
+    close(fd);
+    return ret && sscanf(body.c_str(), "%lu %lu %lu", &stats.m_waits, &stats.m_pushes, &stats.m_notifies) == 3;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+    uint32_t connections = argc > 2 ? atoi(argv[2]) : 0;
+    uint32_t requests = argc > 3 ? atoi(argv[3]) : 0;
+    uint32_t resumers = argc > 4 ? atoi(argv[4]) : 0;
+    if (connections == 0) {
+        connections = 32;
+    }
+    if (requests == 0) {
+        requests = 5000;
+    }
+    if (resumers == 0) {
+        resumers = 4;
+    }
+
+    std::vector<std::thread> resumerThreads;
+    for (uint32_t i=0; i<resumers; ++i) {
+        g_resumers.push_back(new Resumer);
+        resumerThreads.emplace_back(resumer_func, g_resumers.back());
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    ResumeStats begin, end;
+    if (!get_stats(begin)) {
+        fprintf(stdout, "get stats failed\n");
+        coServer.shut_down();
+        return -1;
+    }
+
+    std::atomic<uint64_t> success(0);
+    std::vector<std::thread> clients;
+    uint64_t startUs = now_us();
+    for (uint32_t i=0; i<connections; ++i) {
+        clients.emplace_back([&]() {
+            int fd = connect_server();
+            std::string body;
+            for (uint32_t n=0; fd >= 0 && n<requests; ++n) {
+                if (!http_get(fd, "/hello", body)) {
+                    break;
+                }
+                success ++;
+            }
+            close(fd);
+        });
+    }
+    for (auto &client : clients) {
+        client.join();
+    }
+    uint64_t costUs = now_us() - startUs;
+    get_stats(end);
+
+    uint64_t total = success.load();
+    fprintf(stdout, "connections:%u resumers:%u requests:%lu cost:%.2fs qps:%.0f\n", connections, resumers, total, costUs / 1000000.0, total * 1000000.0 / costUs);
+    fprintf(stdout, "per request  waits:%.2f resume pushes:%.2f eventfd notifies:%.2f\n", total ? (double)(end.m_waits - begin.m_waits) / total : 0.0, 
+            total ? (double)(end.m_pushes - begin.m_pushes) / total : 0.0, total ? (double)(end.m_notifies - begin.m_notifies) / total : 0.0);
+
+    coServer.shut_down();
+    g_run = false;
+    for (auto &thread : resumerThreads) {
+        thread.join();
+    }
+    return 0;
+}
+
+// g++ bench_resume.cpp -O2 -obench_resume -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_resume coserver.conf 32 5000 4
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+
+using namespace coserver;
+
+/*
+    定时器延迟测试: 处理函数中循环usleep, 统计实际唤醒时间比预期晚多少(lateness, 负数表示提前唤醒)
+    分别使用 timer_resolution ms / us 的配置运行, 对比时间轮(ms取整)和timerfd的精度
+*/
+
+static const uint16_t BENCH_PORT = 15679;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPRequest* httpReq = (CoHTTPRequest* )(requestData->m_protocol->get_reqmsg());
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    uint32_t sleepUs = atoi(httpReq->get_paramvalue("us").c_str());
+    uint32_t loops = atoi(httpReq->get_paramvalue("n").c_str());
+
+    std::vector<int64_t> lateness;
+    lateness.reserve(loops);
+    for (uint32_t i=0; i<loops; ++i) {
+        uint64_t start = now_ns();
+        usleep(sleepUs);
+        lateness.push_back((int64_t)(now_ns() - start) - sleepUs * 1000L);
+    }
+    std::sort(lateness.begin(), lateness.end());
+
+    int64_t total = 0;
+    for (auto late : lateness) {
+        total += late;
+    }
+
+    char result[256];
+    snprintf(result, sizeof(result), "sleep:%6uus loops:%u  lateness avg:%8.1fus p50:%8.1fus p99:%8.1fus max:%8.1fus\n", sleepUs, loops,
+            total / 1000.0 / loops, lateness[loops / 2] / 1000.0, lateness[loops * 99 / 100] / 1000.0, lateness[loops - 1] / 1000.0);
+    httpResp->append_content(result);
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+static std::string http_get(const std::string &url)
+{
+    std::string response;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 == connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        std::string request = "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        if (write(fd, request.c_str(), request.size()) > 0) {
+            char buffer[4096];
+            ssize_t readSize = 0;
+            while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+                response.append(buffer, readSize);
+
+                // 服务端保持连接 按Content-Length判断响应结束
+                size_t pos = response.find("\r\n\r\n");
+                size_t lenPos = response.find("Content-Length: ");
+                if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+                    break;
+                }
+            }
+        }
+    }
+    close(fd);
+
+    size_t pos = response.find("\r\n\r\n");
+    return pos == std::string::npos ? response : response.substr(pos + 4);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+    uint32_t loops = argc > 2 ? atoi(argv[2]) : 0;
+    if (loops == 0) {
+        loops = 1000;
+    }
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    fprintf(stdout, "conf:%s\n", confFile);
+    uint32_t sleeps[] = {50, 200, 500, 1500, 5000};
+    for (auto sleepUs : sleeps) {
+        // 长时间sleep减少循环次数
+        uint32_t n = sleepUs >= 1000 ? loops / 10 : loops;
+        fprintf(stdout, "%s", http_get("/timer?us=" + std::to_string(sleepUs) + "&n=" + std::to_string(n)).c_str());
+    }
+
+    coServer.shut_down();
+    return 0;
+}
+
+// g++ bench_timer.cpp -O2 -obench_timer -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./bench_timer coserver.conf 1000         (timer_resolution ms)
+// ./bench_timer coserver_us.conf 1000      (timer_resolution us)
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <string>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_local.h"
+
+using namespace coserver;
+
+/*
+    协程本地存储测试: CoLocal<Outer>的构造函数中使用后定义(槽位下标更大)的CoLocal<Inner>, 嵌套get时m_slots扩容
+    每个请求检查: Outer只构造一次, 再次get返回同一个对象 并且保留修改, Outer引用的Inner和直接get的Inner相同
+    keepalive连接上的后续请求在原内存上重新构造
+*/
+
+static const uint16_t TEST_PORT = 15689;
+
+struct Inner
+{
+    int32_t m_value = 7;
+};
+
+struct Outer
+{
+    Outer();
+
+    Inner*  m_inner = NULL;
+    int32_t m_count = 0;
+};
+
+static CoLocal<Outer> g_outer;
+static CoLocal<Inner> g_inner;     // 在g_outer之后定义 槽位下标更大
+static __thread int32_t g_outerConstructs = 0;
+
+Outer::Outer()
+{
+    ++g_outerConstructs;
+    m_inner = g_inner.get();
+}
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    g_outerConstructs = 0;
+    Outer* outer = g_outer.get(requestData);
+    if (outer) {
+        outer->m_count ++;
+    }
+    Outer* again = g_outer.get(requestData);
+    Inner* inner = g_inner.get(requestData);
+
+    bool ok = outer && outer == again && again->m_count == 1 && g_outerConstructs == 1 && inner && outer->m_inner == inner && inner->m_value == 7;
+    httpResp->append_content(ok ? "ok" : "fail");
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TEST_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// keepalive连接上发送一个请求 按Content-Length读取完整响应 返回响应包体
+static std::string http_get(int fd, const std::string &url)
+{
+    std::string request = "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.c_str(), request.size()) != (ssize_t)request.size()) {
+        return "";
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t readSize = 0;
+    while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, readSize);
+
+        size_t pos = response.find("\r\n\r\n");
+        size_t lenPos = response.find("Content-Length: ");
+        if (pos != std::string::npos && lenPos != std::string::npos && response.size() >= pos + 4 + atoi(response.c_str() + lenPos + 16)) {
+            return response.substr(pos + 4);
+        }
+    }
+    return "";
+}
+
+int main(int argc, char* argv[])
+{
+    const char* confFile = argc > 1 ? argv[1] : "./coserver.conf";
+
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server(confFile, 0)) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+    usleep(100000);
+
+    // 多个连接 每个连接上多个keepalive请求
+    int32_t oks = 0, fails = 0;
+    for (int32_t i=0; i<4; ++i) {
+        int fd = connect_server();
+        for (int32_t j=0; j<8; ++j) {
+            std::string body = fd >= 0 ? http_get(fd, "/local") : "";
+            if (body == "ok") {
+                oks ++;
+            } else {
+                fails ++;
+                fprintf(stdout, "FAIL connection:%d request:%d response:%s\n", i, j, body.c_str());
+            }
+        }
+        close(fd);
+    }
+    fprintf(stdout, "nested colocal ok:%d fail:%d\n", oks, fails);
+
+    coServer.shut_down();
+    return fails == 0 ? 0 : 1;
+}
+
+// g++ test_local.cpp -O2 -otest_local -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver -I/usr/local/include
+// ./test_local coserver.conf
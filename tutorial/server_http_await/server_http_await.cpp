@@ -0,0 +1,107 @@
+#include <fcntl.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_await.h"
+
+using namespace coserver;
+
+CoAwaitTask BusinessProcess(CoUserHandlerData* requestData);
+int BusinessDestroy(CoUserHandlerData* requestData);
+
+int main()
+{
+    CoServer coServer;
+    coServer.add_await_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server("./coserver.conf")) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+
+    coServer.shut_down();
+    fprintf(stdout, "coserver runforever complete\n");
+    return 0;
+}
+
+// 非阻塞socket访问http服务 不可读/不可写时co_await等待
+CoAwaitTask ThirdGet(CoUserHandlerData* requestData, uint16_t port, const std::string &url, std::string* response)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    int32_t ret = CO_ERROR;
+    if (0 == connect(fd, (struct sockaddr*)&addr, sizeof(addr)) || EINPROGRESS == errno) {
+        ret = co_await CoAwait::write(requestData, fd, 1000);
+    }
+
+    std::string request = "GET " + url + " HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n";
+    if (CO_OK == ret && write(fd, request.c_str(), request.size()) > 0) {
+        char buffer[4096];
+        for ( ; ; ) {
+            ssize_t readSize = read(fd, buffer, sizeof(buffer));
+            if (readSize > 0) {
+                response->append(buffer, readSize);
+                continue;
+            }
+
+            if (readSize < 0 && EAGAIN == errno) {
+                ret = co_await CoAwait::read(requestData, fd, 1000);
+                if (CO_OK == ret) {
+                    continue;
+                }
+            }
+            break;
+        }
+    }
+    close(fd);
+
+    co_return ret;
+}
+
+CoAwaitTask BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    // 定时器
+    co_await CoAwait::sleep(requestData, 10);
+
+    // 第三方socket
+    std::string response;
+    int32_t ret = co_await ThirdGet(requestData, 10080, "/coserver.txt", &response);
+    fprintf(stdout, "third ret:%d response size:%lu\n", ret, response.size());
+
+    // upstream子请求
+    if (CO_OK == CoUpstreamPool::add_upstream(requestData, "backend", PROTOCOL_HTTP_CLIENT)) {
+        CoHTTPRequest* httpReq = (CoHTTPRequest* )(requestData->m_upstreamInfos.back()->m_protocol->get_reqmsg());
+        httpReq->set_method("GET");
+        httpReq->set_url("/coserver.txt");
+
+        co_await CoAwait::upstreams(requestData);
+
+        for (auto &upstreamInfo : requestData->m_upstreamInfos) {
+            CoHTTPResponse* upstreamResp = (CoHTTPResponse* )(upstreamInfo->m_protocol->get_respmsg());
+            httpResp->append_content(upstreamResp->get_content());
+        }
+    }
+
+    httpResp->append_content(response);
+    co_return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    return 0;
+}
+
+// make FLAGS="-DCO_AWAIT -std=c++20"
+// g++ server_http_await.cpp -g -oserver_http_await -std=c++20 -DCO_AWAIT -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver
+// curl -v "http://127.0.0.1:15678/await"
+// python -m SimpleHTTPServer 10080
@@ -0,0 +1,91 @@
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "coserver/core/co_server.h"
+#include "coserver/core/co_request.h"
+#include "coserver/core/co_task.h"
+
+using namespace coserver;
+
+int BusinessProcess(CoUserHandlerData* requestData);
+int BusinessDestroy(CoUserHandlerData* requestData);
+
+int main()
+{
+    CoServer coServer;
+    coServer.add_user_handlers("server", BusinessProcess, BusinessDestroy);
+    if (CO_OK != coServer.run_server("./coserver.conf")) {
+        fprintf(stdout, "coserver init failed\n");
+        return -1;
+    }
+
+    coServer.shut_down();
+    fprintf(stdout, "coserver runforever complete\n");
+    return 0;
+}
+
+// 模拟第三方客户端库: 阻塞socket访问http服务
+std::string ThirdBlockingGet(uint16_t port, const std::string &url)
+{
+    std::string response;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (0 == connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        std::string request = "GET " + url + " HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n";
+        if (write(fd, request.c_str(), request.size()) > 0) {
+            char buffer[4096];
+            ssize_t readSize = 0;
+            while ((readSize = read(fd, buffer, sizeof(buffer))) > 0) {
+                response.append(buffer, readSize);
+            }
+        }
+    }
+    close(fd);
+
+    return response;
+}
+
+int BusinessProcess(CoUserHandlerData* requestData)
+{
+    CoHTTPResponse* httpResp = (CoHTTPResponse* )(requestData->m_protocol->get_respmsg());
+
+    // 两个第三方阻塞调用并行执行 共享栈模式下子协程不能引用当前栈上的变量, 使用channel传递结果
+    CoWaitGroup waitGroup;
+    CoChannel<std::string> channel(2);
+
+    CoTask::spawn([channel]() mutable {
+        channel.send(ThirdBlockingGet(10080, "/coserver.txt"));
+    }, &waitGroup);
+
+    CoTask::spawn([channel]() mutable {
+        channel.send(ThirdBlockingGet(10081, "/coserver.txt"));
+    }, &waitGroup);
+
+    if (CO_OK != waitGroup.wait()) {
+        fprintf(stderr, "ERROR wait spawn tasks failed\n");
+        return -1;
+    }
+
+    std::string response;
+    while (channel.size() > 0 && CO_OK == channel.recv(response)) {
+        fprintf(stdout, "third response size:%lu\n", response.size());
+        httpResp->append_content(response);
+    }
+
+    return 0;
+}
+
+int BusinessDestroy(CoUserHandlerData* requestData)
+{
+    fprintf(stdout, "business handler destroy\n");
+}
+
+// g++ server_http_spawn.cpp -g -oserver_http_spawn -std=c++11 -lcoserver -lpthread -ldl -L/usr/local/lib64 -I/usr/local/include/coserver
+// curl -v "http://127.0.0.1:15678/spawn"
+// python -m SimpleHTTPServer 10080 & python -m SimpleHTTPServer 10081